@@ -0,0 +1,62 @@
+//! See https://isatec.ca/fastcgipp/coroutine.html
+//! [Request definition]
+#include <fastcgi++/coroutine.hpp>
+
+class Countdown: public Fastcgipp::CoRequest<char>
+{
+    //! [Request definition]
+    //! [Response]
+    Fastcgipp::Task response()
+    {
+        out <<
+"Content-Type: text/html; charset=iso-8859-1\r\n\r\n"
+"<!DOCTYPE html>\n"
+"<html lang='en'>"
+    "<head>"
+        "<meta charset='iso-8859-1' />"
+        "<title>fastcgi++: Coroutine</title>"
+    "</head>"
+    "<body>"
+        "<p>";
+
+        for(unsigned time=0; time<5; ++time)
+        {
+            out << time << "...";
+            out.flush();
+            co_await sleep(std::chrono::seconds(1));
+        }
+        out << "5</p>";
+        //! [Response]
+
+        //! [Concurrent]
+        const auto start = std::chrono::steady_clock::now();
+        auto first = sleep(std::chrono::seconds(1));
+        auto second = sleep(std::chrono::seconds(1));
+        co_await first;
+        co_await second;
+        out << "<p>Two one second sleeps took "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now()-start).count()
+            << " milliseconds</p>"
+    "</body>"
+"</html>";
+    }
+};
+//! [Concurrent]
+
+//! [Finish]
+#include <fastcgi++/manager.hpp>
+
+int main()
+{
+    Fastcgipp::Manager<Countdown> manager;
+    manager.setupSignals();
+    manager.listen();
+    manager.start();
+    manager.join();
+
+    Fastcgipp::Alarms::stop();
+
+    return 0;
+}
+//! [Finish]
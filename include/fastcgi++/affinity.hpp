@@ -0,0 +1,68 @@
+/*!
+ * @file       affinity.hpp
+ * @brief      Declares the CPU placement functions
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_AFFINITY_HPP
+#define FASTCGIPP_AFFINITY_HPP
+
+#include <vector>
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! The CPUs the calling thread is allowed to run on
+    /*!
+     * @return CPU numbers in ascending order. Empty if this isn't supported
+     *         on the platform.
+     */
+    std::vector<unsigned> allowedCpus();
+
+    //! The CPUs belonging to a NUMA node
+    /*!
+     * Pin threads to these to keep them and the memory they allocate on the
+     * same node.
+     *
+     * @param[in] node NUMA node number.
+     * @return CPU numbers in ascending order. Empty if the node doesn't exist
+     *         or this isn't supported on the platform.
+     */
+    std::vector<unsigned> nodeCpus(unsigned node);
+
+    //! Restrict the calling thread to a set of CPUs
+    /*!
+     * Memory the thread touches for the first time afterwards is allocated
+     * on the NUMA node of those CPUs, so pin a thread before it allocates
+     * its buffers.
+     *
+     * @param[in] cpus CPUs to run on.
+     * @return True on success. False on failure or if this isn't supported
+     *         on the platform.
+     */
+    bool pinThread(const std::vector<unsigned>& cpus);
+}
+
+#endif
@@ -0,0 +1,513 @@
+/*!
+ * @file       coroutine.hpp
+ * @brief      Declares the Fastcgipp::CoRequest class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_COROUTINE_HPP
+#define FASTCGIPP_COROUTINE_HPP
+
+#if !defined(__cpp_impl_coroutine)
+#error "fastcgi++/coroutine.hpp needs a C++20 compiler with coroutines"
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "fastcgi++/curler.hpp"
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/request.hpp"
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Return type of a CoRequest::response() coroutine
+    /*!
+     * It owns the coroutine. Nothing runs until CoRequest resumes it the first
+     * time and the coroutine stays suspended at its end so CoRequest can tell
+     * that it is done.
+     */
+    class Task
+    {
+    public:
+        struct promise_type
+        {
+            //! Anything the coroutine let escape
+            std::exception_ptr exception;
+
+            Task get_return_object()
+            {
+                return Task(
+                        std::coroutine_handle<promise_type>::from_promise(
+                            *this));
+            }
+
+            std::suspend_always initial_suspend() noexcept
+            {
+                return {};
+            }
+
+            std::suspend_always final_suspend() noexcept
+            {
+                return {};
+            }
+
+            void return_void()
+            {}
+
+            void unhandled_exception()
+            {
+                exception = std::current_exception();
+            }
+        };
+
+        Task():
+            m_handle(nullptr)
+        {}
+
+        Task(Task&& x):
+            m_handle(x.m_handle)
+        {
+            x.m_handle = nullptr;
+        }
+
+        Task& operator=(Task&& x)
+        {
+            if(this != &x)
+            {
+                if(m_handle)
+                    m_handle.destroy();
+                m_handle = x.m_handle;
+                x.m_handle = nullptr;
+            }
+            return *this;
+        }
+
+        Task(const Task&) =delete;
+        Task& operator=(const Task&) =delete;
+
+        ~Task()
+        {
+            if(m_handle)
+                m_handle.destroy();
+        }
+
+        //! True if we have a coroutine
+        explicit operator bool() const
+        {
+            return bool(m_handle);
+        }
+
+        //! True if the coroutine has run to its end
+        bool done() const
+        {
+            return m_handle.done();
+        }
+
+        //! Run the coroutine until it suspends again
+        void resume()
+        {
+            m_handle.resume();
+        }
+
+        //! Anything the coroutine let escape
+        std::exception_ptr exception() const
+        {
+            return m_handle.promise().exception;
+        }
+
+    private:
+        explicit Task(std::coroutine_handle<promise_type> handle):
+            m_handle(handle)
+        {}
+
+        std::coroutine_handle<promise_type> m_handle;
+    };
+
+    //! A thread that sends messages once their time has come
+    /*!
+     * This is what CoRequest::sleep() uses. The thread is started by the
+     * first set(). Call stop() after Manager::join() so nothing is sent to a
+     * Manager that has gone away.
+     */
+    class Alarms
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        //! Send a message through a callback at a specific time
+        static void set(
+                Clock::time_point deadline,
+                const std::function<void(Message)>& callback,
+                Message&& message)
+        {
+            Alarms& alarms = instance();
+            std::lock_guard<std::mutex> lock(alarms.m_mutex);
+            if(!alarms.m_thread.joinable())
+            {
+                alarms.m_stop = false;
+                alarms.m_thread = std::thread(&Alarms::handler, &alarms);
+            }
+            alarms.m_alarms.emplace(
+                    deadline,
+                    Alarm{callback, std::move(message)});
+            alarms.m_wake.notify_one();
+        }
+
+        //! Discard every pending alarm and stop the thread
+        static void stop()
+        {
+            Alarms& alarms = instance();
+            std::unique_lock<std::mutex> lock(alarms.m_mutex);
+            alarms.m_alarms.clear();
+            if(alarms.m_thread.joinable())
+            {
+                alarms.m_stop = true;
+                alarms.m_wake.notify_one();
+                lock.unlock();
+                alarms.m_thread.join();
+            }
+        }
+
+    private:
+        struct Alarm
+        {
+            std::function<void(Message)> callback;
+            Message message;
+        };
+
+        std::multimap<Clock::time_point, Alarm> m_alarms;
+        std::thread m_thread;
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        bool m_stop;
+
+        Alarms():
+            m_stop(false)
+        {}
+
+        ~Alarms()
+        {
+            stop();
+        }
+
+        static Alarms& instance()
+        {
+            static Alarms alarms;
+            return alarms;
+        }
+
+        void handler()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while(!m_stop)
+            {
+                if(m_alarms.empty())
+                    m_wake.wait(lock);
+                else if(m_alarms.begin()->first <= Clock::now())
+                {
+                    Alarm alarm(std::move(m_alarms.begin()->second));
+                    m_alarms.erase(m_alarms.begin());
+                    alarm.callback(std::move(alarm.message));
+                }
+                else
+                    m_wake.wait_until(lock, m_alarms.begin()->first);
+            }
+        }
+    };
+
+    //! %Request handled by a coroutine
+    /*!
+     * Derivations define a response() coroutine instead of responseProcess().
+     * It is started once all client data is organized and whenever it
+     * suspends on a co_await the worker thread is free to handle other
+     * requests. Every operation that completes with a Message, be it an SQL
+     * query, a Curl, a sleep() or anything else that calls callback(), brings
+     * that Message back through the Manager and the coroutine is resumed on a
+     * worker thread just as responseProcess() would have been.
+     *
+     * Operations start when they are called, not when they are awaited. To
+     * run some concurrently call them all first and co_await them after.
+     * @code
+     * auto first = query(connection, firstQuery);
+     * auto second = fetch(curler, curl);
+     * co_await first;
+     * co_await second;
+     * @endcode
+     *
+     * Each operation is given a negative Message type of its own so they never
+     * mix up. The types are unique across requests too, so an operation that
+     * completes after its request has ended is never mistaken for one of the
+     * next request to reuse the same RequestId. Positive types are left for
+     * messages sent through callback() and are awaited with message().
+     * Anything arriving while the coroutine waits for something else is held
+     * until it is awaited.
+     *
+     * Everything the coroutine uses across a co_await must live in its frame
+     * or in the request. Should the request be killed or time out the
+     * coroutine is simply destroyed where it is suspended. Operations still in
+     * flight are not cancelled, so whatever is handed to fetch() or query()
+     * must outlive the request and not just the coroutine frame.
+     *
+     * @tparam charT Character type for internal processing (wchar_t or char)
+     *
+     * @date    October 16, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    template<class charT> class CoRequest: public Request<charT>
+    {
+    public:
+        //! @sa Request::Request()
+        CoRequest(const size_t maxPostSize=0):
+            Request<charT>(maxPostSize),
+            m_awaiting(0)
+        {}
+
+        void reset()
+        {
+            m_task = Task();
+            m_arrived.clear();
+            m_resumed = Message();
+            m_awaiting = 0;
+            Request<charT>::reset();
+        }
+
+    protected:
+        //! What co_await on an operation gets
+        /*!
+         * The result is the Message that completed the operation.
+         */
+        class Awaiter
+        {
+        public:
+            Awaiter(CoRequest& request, int type):
+                m_request(request),
+                m_type(type)
+            {}
+
+            bool await_ready()
+            {
+                return m_request.take(m_type, m_message);
+            }
+
+            void await_suspend(std::coroutine_handle<>)
+            {
+                m_request.m_awaiting = m_type;
+            }
+
+            Message await_resume()
+            {
+                if(m_request.m_awaiting == m_type)
+                {
+                    m_request.m_awaiting = 0;
+                    return std::move(m_request.m_resumed);
+                }
+                return std::move(m_message);
+            }
+
+        private:
+            CoRequest& m_request;
+            const int m_type;
+            Message m_message;
+        };
+
+        //! The coroutine that generates the response
+        /*!
+         * Called once all request data has been received from the other side.
+         * The response is complete once it co_returns.
+         */
+        virtual Task response() =0;
+
+        //! Await a Message of a type of our own sent through callback()
+        Awaiter message(int type)
+        {
+            return Awaiter(*this, type);
+        }
+
+        //! Start any operation that completes by calling a callback
+        /*!
+         * @param[in] start Function that starts the operation with the
+         *                  callback it should send its Message through.
+         */
+        Awaiter async(
+                const std::function<void(const std::function<void(Message)>&)>&
+                    start)
+        {
+            const int type = nextType();
+            start(tagged(type));
+            return Awaiter(*this, type);
+        }
+
+        //! Await a period of time
+        template<class Rep, class Period>
+        Awaiter sleep(const std::chrono::duration<Rep, Period>& duration)
+        {
+            return async([&] (const std::function<void(Message)>& callback)
+                    {
+                        Alarms::set(
+                                Alarms::Clock::now()+duration,
+                                callback,
+                                Message());
+                    });
+        }
+
+        //! Queue up a Curl and await its completion
+        /*!
+         * The curler and the curl must outlive the request.
+         */
+        Awaiter fetch(Curler& curler, Curl_base& curl)
+        {
+            return async([&] (const std::function<void(Message)>& callback)
+                    {
+                        curl.setCallback(callback);
+                        curler.queue(curl);
+                    });
+        }
+
+        //! Queue up an SQL::Query and await its completion
+        /*!
+         * This is a template only because the %SQL headers are installed
+         * separately. If the connection won't take the query it completes
+         * right away with the results untouched. The connection and
+         * everything the query points to must outlive the request.
+         *
+         * @tparam Connection SQL::Connection
+         * @tparam Query SQL::Query
+         */
+        template<class Connection, class Query>
+        Awaiter query(Connection& connection, Query query)
+        {
+            return async([&] (const std::function<void(Message)>& callback)
+                    {
+                        query.callback = callback;
+                        if(!connection.queue(query))
+                            callback(Message());
+                    });
+        }
+
+    private:
+        //! First Message type handed out to our own operations
+        /*!
+         * Message::timeout is -1 and never reaches us.
+         */
+        static const int s_firstType = -2;
+
+        //! Next Message type for our own operations
+        /*!
+         * The types are handed out from one counter shared by every request
+         * and only repeat after INT_MAX-1 operations.
+         */
+        static int nextType()
+        {
+            static std::atomic_uint count(0);
+            return s_firstType-static_cast<int>(count++%(INT_MAX-1));
+        }
+
+        //! The response() coroutine once it has been started
+        Task m_task;
+
+        //! Messages that arrived before they were awaited
+        std::deque<Message> m_arrived;
+
+        //! The Message the coroutine was last resumed with
+        Message m_resumed;
+
+        //! Type the suspended coroutine is waiting for or zero
+        int m_awaiting;
+
+        //! A callback that sends its Message back with our type on it
+        std::function<void(Message)> tagged(int type) const
+        {
+            const std::function<void(Message)>& callback
+                = Request<charT>::callback();
+            return [callback, type] (Message message)
+            {
+                message.type = type;
+                callback(std::move(message));
+            };
+        }
+
+        //! Take an arrived Message of a specific type
+        bool take(int type, Message& message)
+        {
+            for(auto arrived=m_arrived.begin();
+                    arrived!=m_arrived.end();
+                    ++arrived)
+                if(arrived->type == type)
+                {
+                    message = std::move(*arrived);
+                    m_arrived.erase(arrived);
+                    return true;
+                }
+            return false;
+        }
+
+        bool responseProcess() final
+        {
+            if(!m_task)
+                m_task = response();
+            else if(this->m_message.type == m_awaiting)
+                m_resumed = std::move(this->m_message);
+            else
+            {
+                m_arrived.push_back(std::move(this->m_message));
+                return false;
+            }
+
+            m_task.resume();
+            if(!m_task.done())
+                return false;
+
+            if(m_task.exception())
+            {
+                try
+                {
+                    std::rethrow_exception(m_task.exception());
+                }
+                catch(const std::exception& e)
+                {
+                    ERR_LOG("Request coroutine threw: " << e.what())
+                }
+                catch(...)
+                {
+                    ERR_LOG("Request coroutine threw")
+                }
+                this->errorHandler();
+            }
+            return true;
+        }
+    };
+}
+
+#endif
@@ -35,6 +35,7 @@
 
 #include <istream>
 #include <functional>
+#include <memory>
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
@@ -55,7 +56,8 @@ namespace Fastcgipp
     class FcgiStreambuf: public WebStreambuf<charT, traits>
     {
     public:
-        FcgiStreambuf()
+        FcgiStreambuf():
+            m_sent(false)
         {
             this->setp(m_buffer, m_buffer+s_buffSize);
         }
@@ -73,19 +75,52 @@ namespace Fastcgipp
          * @param[in] id Complete ID associated with the request
          * @param[in] type Type of output stream (ERR or OUT)
          * @param[in] send_ Function to send record with
+         * @param[in] sendFile_ Function to send a record header followed by
+         *                      part of a file with
          */
         void configure(
                 const Protocol::RequestId& id,
                 const Protocol::RecordType& type,
-                const std::function<void(const Socket&, Block&&)>
+                const std::function<void(const SocketId&, Block&&)>
                     send_,
-                const std::function<void(const Socket&, Block&&)>
-                    send_2)
+                const std::function<void(const SocketId&, Block&&)>
+                    send_2,
+                const std::function<void(
+                    const SocketId&,
+                    Block&&,
+                    const std::shared_ptr<const File>&,
+                    uint64_t,
+                    size_t,
+                    size_t)> sendFile_)
         {
             m_id = id;
             m_type = type;
             send = send_;
             send2=send_2;
+            sendFile = sendFile_;
+            m_sent = false;
+        }
+
+        //! Point an already configured stream buffer at another request
+        /*!
+         * The send functions from the first configure() are kept.
+         *
+         * @param[in] id Complete ID associated with the request
+         */
+        void configure(const Protocol::RequestId& id)
+        {
+            m_id = id;
+            this->setp(m_buffer, m_buffer+s_buffSize);
+            m_sent = false;
+        }
+
+        //! True if anything has been written since configure()
+        /*!
+         * This includes data still waiting in the buffer.
+         */
+        bool written() const
+        {
+            return m_sent || this->pptr() != this->pbase();
         }
 
         //! Dumps raw data directly into the FastCGI protocol
@@ -112,6 +147,21 @@ namespace Fastcgipp
         void dump(std::basic_istream<char>& stream);
         void dump2(const char* data, size_t size);
 
+        //! Dumps part of a file directly into the FastCGI protocol
+        /*!
+         * Only the record headers and padding are built here. The file data
+         * itself goes from the page cache straight into the socket without
+         * ever being copied into a Block. The file must actually contain the
+         * requested range or the connection gets closed.
+         *
+         * @param[in] fd Descriptor of a file open for reading. It is
+         *               duplicated so the caller may close it immediately.
+         * @param[in] offset Where in the file to start
+         * @param[in] size Size in bytes of data to be sent
+         * @return False if the file descriptor couldn't be duplicated.
+         */
+        bool dumpFile(int fd, uint64_t offset, size_t size);
+
     private:
         //! Code converts, packages and transmits all data in the stream buffer
         bool emptyBuffer();
@@ -128,9 +178,21 @@ namespace Fastcgipp
         //! Type of output stream (ERR or OUT)
         Protocol::RecordType m_type;
 
+        //! True if a record has been sent since configure()
+        bool m_sent;
+
         //! Function to actually send the record
-        std::function<void(const Socket&, Block&&)> send;
-        std::function<void(const Socket&, Block&&)> send2;
+        std::function<void(const SocketId&, Block&&)> send;
+        std::function<void(const SocketId&, Block&&)> send2;
+
+        //! Function to send a record header followed by file data
+        std::function<void(
+                const SocketId&,
+                Block&&,
+                const std::shared_ptr<const File>&,
+                uint64_t,
+                size_t,
+                size_t)> sendFile;
     };
 }
 
@@ -261,6 +261,13 @@ namespace Fastcgipp
                 m_postBuffer.shrink_to_fit();
             }
 
+            //! Return to the state of a default constructed one
+            /*!
+             * The strings and buffers keep whatever capacity they have so a
+             * recycled request can fill them again without allocating.
+             */
+            void clear();
+
             Environment():
                 requestMethod(RequestMethod::ERR),
                 etag(0),
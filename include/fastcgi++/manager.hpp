@@ -34,12 +34,14 @@
 #include <algorithm>
 #include <thread>
 #include <mutex>
-#include <shared_mutex>
+#include <vector>
 #include <memory>
 #include <functional>
-#include <condition_variable>
+#include <atomic>
+#include <string>
 
 #include "fastcgi++/protocol.hpp"
+#include "fastcgi++/scheduler.hpp"
 #include "fastcgi++/transceiver.hpp"
 #include "fastcgi++/request.hpp"
 
@@ -189,6 +191,54 @@ namespace Fastcgipp
 			return m_transceiver.listen(ifName, port);
 		}
 
+        //! Accept connections from a listen socket we don't own
+        /*!
+         * This is for listen sockets inherited from a parent process that
+         * stays in charge of them, such as a Prefork supervisor. They are
+         * never shut down or closed by us.
+         *
+         * @param [in] listener Listen socket to accept connections from.
+         * @return True on success. False on failure.
+         */
+        bool inherit(socket_t listener)
+        {
+            return m_transceiver.inherit(listener);
+        }
+
+#if ! defined(FASTCGIPP_WINDOWS)
+        //! Take over the listen sockets of a running process
+        /*!
+         * This is the new process' half of an upgrade without downtime. It
+         * connects to the named socket another Manager is serving with
+         * handOver() and receives its listen sockets, so call it instead of
+         * listen(). The old process only stops accepting once start() has
+         * been called here. Until then connections simply wait in the shared
+         * backlog, so none are ever refused.
+         *
+         * @param [in] name Name of the upgrade socket (path in Unix world).
+         * @return True on success. False if no process handed over any listen
+         *         sockets, in which case you'll want to listen() yourself.
+         */
+        bool takeOver(const char* name);
+
+        //! Let a newer process take over our listen sockets
+        /*!
+         * This is the old process' half of an upgrade without downtime. A
+         * thread of our own listens on a named socket for a process calling
+         * takeOver() and sends it our listen sockets. Once that process has
+         * started we stop() just as though we had received a SIGUSR1,
+         * completing the requests we have but accepting no more.
+         *
+         * Call it before start(). A process that took over should call it as
+         * well so that it can be upgraded in turn.
+         *
+         * @param [in] name Name of the upgrade socket (path in Unix world).
+         *                  Only the owner of the process can connect to it.
+         * @return True on success. False on failure.
+         */
+        bool handOver(const char* name);
+#endif
+
         //! Pass a message to a request
         void push(Protocol::RequestId id, Message&& message);
 
@@ -213,6 +263,91 @@ namespace Fastcgipp
          */
         void resizeThreads(unsigned threads);
 
+        //! Call before start to pin the request handling threads to CPUs
+        /*!
+         * Each thread pins itself before it handles anything so the memory
+         * it allocates for requests comes from the NUMA node of its CPUs.
+         * This only has an effect on Linux. If the Manager is already running
+         * this will do nothing.
+         *
+         * @param[in] cpus CPUs to run request handling threads on. Empty
+         *                 (default) leaves placement to the OS unless perCore
+         *                 is set, in which case every CPU we're allowed to run
+         *                 on is used except those in
+         *                 Transceiver::reactorCpus(). Set those first.
+         * @param[in] perCore If true thread n is pinned to cpus[n] alone,
+         *                    wrapping around if there are more threads than
+         *                    CPUs. Otherwise every thread may run on any of the
+         *                    CPUs.
+         *
+         * @sa Transceiver::reactorCpus()
+         */
+        void workerCpus(const std::vector<unsigned>& cpus, bool perCore=false);
+
+        //! Call before start to handle every request on a single thread
+        /*!
+         * The messages of a request are all routed to one handling thread
+         * chosen by hashing its RequestId. The request then runs to completion
+         * there without ever taking Request_base::mutex. Requests can't be
+         * balanced across threads this way so one that takes long delays the
+         * others routed to its thread. If the Manager is already running this
+         * will do nothing.
+         *
+         * @param[in] status Set to true to route requests to threads. False
+         *                   (default) to let any idle thread take any task.
+         */
+        void affinity(bool status)
+        {
+            if(m_stop)
+                m_scheduler.affinity(status);
+        }
+
+        //! Call before start to dispatch requests by priority class
+        /*!
+         * Every request starts in class zero and moves to the class its
+         * Request::classify() picks once its parameters are in. Idle threads
+         * choose between the classes with tasks waiting in proportion to
+         * their weights so a flood in one class can't starve the others. A
+         * class with a limit never has more than that many of its tasks
+         * handled at once. If the Manager is already running this will do
+         * nothing.
+         *
+         * @param[in] classes The classes indexed by what classify() returns.
+         *                    The default is a single class with no limit.
+         */
+        void priorities(const std::vector<Scheduler::Class>& classes)
+        {
+            if(m_stop)
+                m_scheduler.classes(classes);
+        }
+
+        //! Call before listen() to change the number of I/O reactors
+        /*!
+         * Each reactor has its own poll, socket set and send queues and runs
+         * in its own pair of receive/transmit threads. If the Manager is
+         * already running this will do nothing.
+         *
+         * @param[in] count Number of reactors to spread connections across
+         *
+         * @sa Transceiver::reactors()
+         */
+        void reactors(unsigned count)
+        {
+            m_transceiver.reactors(count);
+        }
+
+        //! Call before start() to pin the reactor threads to CPUs
+        /*!
+         * @param[in] cpus CPUs to pin reactors to. Empty (default) leaves
+         *                 placement to the OS.
+         *
+         * @sa Transceiver::reactorCpus()
+         */
+        void reactorCpus(const std::vector<unsigned>& cpus)
+        {
+            m_transceiver.reactorCpus(cpus);
+        }
+
     protected:
         //! Make a request object
         virtual std::unique_ptr<Request_base> makeRequest(
@@ -220,30 +355,106 @@ namespace Fastcgipp
                 const Protocol::Role& role,
                 bool kill) =0;
 
+        //! Dispose of a finished request
+        /*!
+         * It is called without any of our locks held. By default the request
+         * is simply destroyed.
+         */
+        virtual void recycle(std::unique_ptr<Request_base>&& request)
+        {
+            request.reset();
+        }
+
         //! Handles low level communication with the other side
         Transceiver m_transceiver;
 
     private:
-        //! Queue for pending tasks
-        std::queue<Protocol::RequestId> m_tasks;
+        //! Queues for pending tasks
+        Scheduler m_scheduler;
+
+        //! The requests multiplexed on a single connection
+        struct Requests
+        {
+            //! Thread safe the rest of this
+            std::mutex mutex;
+
+            //! Generation of the connection the requests belong to
+            uint32_t generation;
 
-        //! Thread safe our tasks
-        std::mutex m_tasksMutex;
+            //! Requests indexed by FastCGI request ID
+            /*!
+             * It grows to the highest ID in use on the connection.
+             */
+            std::vector<std::unique_ptr<Request_base>> requests;
 
-        //! An associative container for our requests
-        Protocol::Requests<std::unique_ptr<Request_base>> m_requests;
+            //! Requests still running from older connections on the socket
+            std::vector<std::pair<
+                Protocol::RequestId,
+                std::unique_ptr<Request_base>>> orphans;
+
+            Requests():
+                generation(0)
+            {}
+        };
+
+        //! Number of connections in a page of the request table
+        static const size_t s_requestsPage = 1024;
+
+        //! Number of pages in the request table
+        static const size_t s_requestsPages = 1024;
+
+        //! The request table indexed by OS level socket identifier
+        /*!
+         * Pages are allocated on first use and never move or get freed until
+         * we are destroyed so a connection's requests can be found without a
+         * lock. Only the connection's own mutex is taken to get at them.
+         */
+        std::atomic<Requests*> m_requests[s_requestsPages];
 
-        //! Thread safe our requests
-        std::shared_timed_mutex m_requestsMutex;
+        //! Number of requests in the table
+        std::atomic_size_t m_requestsSize;
+
+        //! Find the request table slot for a connection
+        /*!
+         * @param[in] socket Connection to look up.
+         * @return Pointer to the slot or nullptr if the socket identifier is
+         *         too large for the table.
+         */
+        Requests* requests(const SocketId& socket);
+
+        //! Find a request in a slot
+        /*!
+         * Call with the slot's mutex locked.
+         *
+         * @return Pointer to the owner of the request or nullptr if it doesn't
+         *         exist.
+         */
+        static std::unique_ptr<Request_base>* find(
+                Requests& requests,
+                const Protocol::RequestId& id);
+
+        //! Remove a request from a slot
+        /*!
+         * Call with the slot's mutex locked.
+         *
+         * @return The request so it can be recycled once the mutex is
+         *         unlocked. Empty if it didn't exist.
+         */
+        std::unique_ptr<Request_base> erase(
+                Requests& requests,
+                const Protocol::RequestId& id);
 
         //! Local messages
-        std::queue<std::pair<Message, Socket>> m_messages;
+        std::queue<std::pair<Message, SocketId>> m_messages;
 
         //! Thread safe our local messages
         std::mutex m_messagesMutex;
 
         //! General handling function to have it's own thread
-        void handler();
+        /*!
+         * @param[in] thread Index of the thread in m_threads.
+         */
+        void handler(unsigned thread);
 
         //! Handles management messages
         /*!
@@ -253,10 +464,10 @@ namespace Fastcgipp
         inline void localHandler();
 
         //! True when the manager should be terminating
-        bool m_terminate;
+        std::atomic_bool m_terminate;
 
         //! True when the manager should be stopping
-        bool m_stop;
+        std::atomic_bool m_stop;
 
         //! Thread safe starting and stopping
         std::mutex m_startStopMutex;
@@ -264,8 +475,31 @@ namespace Fastcgipp
         //! Threads our manager is running in
         std::vector<std::thread> m_threads;
 
-        //! Condition variable to wake handler() threads up
-        std::condition_variable m_wake;
+        //! CPUs to pin handler() threads to
+        std::vector<unsigned> m_workerCpus;
+
+        //! Pin each handler() thread to a single CPU of m_workerCpus
+        bool m_perCore;
+
+#if ! defined(FASTCGIPP_WINDOWS)
+        //! Connection to the process we took over from until start()
+        socket_t m_takeOver;
+
+        //! Socket that newer processes connect to in order to take over
+        socket_t m_handOver;
+
+        //! Shutting down the first of these wakes up handOverHandler()
+        socket_t m_handOverWake[2];
+
+        //! Name of m_handOver
+        std::string m_handOverName;
+
+        //! Thread waiting for a newer process to take over
+        std::thread m_handOverThread;
+
+        //! Hand over our listen sockets to the first process that asks
+        void handOverHandler();
+#endif
 
         //! General function to handler POSIX signals
 #if ! defined(FASTCGIPP_WINDOWS)
@@ -279,7 +513,7 @@ namespace Fastcgipp
         std::atomic_ullong m_requestCount;
 
         //! Debug counter for max requests
-        size_t m_maxRequests;
+        std::atomic_size_t m_maxRequests;
 
         //! Debug counter for management records
         std::atomic_ullong m_managementRecordCount;
@@ -294,10 +528,10 @@ namespace Fastcgipp
         std::atomic_ullong m_messageCount;
 
         //! Debug counter currently active handler() threads
-        unsigned m_activeThreads;
+        std::atomic_uint m_activeThreads;
 
         //! Debug counter max active handler() threads
-        unsigned m_maxActiveThreads;
+        std::atomic_uint m_maxActiveThreads;
 #endif
     };
 
@@ -329,10 +563,44 @@ namespace Fastcgipp
          * @param[in] threads Number of threads to use for request handling
          */
         Manager(unsigned threads = std::thread::hardware_concurrency()):
-            Manager_base(threads)
+            Manager_base(threads),
+            m_poolSize(0)
         {}
 
+        //! Call before start() to recycle request objects
+        /*!
+         * Finished requests are reset() and kept for the next ones instead of
+         * being destroyed and constructed all over again. RequestT::reset()
+         * must return everything the request holds to how it was
+         * constructed.
+         *
+         * @param[in] size Most finished requests to keep. Zero (default)
+         *                 disables pooling.
+         *
+         * @sa Request::reset()
+         */
+        void pool(size_t size)
+        {
+            std::lock_guard<std::mutex> lock(m_poolMutex);
+            m_poolSize = size;
+            while(m_pool.size() > m_poolSize)
+                m_pool.pop_back();
+        }
+
     private:
+        //! Finished requests ready for reuse
+        std::vector<std::unique_ptr<RequestT>> m_pool;
+
+        //! Thread safe our pool
+        std::mutex m_poolMutex;
+
+        //! Most requests to keep in m_pool
+        /*!
+         * This is written under m_poolMutex but recycle() checks it without
+         * the lock first.
+         */
+        std::atomic_size_t m_poolSize;
+
         //! Make a request object
         std::unique_ptr<Request_base> makeRequest(
                 const Protocol::RequestId& id,
@@ -341,17 +609,57 @@ namespace Fastcgipp
         {
             using namespace std::placeholders;
 
-            std::unique_ptr<RequestT> request(new RequestT);
+            std::unique_ptr<RequestT> request;
+            {
+                std::lock_guard<std::mutex> lock(m_poolMutex);
+                if(!m_pool.empty())
+                {
+                    request = std::move(m_pool.back());
+                    m_pool.pop_back();
+                }
+            }
+            if(request)
+            {
+                request->configure(
+                        id,
+                        role,
+                        kill,
+                        std::bind(&Manager_base::push, this, id, _1));
+                return request;
+            }
+
+            request.reset(new RequestT);
             request->configure(
                     id,
                     role,
                     kill,
                     std::bind(&Transceiver::send, &m_transceiver, _1, _2, _3),
                     std::bind(&Transceiver::send2, &m_transceiver, _1, _2, _3),
+                    std::bind(
+                        &Transceiver::sendFile,
+                        &m_transceiver,
+                        _1, _2, _3, _4, _5, _6),
                     std::bind(&Manager_base::push, this, id, _1));
             return request;
         }
 
+        //! Keep a finished request in the pool if there is room
+        void recycle(std::unique_ptr<Request_base>&& request)
+        {
+            if(!request || m_poolSize == 0)
+            {
+                request.reset();
+                return;
+            }
+
+            // Everything in the table came from makeRequest()
+            std::unique_ptr<RequestT> recycled(
+                    static_cast<RequestT*>(request.release()));
+            recycled->reset();
+            std::lock_guard<std::mutex> lock(m_poolMutex);
+            if(m_pool.size() < m_poolSize)
+                m_pool.push_back(std::move(recycled));
+        }
     };
 }
 
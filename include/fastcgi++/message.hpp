@@ -38,10 +38,10 @@ namespace Fastcgipp
      * This data structure is crucial to all operation in the fastcgi++ library
      * as all data passed to requests must be encapsulated in this data
      * structure.  A type value of 0 means that the message is a FastCGI record
-     * and will be processed at a low level by the library. Any other type value
-     * and the message will be passed up to the user code to be processed. The
-     * data may contain any data that can be serialized into a raw character
-     * array.
+     * and will be processed at a low level by the library. Negative type values
+     * are also reserved for the library. Any other type value and the message
+     * will be passed up to the user code to be processed. The data may contain
+     * any data that can be serialized into a raw character array.
      */
     struct Message
     {
@@ -71,6 +71,9 @@ namespace Fastcgipp
         //! Type of message. A 0 means FastCGI record. Anything else is open.
         int type;
 
+        //! Type of the message passed to a request that has run out of time
+        static const int timeout = -1;
+
         //! The raw data being passed along with the message.
         Block data;
     };
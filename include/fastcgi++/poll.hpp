@@ -44,8 +44,13 @@
 #include <WinSock2.h>
 #endif
 #include <mutex>
+#include <memory>
 #include <utility>
 
+#ifdef FASTCGIPP_IO_URING
+struct msghdr;
+#endif
+
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
@@ -60,6 +65,7 @@ namespace Fastcgipp
 	int shutdown(socket_t fd, bool bRead = true, bool Write = true);
 	bool setNonBlocking(socket_t fd);
 	void set_reuse(socket_t fd);
+	void set_reuseport(socket_t fd);
     //! Class for handling OS level socket polling
     /*!
      * This class introduces a layer of abstraction to the polling interface
@@ -82,15 +88,119 @@ namespace Fastcgipp
 		typedef std::vector<pollfd> poll_t;
 #endif
 
+#ifdef FASTCGIPP_IO_URING
+        //! An io_uring set up to poll sockets
+        struct Ring;
+
+        //! Used in place of m_poll if the kernel supports io_uring
+        std::unique_ptr<Ring> m_ring;
+
+        //! A second io_uring for send() so it never competes with poll()
+        std::unique_ptr<Ring> m_sendRing;
+#endif
+
         //! The OS level polling object
         poll_t m_poll;
     public:
         //! Add a socket identifier to the poll list
-        bool add(const socket_t socket);
+        /*!
+         * @param [in] socket Socket identifier to add.
+         * @param [in] exclusive True to have only one of the polls sharing the
+         *                       socket woken for each event (EPOLLEXCLUSIVE).
+         *                       This is ignored where it isn't supported.
+         * @return True on success. False on failure.
+         */
+        bool add(const socket_t socket, bool exclusive=false);
 
         //! Remove a socket identifier to the poll list
 		bool del(const socket_t socket);
 
+        //! Add or remove write readiness from the events polled for a socket
+        /*!
+         * Sockets are always polled for incoming data. Calling this with
+         * \a out set to true additionally has poll() report the socket once
+         * it can be written to without blocking.
+         *
+         * @param [in] socket Socket identifier already in the poll list.
+         * @param [in] out True to poll for write readiness. False to stop.
+         * @return True on success. False on failure.
+         */
+        bool pollOut(const socket_t socket, bool out);
+
+#ifdef FASTCGIPP_IO_URING
+        //! Accept connections on a listen socket with a multishot accept
+        /*!
+         * Every connection the kernel accepts is returned by poll() as a
+         * result for the listener with Result::accepted() set. The accepted
+         * sockets are already non-blocking. Remove the listener with del().
+         *
+         * @param [in] listener Listen socket to accept connections on.
+         * @return True on success. False if the kernel can't do this, in
+         *         which case add() the listener instead.
+         */
+        bool accept(const socket_t listener);
+
+        //! Receive from a socket with a multishot recv into our buffer ring
+        /*!
+         * The kernel puts incoming data straight into buffers we provide so
+         * it never takes a system call to read it. poll() reports the socket
+         * readable for as long as any of it is waiting. Take it out with
+         * read() instead of reading the socket. Remove the socket with del().
+         *
+         * @param [in] socket Connected socket to receive from.
+         * @return True on success. False if the kernel can't do this, in
+         *         which case add() the socket instead.
+         */
+        bool receive(const socket_t socket);
+
+        //! Copy data received for a socket out of the buffer ring
+        /*!
+         * @param [in] socket Socket passed to receive().
+         * @param [out] buffer Where to copy the data to.
+         * @param [in] size Maximum number of bytes to copy.
+         * @return Number of bytes copied. Zero means nothing is waiting.
+         */
+        size_t read(const socket_t socket, char* buffer, size_t size);
+
+        //! A gathered send for send()
+        struct Send
+        {
+            //! Socket to send on
+            socket_t socket;
+
+            //! Message to send. It must stay put until send() returns.
+            const msghdr* message;
+
+            //! Flags as would be passed to sendmsg()
+            int flags;
+
+            //! Bytes sent or a negated errno
+            int result;
+        };
+
+        //! Send a batch of gathered messages with a single system call
+        /*!
+         * This is the sendmsg() of every message submitted and waited for
+         * together. Sends that would block come back with -EAGAIN instead.
+         * It is safe to call from another thread while poll() is waiting.
+         *
+         * @param [inout] sends Messages to send. Each result is filled in.
+         * @param [in] count Number of messages.
+         * @return True on success. False if the kernel can't do this, in
+         *         which case nothing was sent.
+         */
+        bool send(Send* sends, unsigned count);
+
+        //! True if send() can be used
+        bool sending() const
+        {
+            return static_cast<bool>(m_sendRing);
+        }
+
+        //! Maximum number of messages worth batching into one send()
+        static const unsigned maxSends = 64;
+#endif
+
         //! Type returned from a poll request
         class Result
         {
@@ -98,6 +208,9 @@ namespace Fastcgipp
             //! Event: there is data to read
             static const unsigned pollIn;
 
+            //! Event: the socket can be written to
+            static const unsigned pollOut;
+
             //! Event: there is an error in the socket
             static const unsigned pollErr;
 
@@ -114,24 +227,43 @@ namespace Fastcgipp
             //! Associated socket
             socket_t m_socket;
 
+#ifdef FASTCGIPP_IO_URING
+            //! Connection accepted on the socket or -1
+            socket_t m_accepted;
+#endif
+
             //! True if the poll actually returned a socket with an event
             bool m_data;
 
             friend class Poll;
 
-            //! Only Poll should be able to construct these
+        public:
+            //! An empty result. Only Poll can fill these in.
             Result():
                 m_events(0),
+#ifdef FASTCGIPP_IO_URING
+                m_accepted(-1),
+#endif
                 m_data(false)
             {}
 
-        public:
             //! Get socket id associated with poll event
             socket_t socket() const
             {
                 return m_socket;
             }
 
+#ifdef FASTCGIPP_IO_URING
+            //! Connection the kernel accepted on the listen socket or -1
+            /*!
+             * Only listeners passed to Poll::accept() have this set.
+             */
+            socket_t accepted() const
+            {
+                return m_accepted;
+            }
+#endif
+
             //! True if the poll actually returned a socket with an event
             explicit operator bool() const
             {
@@ -171,6 +303,12 @@ namespace Fastcgipp
                 return m_events & pollIn;
             }
 
+            //! True if the socket can be written to
+            bool out() const
+            {
+                return m_events & pollOut;
+            }
+
             //! True if and only if the socket has data to read
             bool onlyIn() const
             {
@@ -186,6 +324,26 @@ namespace Fastcgipp
          */
         Result poll(int timeout);
 
+        //! Initiate poll on group and retrieve a batch of events
+        /*!
+         * This retrieves as many ready sockets as are available, up to
+         * \a max, with a single system call. Only the first n results are
+         * filled in.
+         *
+         * @param [out] results Array of at least \a max results to fill.
+         * @param [in] max Size of the results array. On Linux no more than
+         *                 maxBatch events are retrieved per call.
+         * @param [in] timeout 0 means don't block at all. -1 means block
+         *                     indefinitely. A positive integer is the number of
+         *                     milliseconds before blocking times out.
+         * @return Number n of results filled in. Zero means the poll timed out
+         *         or was interrupted.
+         */
+        unsigned poll(Result* results, unsigned max, int timeout);
+
+        //! Maximum number of events retrieved by a single batch poll()
+        static const unsigned maxBatch = 256;
+
         Poll();
         ~Poll();
     };
@@ -0,0 +1,270 @@
+/*!
+ * @file       prefork.hpp
+ * @brief      Declares the Fastcgipp::Prefork class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_PREFORK_HPP
+#define FASTCGIPP_PREFORK_HPP
+
+#include "fastcgi++/config.hpp"
+
+#if ! defined(FASTCGIPP_WINDOWS)
+#include <chrono>
+#include <functional>
+#include <vector>
+#include <signal.h>
+#include <sys/types.h>
+
+#include "fastcgi++/manager.hpp"
+#include "fastcgi++/sockets.hpp"
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Supervisor of a group of pre-forked worker processes
+    /*!
+     * The supervisor binds the listen sockets once and forks a number of
+     * worker processes that all accept from them. Each worker runs a
+     * Manager of its own so nothing at all is shared between them. Workers
+     * that exit or crash are restarted. A SIGUSR1 or SIGTERM received by the
+     * supervisor is forwarded to every worker and run() returns once they
+     * have all exited.
+     *
+     * To operate this class you need to do the following:
+     *  - Construct a Prefork object
+     *  - Call at least one of the listen() member functions.
+     *  - Call run()
+     *
+     * <em>Forking is only safe from a single threaded process so run() must
+     * be called before any threads are started.</em>
+     *
+     * @date    October 16, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class Prefork_base
+    {
+    public:
+        //! Sole constructor
+        /*!
+         * @param[in] workers Number of worker processes to run
+         */
+        Prefork_base(unsigned workers);
+
+        virtual ~Prefork_base() {}
+
+        //! Listen to the default Fastcgi socket
+        /*!
+         * @return True on success. False on failure.
+         */
+        bool listen()
+        {
+            return m_listeners.listen();
+        }
+
+        //! Listen to a named socket
+        /*!
+         * @param [in] name Name of socket (path in Unix world).
+         * @param [in] permissions Permissions of socket. If you do not wish to
+         *                         set the permissions, leave it as it's default
+         *                         value of 0xffffffffUL.
+         * @param [in] owner Owner (username) of socket. Leave as nullptr if you
+         *                   do not wish to set it.
+         * @param [in] group Group (group name) of socket. Leave as nullptr if
+         *                   you do not wish to set it.
+         * @return True on success. False on failure.
+         */
+        bool listen(
+                const char* name,
+                uint32_t permissions = 0xffffffffUL,
+                const char* owner = nullptr,
+                const char* group = nullptr)
+        {
+            return m_listeners.listen(name, permissions, owner, group);
+        }
+
+        //! Listen to a TCP port
+        /*!
+         * @param [in] interface Interface to listen on. This could be an IP
+         *                       address or a hostname. If you don't want to
+         *                       specify the interface, pass nullptr.
+         * @param [in] service Port or service to listen on. This could be a
+         *                     service name, or a string representation of a
+         *                     port number.
+         * @return True on success. False on failure.
+         */
+        bool listen(
+                const char* ifName,
+                const char* service)
+        {
+            return m_listeners.listen(ifName, service);
+        }
+
+        //! Should we set socket option to reuse address
+        /*!
+         * @param [in] status Set to true if you want to reuse address.
+         *                    False otherwise (default).
+         */
+        void reuseAddress(bool value)
+        {
+            m_listeners.reuseAddress(value);
+        }
+
+        //! Pin each worker process to a CPU of its own
+        /*!
+         * Worker n is pinned to the n-th CPU the supervisor is allowed to run
+         * on, wrapping around if there are more workers than CPUs. This only
+         * has an effect on Linux.
+         *
+         * @param [in] status Set to true to pin workers. False otherwise
+         *                    (default).
+         */
+        void pin(bool status)
+        {
+            m_pin = status;
+        }
+
+        //! Fork the workers and supervise them until they are stopped
+        /*!
+         * @return False if there was nothing to listen to. True once every
+         *         worker has exited after a SIGUSR1 or SIGTERM.
+         */
+        bool run();
+
+    protected:
+        //! Run a worker
+        /*!
+         * This is called in a freshly forked worker process. It should run a
+         * Manager on the inherited listen sockets until it is stopped.
+         *
+         * @param [in] slot Which worker this is starting from zero.
+         */
+        virtual void worker(unsigned slot) =0;
+
+        //! The listen sockets our workers inherit
+        const std::set<socket_t>& listeners() const
+        {
+            return m_listeners.listeners();
+        }
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        //! Binds the listen sockets and cleans them up once we're done
+        SocketGroup m_listeners;
+
+        //! Set to true if workers should be pinned to a CPU
+        bool m_pin;
+
+        //! Signal mask to restore in the workers
+        sigset_t m_mask;
+
+        //! A worker process
+        struct Worker
+        {
+            //! Process ID or -1 if it isn't running
+            pid_t pid;
+
+            //! When it was last started
+            Clock::time_point started;
+
+            //! When to restart it if it isn't running
+            Clock::time_point restart;
+        };
+
+        //! Our workers indexed by slot
+        std::vector<Worker> m_workers;
+
+        //! Fork the worker in a slot
+        void spawn(unsigned slot);
+
+        //! Pin the calling process to the CPU for a slot
+        void pinTo(unsigned slot);
+
+        //! Send a signal to every running worker
+        void forward(int signum);
+    };
+
+    //! Supervisor of a group of pre-forked Manager processes
+    /*!
+     * Each worker process runs a Manager<RequestT> on the listen sockets it
+     * inherited from the supervisor and with the signals set up by
+     * Manager_base::setupSignals().
+     *
+     * @tparam RequestT Class that will handle requests in the workers.
+     *
+     * @date    October 16, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    template<class RequestT> class Prefork: public Prefork_base
+    {
+    public:
+        //! Sole constructor
+        /*!
+         * @param[in] workers Number of worker processes to run
+         * @param[in] threads Number of threads each worker uses for request
+         *                    handling
+         */
+        Prefork(
+                unsigned workers = std::thread::hardware_concurrency(),
+                unsigned threads = 1):
+            Prefork_base(workers),
+            m_threads(threads)
+        {}
+
+        //! Set a function to configure the Manager of each worker
+        /*!
+         * It is called in the worker process before the Manager starts
+         * listening so it can be used to set reactors, timeouts and so on.
+         */
+        void setup(const std::function<void(Manager<RequestT>&)>& setup)
+        {
+            m_setup = setup;
+        }
+
+    private:
+        //! Number of threads each worker uses for request handling
+        const unsigned m_threads;
+
+        //! Function to configure the Manager of each worker
+        std::function<void(Manager<RequestT>&)> m_setup;
+
+        void worker(unsigned slot)
+        {
+            Manager<RequestT> manager(m_threads);
+            if(m_setup)
+                m_setup(manager);
+            for(const auto listener: listeners())
+                if(!manager.inherit(listener))
+                    return;
+            manager.setupSignals();
+            manager.start();
+            manager.join();
+        }
+    };
+}
+#endif
+
+#endif
@@ -33,6 +33,8 @@
 #include <algorithm>
 #include <map>
 #include <vector>
+#include <string>
+#include <utility>
 
 #include "fastcgi++/message.hpp"
 #include "fastcgi++/sockets.hpp"
@@ -81,29 +83,24 @@ namespace Fastcgipp
             RequestId(
                     FcgiId id,
                     const Socket& socket):
-                m_socket(socket),
+                m_socket(socket.id()),
                 m_id(id)
             {}
 
-            RequestId(const RequestId& x):
-                m_socket(x.m_socket),
-                m_id(x.m_id)
+            //! Construct from an FcgiId and a connection handle
+            RequestId(
+                    FcgiId id,
+                    const SocketId& socket):
+                m_socket(socket),
+                m_id(id)
             {}
 
             RequestId():
-                m_socket(Socket()),
                 m_id(badFcgiId)
             {}
 
-            RequestId& operator=(const RequestId& x)
-            {
-                m_socket = x.m_socket;
-                m_id = x.m_id;
-                return *this;
-            }
-
-            //! Associated socket
-            Socket m_socket;
+            //! Associated connection
+            SocketId m_socket;
 
             //! Internal FastCGI request ID
             FcgiId m_id;
@@ -121,12 +118,12 @@ namespace Fastcgipp
                         return x.m_socket < y.m_socket;
                 }
 
-                inline bool operator()(const RequestId& id, const Socket& socket) const noexcept
+                inline bool operator()(const RequestId& id, const SocketId& socket) const noexcept
                 {
                     return id.m_socket < socket;
                 }
 
-                inline bool operator()(const Socket& socket, const RequestId& id) const noexcept
+                inline bool operator()(const SocketId& socket, const RequestId& id) const noexcept
                 {
                     return socket < id.m_socket;
                 }
@@ -388,7 +385,7 @@ namespace Fastcgipp
                 header.version = version;
                 header.type = RecordType::GET_VALUES_RESULT;
                 header.fcgiId = 0;
-                header.contentLength = NAMELENGTH+VALUELENGTH;
+                header.contentLength = 2+NAMELENGTH+VALUELENGTH;
                 header.paddingLength= paddingLength;
             }
         };
@@ -403,14 +400,19 @@ namespace Fastcgipp
          */
         size_t getRecordSize(size_t contentLength);
 
-        //! The maximum allowed file descriptors open at a time
-        extern const ManagementReply<14, 2> maxConnsReply;
-
-        //! The maximum allowed requests at a time
-        extern const ManagementReply<13, 2> maxReqsReply;
-
         //! Where or not requests can be multiplexed over a single connections
         extern const ManagementReply<15, 1> mpxsConnsReply;
+
+        //! Build a GET_VALUES_RESULT record from name-value pairs
+        /*!
+         * Unlike ManagementReply the values need not be known at compile
+         * time.
+         *
+         * @param[in] values Name-value pairs to put in the record.
+         * @return The complete record including header and padding.
+         */
+        Block valuesResult(
+                const std::vector<std::pair<std::string, std::string>>& values);
     }
 }
 
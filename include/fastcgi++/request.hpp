@@ -37,6 +37,7 @@
 #include <functional>
 #include <queue>
 #include <mutex>
+#include <atomic>
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
@@ -59,11 +60,21 @@ namespace Fastcgipp
          */
         virtual std::unique_lock<std::mutex> handler() =0;
 
+        Request_base():
+            priority(0)
+        {}
+
         virtual ~Request_base() {}
 
         //! Only one thread is allowed to handle the request at a time
         std::mutex mutex;
 
+        //! Priority class our tasks are dispatched in
+        /*!
+         * @sa Manager_base::priorities()
+         */
+        std::atomic_uint priority;
+
         //! Send a message to the request
         inline void push(Message&& message)
         {
@@ -124,8 +135,8 @@ namespace Fastcgipp
             m_state(Protocol::RecordType::PARAMS),
             m_status(Protocol::ProtocolStatus::REQUEST_COMPLETE)
         {
-            out.imbue(std::locale("C"));
-            err.imbue(std::locale("C"));
+            out.imbue(std::locale::classic());
+            err.imbue(std::locale::classic());
         }
 
         //! Configures the request with the data it needs.
@@ -139,6 +150,8 @@ namespace Fastcgipp
          * @param[in] kill Boolean value indicating whether or not the socket
          *                 should be closed upon completion
          * @param[in] send Function for sending data out of the stream buffers
+         * @param[in] sendFile Function for sending file data out of the stream
+         *                     buffers
          * @param[in] callback Callback function capable of passing messages to
          *                     the request
          */
@@ -146,12 +159,49 @@ namespace Fastcgipp
                 const Protocol::RequestId& id,
                 const Protocol::Role& role,
                 bool kill,
-                const std::function<void(const Socket&, Block&&, bool)>
+                const std::function<void(const SocketId&, Block&&, bool)>
                     send,
-                const std::function<void(const Socket&, Block&&, bool)>
+                const std::function<void(const SocketId&, Block&&, bool)>
                     send2,
+                const std::function<void(
+                    const SocketId&,
+                    Block&&,
+                    const std::shared_ptr<const File>&,
+                    uint64_t,
+                    size_t,
+                    size_t)> sendFile,
+                const std::function<void(Message)> callback);
+
+        //! Configures a recycled request with the data it needs.
+        /*!
+         * This is configure() for a request that has been through reset().
+         * The send functions it was first configured with are kept.
+         *
+         * @param[in] id Complete ID of the request
+         * @param[in] role The role that the other side expects this request to
+         *                 play
+         * @param[in] kill Boolean value indicating whether or not the socket
+         *                 should be closed upon completion
+         * @param[in] callback Callback function capable of passing messages to
+         *                     the request
+         */
+        void configure(
+                const Protocol::RequestId& id,
+                const Protocol::Role& role,
+                bool kill,
                 const std::function<void(Message)> callback);
 
+        //! Return the request to the state it was constructed in
+        /*!
+         * This is called on finished requests by a Manager that pools them
+         * so the object can be configured for another one. Buffers and
+         * strings keep their capacity. Derivations with state of their own
+         * should override it to clear that state and call this one.
+         *
+         * @sa Manager::pool()
+         */
+        virtual void reset();
+
         std::unique_lock<std::mutex> handler();
 
         virtual ~Request() {}
@@ -201,6 +251,19 @@ namespace Fastcgipp
          */
         virtual void unknownContentErrorHandler();
 
+        //! Called when the request has taken too long
+        /*!
+         * This function is called when the deadline set with
+         * Transceiver::requestTimeout() passes before the request is complete
+         * and nothing has been written to out yet. The request is completed
+         * straight after. By default it will send a standard 504 Gateway
+         * Timeout message to the user. Override for more specialized purposes.
+         *
+         * If part of the response has already been written this isn't called.
+         * The request is simply completed and the connection closed.
+         */
+        virtual void timeoutHandler();
+
         //! See the requests role
         Protocol::Role role() const
         {
@@ -256,6 +319,21 @@ namespace Fastcgipp
         virtual void inHandler(int bytesReceived)
         {}
 
+        //! Pick the priority class of the request
+        /*!
+         * Override this to dispatch some requests ahead of others. It is
+         * called once all the parameters have been received so role() and
+         * environment() are ready to look at. Until then the request is in
+         * class zero.
+         *
+         * @return Index into the classes given to Manager_base::priorities().
+         *         The default is zero.
+         */
+        virtual unsigned classify()
+        {
+            return 0;
+        }
+
         //! Process custom POST data
         /*!
          * Override this function should you wish to process non-standard post
@@ -331,6 +409,24 @@ namespace Fastcgipp
         {
             m_outStreamBuffer.dump2(data, size);
         }
+
+        //! Dumps part of a file directly into the FastCGI protocol
+        /*!
+         * This is the way to send large files. The data is moved from the page
+         * cache into the socket by the OS instead of being read into memory
+         * first. Any output already in the stream buffer is sent ahead of it.
+         *
+         * @param[in] fd Descriptor of a file open for reading. It is
+         *               duplicated so the caller may close it immediately.
+         * @param[in] offset Where in the file to start
+         * @param[in] size Size in bytes of data to be sent. The file must be at
+         *                 least @p offset plus this long.
+         * @return False if the file descriptor couldn't be duplicated.
+         */
+        bool dumpFile(int fd, uint64_t offset, size_t size)
+        {
+            return m_outStreamBuffer.dumpFile(fd, offset, size);
+        }
 		bool socketValid()const;
         //! Pick a locale
         /*!
@@ -388,7 +484,7 @@ namespace Fastcgipp
         void complete();
 
         //! Function to actually send the record
-        std::function<void(const Socket&, Block&&, bool kill)> m_send;
+        std::function<void(const SocketId&, Block&&, bool kill)> m_send;
 
         //! Status to end the request with
         Protocol::ProtocolStatus m_status;
@@ -0,0 +1,306 @@
+/*!
+ * @file       scheduler.hpp
+ * @brief      Declares the Fastcgipp::Scheduler class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_SCHEDULER_HPP
+#define FASTCGIPP_SCHEDULER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "fastcgi++/protocol.hpp"
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Work-stealing task queues for a fixed set of worker threads
+    /*!
+     * Every worker has a queue of its own. Tasks pushed from a worker go to
+     * its own queue and tasks pushed from anywhere else are spread across
+     * them. A worker with an empty queue steals half of someone else's.
+     *
+     * Idle workers spin for a while before parking. Parked workers are only
+     * woken when nobody is spinning, so a burst of tasks wakes them one at a
+     * time instead of once per task.
+     *
+     * In affinity mode every task for a request goes to the same worker and
+     * nothing is ever stolen, so a request is only ever handled by one thread.
+     *
+     * Tasks can be pushed in different priority classes. Workers pick between
+     * the classes with something queued by smooth weighted round robin so each
+     * class gets its share of the workers under load and none is starved. A
+     * class can also be limited in how many of its tasks are handled at once.
+     * A task counts as being handled from the pop() that returns it until the
+     * worker calls pop(), idle() or release() again.
+     *
+     * @date    October 16, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class Scheduler
+    {
+    public:
+        //! Sole constructor
+        /*!
+         * @param[in] workers Number of worker threads. Zero is treated as one.
+         */
+        Scheduler(unsigned workers=1);
+
+        Scheduler(const Scheduler&) =delete;
+        Scheduler& operator=(const Scheduler&) =delete;
+
+        //! A priority class
+        struct Class
+        {
+            //! Relative share of the workers while other classes are busy too
+            unsigned weight;
+
+            //! Most of its tasks handled at once. Zero for no limit.
+            unsigned limit;
+        };
+
+        //! Most priority classes there can be
+        static const unsigned maxClasses = 64;
+
+        //! Change the number of worker threads
+        /*!
+         * Only call this while no worker is running. Queued tasks are kept.
+         *
+         * @param[in] count Number of worker threads. Zero is treated as one.
+         */
+        void workers(unsigned count);
+
+        //! How many worker threads do we have queues for
+        unsigned workers() const
+        {
+            return m_queues.size();
+        }
+
+        //! Call before starting the workers to set the priority classes
+        /*!
+         * Tasks are pushed in a class by its index. The default is a single
+         * class without a limit. Queued tasks in a class that no longer exists
+         * move to the last one.
+         *
+         * @param[in] classes At least one and at most maxClasses classes. A
+         *                    weight of zero is treated as one.
+         */
+        void classes(const std::vector<Class>& classes);
+
+        //! The priority classes
+        const std::vector<Class>& classes() const
+        {
+            return m_classes;
+        }
+
+        //! Call before starting the workers to route tasks by request
+        /*!
+         * @param[in] status Set to true to hash every task onto a worker by
+         *                   its RequestId and never steal. False (default) to
+         *                   balance tasks across workers.
+         */
+        void affinity(bool status)
+        {
+            m_affinity = status;
+        }
+
+        //! Are tasks routed to workers by request
+        bool affinity() const
+        {
+            return m_affinity;
+        }
+
+        //! The worker a task is routed to in affinity mode
+        unsigned worker(const Protocol::RequestId& task) const;
+
+        //! Queue up a task
+        /*!
+         * Call from any thread.
+         *
+         * @param[in] task The task.
+         * @param[in] priority Index of its priority class. Anything past the
+         *                     last class goes in the last class.
+         */
+        void push(const Protocol::RequestId& task, unsigned priority=0);
+
+        //! Take a task from our own queue or steal one
+        /*!
+         * Call from the worker thread itself.
+         *
+         * @param[in] worker Which worker this is.
+         * @param[out] task Set to the task if there was one.
+         * @return True if a task was taken. False if every queue is empty.
+         */
+        bool pop(unsigned worker, Protocol::RequestId& task);
+
+        //! Done handling the task last returned by pop()
+        /*!
+         * Call from the worker thread itself. pop() and idle() do this on
+         * their own so it's only needed by a worker that is exiting.
+         */
+        void release(unsigned worker);
+
+        //! Current wake() generation
+        /*!
+         * Take this before checking whatever wake() signals and pass it to
+         * idle() so a wake() in between isn't missed.
+         */
+        unsigned generation() const
+        {
+            return m_generation;
+        }
+
+        //! Wait for tasks
+        /*!
+         * Spins for a while and then parks the calling worker until a task
+         * is pushed or wake() is called. It may return spuriously.
+         *
+         * @param[in] worker Which worker this is.
+         * @param[in] generation The value of generation() from before the
+         *                       caller last checked its own conditions.
+         */
+        void idle(unsigned worker, unsigned generation);
+
+        //! Wake up every idle worker
+        /*!
+         * Call after changing whatever the workers check between tasks.
+         */
+        void wake();
+
+        //! How many tasks are queued
+        size_t size() const
+        {
+            return m_size;
+        }
+
+    private:
+        //! A worker's queue
+        struct Queue
+        {
+            std::mutex mutex;
+
+            //! Tasks indexed by priority class
+            std::vector<std::deque<Protocol::RequestId>> tasks;
+
+            //! Number of tasks so it can be checked without the mutex
+            std::atomic_size_t size;
+
+            //! Round robin credit of each class. Only our worker touches it.
+            std::vector<int> credit;
+
+            //! Class of the task our worker is handling or -1
+            int handling;
+
+            //! The worker waits on this when parked in affinity mode
+            std::condition_variable wake;
+
+            //! True while the worker is parked in affinity mode
+            bool parked;
+
+            Queue(size_t classes):
+                tasks(classes),
+                size(0),
+                credit(classes, 0),
+                handling(-1),
+                parked(false)
+            {}
+
+            //! Keep the next queue off our cache line
+            char padding[64];
+        };
+
+        //! Queues indexed by worker
+        std::vector<std::unique_ptr<Queue>> m_queues;
+
+        //! Priority classes
+        std::vector<Class> m_classes;
+
+        //! Number of queued tasks in each class
+        std::unique_ptr<std::atomic_size_t[]> m_queued;
+
+        //! Number of tasks in each class being handled
+        std::unique_ptr<std::atomic_uint[]> m_handling;
+
+        //! Route tasks to workers by request
+        bool m_affinity;
+
+        //! Round robin position for tasks pushed from outside the workers
+        std::atomic_uint m_next;
+
+        //! Total number of queued tasks
+        std::atomic_size_t m_size;
+
+        //! Number of workers spinning in idle()
+        std::atomic_uint m_spinning;
+
+        //! Number of workers parked in idle()
+        std::atomic_uint m_parked;
+
+        //! Incremented by wake()
+        std::atomic_uint m_generation;
+
+        //! Parked workers wait on this
+        std::condition_variable m_wake;
+        std::mutex m_wakeMutex;
+
+        //! Move half of a victim's tasks into a worker's queue
+        /*!
+         * @return True if a task was moved into the task argument.
+         */
+        bool steal(unsigned worker, unsigned victim, Protocol::RequestId& task);
+
+        //! Wake a parked worker if nobody is spinning
+        void unpark();
+
+        //! Pick the next class to take a task from and count it as handled
+        /*!
+         * Call with the mutex of the queue locked.
+         *
+         * @param[in] worker The worker whose round robin credit is used.
+         * @param[in] queue The queue the task will be taken from.
+         * @return Index of the class or -1 if nothing can be taken.
+         */
+        int choose(unsigned worker, const Queue& queue);
+
+        //! Is there a queued task in a class that isn't at its limit
+        bool runnable() const;
+
+        //! Is there a task in a queue in a class that isn't at its limit
+        /*!
+         * Call with the mutex of the queue locked.
+         */
+        bool runnable(const Queue& queue) const;
+
+        //! idle() in affinity mode
+        void idleAlone(unsigned worker, unsigned generation);
+    };
+}
+
+#endif
@@ -34,12 +34,17 @@
 #include <mutex>
 #include <set>
 #include <atomic>
+#include <cstdint>
 #include <deque>
 #include <string>
 #include <vector>
+#include <functional>
 #if defined(FASTCGIPP_WINDOWS)
 #include <WinSock2.h>
 typedef int ssize_t;
+#else
+struct iovec;
+struct msghdr;
 #endif
 
 #include "fastcgi++/poll.hpp"
@@ -48,6 +53,56 @@ typedef int ssize_t;
 namespace Fastcgipp
 {
     class SocketGroup;
+    class SocketId;
+
+    //! An open file that data can be transmitted from
+    /*!
+     * The file descriptor passed to the constructor is duplicated so the
+     * caller can close theirs straight away. Our own is closed on destruction.
+     * Everything sending from the file should share it with a std::shared_ptr.
+     *
+     * @date    October 16, 2026
+     */
+    class File
+    {
+    public:
+        //! Duplicate a file descriptor
+        /*!
+         * @param [in] fd Descriptor of a file open for reading. Check valid()
+         *                afterwards.
+         */
+        explicit File(int fd);
+
+        ~File();
+
+        //! OS level file descriptor
+        int get() const
+        {
+            return m_fd;
+        }
+
+        //! Returns true if the descriptor was duplicated successfully
+        bool valid() const
+        {
+            return m_fd != -1;
+        }
+
+        //! Read from the file at an offset without moving its position
+        /*!
+         * @param [out] buffer Where to read the data into.
+         * @param [in] size Maximum number of bytes to read.
+         * @param [in] offset Where in the file to read from.
+         * @return Number of bytes read. Zero means end of file and -1 an
+         *         error.
+         */
+        ssize_t read(char* buffer, size_t size, uint64_t offset) const;
+
+        File(const File&) =delete;
+        File& operator=(const File&) =delete;
+
+    private:
+        const int m_fd;
+    };
 
     //! Class for representing an OS level I/O socket.
     /*!
@@ -70,12 +125,24 @@ namespace Fastcgipp
         //! Our respective SocketGroup needs private access.
         friend class SocketGroup;
 
+        //! How far along zero copy transmission is on a socket
+        enum class ZeroCopy
+        {
+            UNTRIED,     //!< Nobody has asked for zero copy yet
+            ON,          //!< SO_ZEROCOPY is set and being used
+            COPYING,     //!< SO_ZEROCOPY is set but the kernel copies anyway
+            UNAVAILABLE  //!< The socket doesn't support it
+        };
+
         //! Data structure to hold the shared socket data.
         struct Data
         {
             //! OS level socket identifier.
             const socket_t m_socket;
 
+            //! Distinguishes this connection from others that reuse the fd
+            const uint32_t m_generation;
+
             //! Indicates whether or not the socket is dead/invalid.
             bool m_valid;
 
@@ -89,6 +156,30 @@ namespace Fastcgipp
             //! SocketGroup object this socket is tied to.
             SocketGroup& m_group;
 
+            //! Serializes system calls on the socket against closing it
+            std::mutex m_mutex;
+
+            //! Zero copy state of the socket
+            std::atomic<ZeroCopy> m_zeroCopy;
+
+            //! Number of sends made with MSG_ZEROCOPY
+            /*!
+             * Only the thread writing to the socket touches this.
+             */
+            uint32_t m_zeroCopySent;
+
+            //! Number of zero copy sends the kernel is done with
+            std::atomic_uint_fast32_t m_zeroCopyDone;
+
+#if defined(FASTCGIPP_IO_URING)
+            //! True if the poll receives into its buffer ring for us
+            /*!
+             * Data is then taken out with Poll::read() instead of reading the
+             * socket.
+             */
+            bool m_buffered;
+#endif
+
             //! Sole constructor
             /*!
              * @param [inout] socket The OS level socket identifier to associate
@@ -104,13 +195,26 @@ namespace Fastcgipp
                     bool valid,
                     SocketGroup& group):
                 m_socket(socket),
+                m_generation(++s_generation),
                 m_valid(valid),
                 m_closing(false),
-                m_group(group)
+                m_group(group),
+                m_zeroCopy(ZeroCopy::UNTRIED),
+                m_zeroCopySent(0),
+                m_zeroCopyDone(0)
+#if defined(FASTCGIPP_IO_URING)
+                ,m_buffered(false)
+#endif
             {}
 
             Data() =delete;
             Data(const Data&) =delete;
+
+            //! Mark the socket invalid and take it out of the live table
+            void invalidate();
+
+            //! Last generation handed out
+            static std::atomic_uint_fast32_t s_generation;
         };
 
         //! Shared pointer to hold the socket data.
@@ -119,7 +223,6 @@ namespace Fastcgipp
         //! This is only true for a non-copy constructed object.
         bool m_original;
 
-        mutable std::mutex m_sockDataMutex;
         //! Sole non-copy/move constructor
         /*!
          * This constructor is only accessible to the SocketGroup class to create
@@ -138,6 +241,22 @@ namespace Fastcgipp
                 const socket_t& socket,
                 SocketGroup& group,
                 bool valid=true);
+
+        //! Set SO_ZEROCOPY on the socket if it hasn't been tried yet
+        /*!
+         * @return True if sends should be made with MSG_ZEROCOPY.
+         */
+        bool enableZeroCopy() const;
+
+        //! Drain zero copy completions out of the socket's error queue
+        /*!
+         * This is called from SocketGroup::poll() when the socket reports an
+         * error.
+         *
+         * @return True if there was nothing but zero copy completions in the
+         *         error queue. False means the error is a real one.
+         */
+        bool reapZeroCopy() const;
     public:
         //! Try and read a chunk of data out of the socket.
         /*!
@@ -184,6 +303,112 @@ namespace Fastcgipp
         ssize_t write(const char* buffer, size_t size) const;
         ssize_t write2(const char* buffer, size_t size) const;
 
+        //! A contiguous chunk of memory to be written by a gathered write()
+        typedef std::pair<const char*, size_t> Chunk;
+
+        //! Try and write a series of chunks into the socket in one call.
+        /*!
+         * This behaves exactly like write(const char*, size_t) except the data
+         * is gathered from multiple buffers with a single system call
+         * (sendmsg()/WSASend()). Bytes are written in the order of the chunks
+         * so a short write can be resolved by walking the chunks from the
+         * front.
+         *
+         * With @p zeroCopy set the kernel is asked to send straight out of the
+         * chunks instead of copying them. If it does, zeroCopySent() goes up
+         * by one and the chunks must be left alone until zeroCopied() says
+         * the kernel is done with them.
+         *
+         * With @p more set the kernel is told more data follows straight
+         * away (MSG_MORE) so it can hold on to a partial segment. The next
+         * write without it sends everything.
+         *
+         * @param [in] chunks Buffers to write from, in order.
+         * @param [in] zeroCopy True to try and send with MSG_ZEROCOPY.
+         * @param [in] more True if more data is about to be written.
+         * @return Actual number of bytes written from all the chunks. A -1
+         *         means you can't actually write data to the socket anymore.
+         */
+        ssize_t write(
+                const std::vector<Chunk>& chunks,
+                bool zeroCopy=false,
+                bool more=false) const;
+
+    private:
+#if ! defined(FASTCGIPP_WINDOWS)
+        //! Set up a sendmsg() of chunks as write() would
+        /*!
+         * @param [in] chunks Buffers to write from, in order.
+         * @param [in] zeroCopy True to try and send with MSG_ZEROCOPY.
+         * @param [in] more True if more data is about to be written.
+         * @param [out] buffers Filled in to point at the chunks.
+         * @param [out] message Filled in to point at the buffers.
+         * @return Flags to send with.
+         */
+        int gather(
+                const std::vector<Chunk>& chunks,
+                bool zeroCopy,
+                bool more,
+                std::vector<iovec>& buffers,
+                msghdr& message) const;
+
+        //! Finish off a sendmsg() made with the flags from gather()
+        /*!
+         * A zero copy send the kernel had no memory to pin pages for is
+         * retried as a copy. Successful zero copy sends are counted. Call
+         * with the socket's mutex locked.
+         *
+         * @param [in] count What sendmsg() returned.
+         * @param [in] message The message sent.
+         * @param [in] flags The flags it was sent with.
+         * @return What the send finally returned. Check errno if it is
+         *         negative.
+         */
+        ssize_t sent(ssize_t count, const msghdr& message, int flags) const;
+#endif
+
+        //! Turn what a send returned into what write() returns
+        /*!
+         * Sends that would block count as zero bytes. Anything else that
+         * failed closes the socket.
+         *
+         * @param [in] count What the send returned. If negative the error is
+         *                   taken from getLastSocketError().
+         * @return Number of bytes written or -1.
+         */
+        ssize_t written(ssize_t count) const;
+    public:
+        //! Number of writes so far that were sent with zero copy
+        /*!
+         * Only call this from the thread writing to the socket.
+         */
+        uint32_t zeroCopySent() const
+        {
+            return m_data->m_zeroCopySent;
+        }
+
+        //! True if the kernel is done with the first @p sends zero copy writes
+        bool zeroCopied(uint32_t sends) const
+        {
+            return static_cast<int32_t>(m_data->m_zeroCopyDone-sends) >= 0;
+        }
+
+        //! Try and write part of a file into the socket
+        /*!
+         * This behaves exactly like write(const char*, size_t) except the data
+         * comes straight out of a file. On Linux this is done with sendfile()
+         * so it never passes through user space. Elsewhere it is read into a
+         * buffer first. A file ending before @p size bytes is treated like a
+         * socket error since the other side would be left waiting.
+         *
+         * @param [in] file File to write from.
+         * @param [in] offset Where in the file to start.
+         * @param [in] size Maximum amount of data to write.
+         * @return Actual number of bytes written from the file. A -1 means
+         *         you can't actually write data to the socket anymore.
+         */
+        ssize_t write(const File& file, uint64_t offset, size_t size) const;
+
         //! We need this to allow the socket objects to be in sorted containers.
         inline bool operator<(const Socket& x) const noexcept
         {
@@ -223,13 +448,26 @@ namespace Fastcgipp
          * into containers. The source socket has it's originality stripped and
          * moved to the destination.
          */
-        Socket(Socket&& x):
+        Socket(Socket&& x) noexcept:
             m_data(x.m_data),
             m_original(x.m_original)
         {
             x.m_original=false;
         }
 
+        //! Move assignment
+        /*!
+         * Like the move constructor, this moves "originality" from the source
+         * to the destination so sockets can be placed into the group's table.
+         */
+        Socket& operator=(Socket&& x) noexcept
+        {
+            m_data = std::move(x.m_data);
+            m_original = x.m_original;
+            x.m_original=false;
+            return *this;
+        }
+
         //! Calls close() on the socket if we are destructing the original
         ~Socket();
 
@@ -254,6 +492,48 @@ namespace Fastcgipp
         //! Creates an invalid socket with no original.
         Socket();
         socket_t getHandle()const;
+
+        //! Generation of this connection
+        /*!
+         * Every socket gets a new generation when it is created so two
+         * connections that happen to use the same OS level socket identifier
+         * can be told apart. Generations eventually wrap around so compare
+         * them with newer().
+         */
+        uint32_t generation() const
+        {
+            return m_data->m_generation;
+        }
+
+        //! True if generation \a a was handed out after generation \a b
+        static bool newer(uint32_t a, uint32_t b)
+        {
+            return static_cast<int32_t>(a-b) > 0;
+        }
+
+        //! The SocketGroup this socket belongs to
+        /*!
+         * @return Pointer to the owning SocketGroup or nullptr if this socket
+         *         was default constructed.
+         */
+        const SocketGroup* group() const
+        {
+            return m_data?&m_data->m_group:nullptr;
+        }
+
+        //! Compact handle to this connection
+        SocketId id() const;
+
+        //! Generation of the live socket using an OS level identifier
+        /*!
+         * Every valid socket in the process is recorded in a table indexed
+         * by its identifier. This lets a SocketId be checked without holding
+         * on to the socket itself.
+         *
+         * @return Generation of the valid socket using the identifier or zero
+         *         if there isn't one.
+         */
+        static uint32_t live(socket_t socket);
 #if defined(FASTCGIPP_WINDOWS)
 public:
 			static bool Startup();
@@ -261,6 +541,101 @@ public:
 #endif
     };
 
+    //! Compact handle to a connection
+    /*!
+     * This identifies a Socket by its OS level identifier and generation and
+     * is what requests hold on to instead of a copy of the Socket. It is
+     * trivially copyable so copying, comparing and checking one never touches
+     * a reference count. Since the generation is checked, a handle to a
+     * closed connection never mistakes a newer one reusing the identifier for
+     * its own.
+     *
+     * @date    October 16, 2026
+     */
+    class SocketId
+    {
+    public:
+        //! A handle to no connection at all
+        SocketId():
+            m_socket(0),
+            m_generation(0)
+        {}
+
+        SocketId(socket_t socket, uint32_t generation):
+            m_socket(static_cast<uint32_t>(socket)),
+            m_generation(generation)
+        {}
+
+        //! OS level socket identifier
+        socket_t socket() const
+        {
+            return static_cast<socket_t>(m_socket);
+        }
+
+        //! Generation of the connection
+        uint32_t generation() const
+        {
+            return m_generation;
+        }
+
+        //! Returns true if the connection is still open
+        bool valid() const
+        {
+            return m_generation != 0 && Socket::live(socket()) == m_generation;
+        }
+
+        bool operator<(const SocketId& x) const noexcept
+        {
+            return m_generation < x.m_generation
+                || (m_generation == x.m_generation && m_socket < x.m_socket);
+        }
+
+        bool operator==(const SocketId& x) const noexcept
+        {
+            return m_generation == x.m_generation && m_socket == x.m_socket;
+        }
+
+        bool operator!=(const SocketId& x) const noexcept
+        {
+            return !(*this == x);
+        }
+
+    private:
+        //! OS level socket identifier
+        uint32_t m_socket;
+
+        //! Generation of the connection
+        uint32_t m_generation;
+    };
+
+    inline SocketId Socket::id() const
+    {
+        return m_data?
+            SocketId(m_data->m_socket, m_data->m_generation):
+            SocketId();
+    }
+
+#if ! defined(FASTCGIPP_WINDOWS)
+    //! Pass sockets to another process over a connected Unix socket
+    /*!
+     * The receiving process gets its own descriptors of the same sockets.
+     * Ours remain open.
+     *
+     * @param [in] channel Connected Unix socket to send through.
+     * @param [in] sockets Sockets to send.
+     * @return True on success. False on failure.
+     */
+    bool sendSockets(socket_t channel, const std::vector<socket_t>& sockets);
+
+    //! Receive sockets passed with sendSockets()
+    /*!
+     * @param [in] channel Connected Unix socket to receive through.
+     * @param [out] sockets The received sockets are appended to this.
+     * @return True on success. False on failure.
+     */
+    bool receiveSockets(socket_t channel, std::vector<socket_t>& sockets);
+#endif
+
     //! Class for representing an OS level socket that listens for connections.
     /*!
      * It works together with the Socket class to establish all the interfacing
@@ -343,6 +718,47 @@ public:
 		bool listen(
 			const char* ifName,
 			int port);
+
+        //! Poll a listen socket that is owned by another SocketGroup
+        /*!
+         * This allows multiple SocketGroup objects, each with their own Poll
+         * and running in their own thread, to accept connections from the
+         * same listen socket. The socket is set non-blocking so that groups
+         * losing the race for a connection simply return to polling. The
+         * socket will not be closed when this SocketGroup is destroyed.
+         *
+         * @param [in] listener Listen socket to share.
+         * @return True on success. False on failure.
+         */
+        bool share(socket_t listener);
+
+#if ! defined(FASTCGIPP_WINDOWS)
+        //! Take ownership of a listen socket opened by another process
+        /*!
+         * The socket is treated just as though listen() had opened it. If it
+         * is bound to a path the file is removed when this SocketGroup is
+         * destroyed.
+         *
+         * @param [in] listener Listen socket to adopt.
+         * @return True on success. False on failure.
+         */
+        bool adopt(socket_t listener);
+
+        //! Give up our listen sockets to another process
+        /*!
+         * Once called, destroying this SocketGroup only closes our own
+         * descriptors of the listen sockets. They are neither shut down nor
+         * their files removed as another process is still accepting from
+         * them.
+         */
+        void handOver();
+#endif
+
+        //! The sockets we are currently listening on
+        const std::set<socket_t>& listeners() const
+        {
+            return m_listeners;
+        }
 #if ! defined(FASTCGIPP_WINDOWS)
         //! Connect to a named socket
         /*!
@@ -393,10 +809,13 @@ public:
          *
          * @param[in] block Set \em true to make the call sleep and wait for new
          *                  data to arrive.
+         * @param[in] timeout If blocking, give up and return an invalid socket
+         *                    after this many milliseconds. The kernel is then
+         *                    only polled once per call. -1 waits indefinitely.
          * @return The socket for which there is new data waiting. Make sure to
          *         Socket::valid() on it to ensure validity.
          */
-        Socket poll(bool block);
+        Socket poll(bool block, int timeout=-1);
 
         //! Wake up from a nap inside poll()
         /*!
@@ -409,10 +828,113 @@ public:
          */
         void wake();
 
+        //! Have poll() watch for a socket becoming writable
+        /*!
+         * Call this after a write() to the socket came up short. Once the
+         * kernel reports the socket writable, the next poll() will stop
+         * watching for write readiness and pass the socket to the function
+         * set with onWritable().
+         *
+         * This function is thread safe.
+         *
+         * @param [in] socket Socket to watch for write readiness.
+         */
+        void pollWrite(const Socket& socket);
+
+        //! A gathered write for write()
+        struct Write
+        {
+            //! Socket to write to
+            Socket socket;
+
+            //! Buffers to write from, in order
+            std::vector<Socket::Chunk> chunks;
+
+            //! True to try and send with MSG_ZEROCOPY
+            bool zeroCopy;
+
+            //! True if more data is about to be written
+            bool more;
+
+            //! What Socket::write() would have returned
+            ssize_t sent;
+        };
+
+        //! Make a batch of gathered writes to sockets in the group
+        /*!
+         * Each write behaves exactly like Socket::write() with its chunks.
+         * With io_uring they all go to the kernel in a single system call.
+         * Otherwise they are simply made one after the other.
+         *
+         * This function can be called from one thread while another is in
+         * poll(), but only from one thread at a time.
+         *
+         * @param [inout] writes Writes to make. Each one's sent is filled in.
+         */
+        void write(const std::vector<Write*>& writes);
+
+        //! How many writes are worth batching into a single write()
+        /*!
+         * This is one unless write() makes them with a single system call.
+         */
+        unsigned writeBatch() const;
+
+        //! Set the function to call when a socket becomes writable
+        /*!
+         * The function is called from within poll() so it should be quick and
+         * must not call back into this SocketGroup other than wake() and
+         * pollWrite().
+         *
+         * @param [in] writable Function to call with the writable socket.
+         */
+        void onWritable(const std::function<void(const Socket&)>& writable)
+        {
+            m_writable = writable;
+        }
+
+        //! Set the function to call when the kernel releases zero copy data
+        /*!
+         * The function is called from within poll() after the completions
+         * have been read out of the socket so Socket::zeroCopied() is up to
+         * date. The same restrictions as onWritable() apply.
+         *
+         * @param [in] zeroCopied Function to call with the socket.
+         */
+        void onZeroCopied(
+                const std::function<void(const Socket&)>& zeroCopied)
+        {
+            m_zeroCopied = zeroCopied;
+        }
+
+        //! Set the function to call when a new connection joins the group
+        /*!
+         * The function is called from within poll(). The same restrictions as
+         * onWritable() apply.
+         *
+         * @param [in] opened Function to call with the new socket.
+         */
+        void onOpened(const std::function<void(const Socket&)>& opened)
+        {
+            m_opened = opened;
+        }
+
+        //! Set the function to call when a socket is about to be closed
+        /*!
+         * The function is called from within poll() just before the OS level
+         * socket is closed and its identifier can be reused. The same
+         * restrictions as onWritable() apply.
+         *
+         * @param [in] closed Function to call with the socket.
+         */
+        void onClosed(const std::function<void(const Socket&)>& closed)
+        {
+            m_closed = closed;
+        }
+
         //! How many active sockets (not counting listeners) are in the group
         size_t size() const
         {
-            return m_sockets.size();
+            return m_socketCount;
         }
 
         //! Should we accept new connections?
@@ -431,6 +953,47 @@ public:
         {
             m_reuse = value;
         }
+
+        //! Should we set socket option to reuse port on TCP listeners
+        /*!
+         * With this set, multiple SocketGroup objects can bind and listen to
+         * the same TCP interface and port with the kernel balancing incoming
+         * connections between them.
+         *
+         * @param [in] status Set to true if you want to reuse port.
+         *                    False otherwise (default).
+         */
+        void reusePort(bool value)
+        {
+            m_reusePort = value;
+        }
+
+        //! Should listen sockets wake only one poll sharing them
+        /*!
+         * Set this when the same listen socket is polled by several
+         * SocketGroup objects so a new connection doesn't wake them all. Call
+         * before listening.
+         *
+         * @param [in] status Set to true to poll listeners with
+         *                    EPOLLEXCLUSIVE. False otherwise (default).
+         */
+        void exclusiveListen(bool value)
+        {
+            m_exclusiveListen = value;
+        }
+
+        //! Maximum number of connections accepted per listener event
+        /*!
+         * Every time a listen socket is reported readable, connections are
+         * accepted until the backlog is empty or this many have been
+         * accepted. The default is 64.
+         *
+         * @param [in] batch Number of connections. Zero is treated as one.
+         */
+        void acceptBatch(unsigned batch)
+        {
+            m_acceptBatch = batch?batch:1;
+        }
     private:
         //! Our sockets need access to our private data
         friend class Socket;
@@ -441,8 +1004,10 @@ public:
         //! Our poll object
         Poll m_poll;
 
+#if ! defined(FASTCGIPP_WINDOWS)
         //! A pair of sockets for wakeup purposes
-        //socket_t m_wakeSockets[2];
+        socket_t m_wakeSockets[2];
+#endif
 
         //! Set to true while there is a pending wake
         bool m_waking;
@@ -450,6 +1015,21 @@ public:
         //! Set to true to reuse address
         bool m_reuse;
 
+        //! Set to true to reuse port on TCP listeners
+        bool m_reusePort;
+
+        //! Set to true to poll listeners with EPOLLEXCLUSIVE
+        bool m_exclusiveListen;
+
+        //! Maximum number of connections accepted per listener event
+        unsigned m_acceptBatch;
+
+        //! Listen sockets in m_listeners that are owned by another group
+        std::set<socket_t> m_sharedListeners;
+
+        //! Set to true once our listen sockets belong to another process
+        bool m_handedOver;
+
         //! Set to true if we should be accepting new connections
         std::atomic_bool m_accept;
 
@@ -459,21 +1039,89 @@ public:
         //! We need this mutex to thread safe the wake() function.
         std::mutex m_wakingMutex;
 
-        //! All the sockets
-        std::map<socket_t, Socket> m_sockets;
+        //! All the sockets indexed by their OS level identifier
+        /*!
+         * Slots of closed sockets hold a default constructed Socket.
+         */
+        std::vector<Socket> m_sockets;
+
+        //! Number of occupied slots in m_sockets
+        size_t m_socketCount;
 
-        //! Accept a new connection and create it's socket
+        //! Find the socket with the given identifier
+        /*!
+         * @return Pointer to the socket or nullptr if it isn't in the group.
+         */
+        Socket* findSocket(socket_t socket)
+        {
+            if (static_cast<size_t>(socket) >= m_sockets.size()
+                    || !m_sockets[socket].m_data)
+                return nullptr;
+            return &m_sockets[socket];
+        }
+
+        //! Put a new socket in the group
+        Socket& insertSocket(socket_t socket);
+
+        //! Close a socket and take it out of the group
+        /*!
+         * Nothing is done if the slot is now held by a socket of another
+         * generation.
+         */
+        void eraseSocket(socket_t socket, uint32_t generation);
+
+        //! Events retrieved by the last Poll::poll() but not yet handled
+        /*!
+         * poll() hands these out one at a time and only goes back to the
+         * kernel once the whole batch has been drained.
+         */
+        std::vector<Poll::Result> m_ready;
+
+        //! Next event in m_ready to handle
+        unsigned m_readyIndex;
+
+        //! Number of valid events in m_ready
+        unsigned m_readyCount;
+
+        //! Accept new connections and create their sockets
+        /*!
+         * This keeps accepting until the listener's backlog is empty or
+         * m_acceptBatch connections have been accepted.
+         */
         inline void createSocket(const socket_t listener);
 
+        //! Add a connection accepted on one of our listeners to the group
+        inline void accepted(const socket_t socket);
+
         //! Filenames to cleanup when we're done
         std::deque<std::string> m_filenames;
 	private:
 		std::mutex m_pollMutex;
-		std::vector<std::pair<socket_t, bool> >m_ready2DoSock;
+		std::vector<std::pair<SocketId, bool> >m_ready2DoSock;
+
+        //! Sockets to start polling for write readiness
+        std::vector<socket_t> m_pollWrite;
+
+        //! Function to call when a socket becomes writable
+        std::function<void(const Socket&)> m_writable;
+
+        //! Function to call when zero copy data has been released
+        std::function<void(const Socket&)> m_zeroCopied;
+
+        //! Function to call when a connection joins the group
+        std::function<void(const Socket&)> m_opened;
+
+        //! Function to call before a socket is closed
+        std::function<void(const Socket&)> m_closed;
 	private:
-		void doAddDel();
+		//! Apply pending additions and removals to the poll
+		/*!
+		 * @return True if a new socket was passed to the onOpened()
+		 *         function.
+		 */
+		bool doAddDel();
 		void add(const socket_t socket);
-		void del(const socket_t socket);
+		void del(const socket_t socket, uint32_t generation);
 #if FASTCGIPP_LOG_LEVEL > 3
         //! Debug counter for incoming connections
         std::atomic_ullong m_incomingConnectionCount;
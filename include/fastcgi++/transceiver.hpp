@@ -30,7 +30,9 @@
 #define FASTCGIPP_TRANSCEIVER_HPP
 
 #include <map>
+#include <set>
 #include <list>
+#include <vector>
 //#include <queue>
 #include <algorithm>
 #include <map>
@@ -40,10 +42,12 @@
 #include <mutex>
 #include <condition_variable>
 #include <thread>
+#include <chrono>
 
 #include <fastcgi++/protocol.hpp>
 #include <fastcgi++/poll.hpp>
 #include "fastcgi++/block.hpp"
+#include "fastcgi++/wheel.hpp"
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
@@ -54,21 +58,21 @@ namespace Fastcgipp
      * level sockets and also the creation/destruction of the sockets
      * themselves.
      *
+     * The work is split across one or more reactors. Each reactor owns its own
+     * SocketGroup (and thus its own Poll), a list of connections ready to
+     * transmit, and a receive and a transmit thread. The receive buffer and
+     * send queue of every connection sit together in a table indexed by
+     * socket identifier. Queueing output for a connection never takes a lock
+     * shared with other connections.
+     * Connections are spread across reactors by the kernel with SO_REUSEPORT
+     * on TCP listeners and by sharing the listen socket otherwise.
+     *
      * @date    May 4, 2017
      * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
      */
     class Transceiver
     {
     public:
-        //! General transceiver handler
-        /*!
-         * This function is called by Manager::handler() to both transmit data
-         * passed to it from requests and relay received data back to them as a
-         * Message. The function will return true if there is nothing at all for
-         * it to do.
-         */
-        void handler();
-        void recvHandler();
         //! Call from any thread to stop the handler() thread
         /*!
          * Calling this thread will signal the handler() thread to cleanly stop
@@ -105,8 +109,32 @@ namespace Fastcgipp
          * @param[in] kill True if the socket should be closed once everything
          *                 is sent.
          */
-        void send(const Socket& socket, Block&& data, bool kill);
-        void send2(const Socket& socket, Block&& data, bool kill);
+        void send(const SocketId& socket, Block&& data, bool kill);
+        void send2(const SocketId& socket, Block&& data, bool kill);
+
+        //! Queue up a block of data followed by part of a file
+        /*!
+         * The file data is moved straight from the page cache into the socket
+         * where the OS allows it and never copied through user space. The
+         * data, the file and the padding are queued together so nothing else
+         * on the socket can land between them.
+         *
+         * @param[in] socket Socket to write the data out
+         * @param[in] data Block of data to send out before the file. Normally
+         *                 this is a FastCGI record header.
+         * @param[in] file File to send from
+         * @param[in] offset Where in the file to start
+         * @param[in] size Number of bytes of the file to send
+         * @param[in] padding Number of zero bytes to send after the file. It
+         *                    must be less than Protocol::chunkSize.
+         */
+        void sendFile(
+                const SocketId& socket,
+                Block&& data,
+                const std::shared_ptr<const File>& file,
+                uint64_t offset,
+                size_t size,
+                size_t padding);
 
         //! Constructor
         /*!
@@ -128,10 +156,7 @@ namespace Fastcgipp
          *
          * @return True on success. False on failure.
          */
-        bool listen()
-        {
-            return m_socketGroup.listen();
-        }
+        bool listen();
 
 #if ! defined(FASTCGIPP_WINDOWS)
         //! Listen to a named socket
@@ -153,10 +178,7 @@ namespace Fastcgipp
                 const char* name,
                 uint32_t permissions = 0xffffffffUL,
                 const char* owner = nullptr,
-                const char* group = nullptr)
-        {
-            return m_socketGroup.listen(name, permissions, owner, group);
-        }
+                const char* group = nullptr);
 #endif
         //! Listen to a TCP port
         /*!
@@ -172,10 +194,7 @@ namespace Fastcgipp
          */
         bool listen(
                 const char* ifName,
-                const char* service)
-        {
-            return m_socketGroup.listen(ifName, service);
-        }
+                const char* service);
 		//! Listen to a TCP port
 		/*!
 		 * Listen on a specific interface and TCP port.
@@ -189,72 +208,852 @@ namespace Fastcgipp
 		 * @return True on success. False on failure.
 		 */
 		bool listen(
-			const char* ifName, int port)
-		{
-			return m_socketGroup.listen(ifName, port);
-		}
-			
+			const char* ifName, int port);
+
+        //! Accept connections from a listen socket owned by another process
+        /*!
+         * Every reactor polls the socket exclusively since other processes
+         * are accepting from it as well.
+         *
+         * @param [in] listener Listen socket to accept connections from.
+         * @return True on success. False on failure.
+         */
+        bool inherit(socket_t listener);
+
+#if ! defined(FASTCGIPP_WINDOWS)
+        //! Send all our listen sockets to another process
+        /*!
+         * We keep accepting from them until releaseListeners() is called.
+         *
+         * @param [in] channel Connected Unix socket to the other process.
+         * @return True on success. False on failure.
+         */
+        bool sendListeners(socket_t channel);
+
+        //! Leave the listen sockets sent with sendListeners() to their new owner
+        /*!
+         * This should be followed by stop().
+         */
+        void releaseListeners();
+
+        //! Listen to the sockets another process sent with sendListeners()
+        /*!
+         * @param [in] channel Connected Unix socket to the other process.
+         * @return True if at least one listen socket was adopted.
+         */
+        bool adoptListeners(socket_t channel);
+#endif
+
         //! Should we set socket option to reuse address
         /*!
          * @param [in] status Set to true if you want to reuse address.
          *                    False otherwise (default).
          */
-        void reuseAddress(bool value)
-        {
-            m_socketGroup.reuseAddress(value);
-        }
+        void reuseAddress(bool value);
+
+        //! Set the maximum number of connections accepted per wakeup
+        /*!
+         * Each time a listen socket becomes readable the reactor accepts
+         * connections until the backlog is empty or this many have been
+         * accepted. The default is 64.
+         *
+         * @param[in] batch Number of connections. Zero is treated as one.
+         */
+        void acceptBatch(unsigned batch);
+
+        //! Set the ceiling on bytes queued for transmission
+        /*!
+         * This covers every connection together. Once it is reached, only
+         * producers on connections holding more than their fair share of it
+         * are made to wait so a few big responses can't hold up small ones.
+         * The default is 10 MiB.
+         */
         void SetMaxSendBufferSize(int nSize)
         {
             m_maxSendBufferSize=nSize;
         }
+
+        //! Set the limit on bytes queued for transmission on one connection
+        /*!
+         * A request producing output faster than its connection can take it
+         * waits in send() once this much is queued. Requests multiplexed on
+         * the same connection share the budget. The default is 4 MiB.
+         */
+        void SetMaxConnectionBufferSize(int nSize)
+        {
+            m_maxConnectionBufferSize=nSize;
+        }
+
+        //! Send large records without copying them into the kernel
+        /*!
+         * Records at least this big are written with MSG_ZEROCOPY where the
+         * socket supports it and held on to until the kernel says it is done
+         * with them. Smaller records are still copied as usual since pinning
+         * pages costs more than copying a few kilobytes. Something around
+         * 32 KiB is a sensible value. The default is zero which turns this
+         * off.
+         *
+         * @param[in] threshold Minimum record size in bytes to send with zero
+         *                      copy.
+         */
+        void zeroCopy(size_t threshold)
+        {
+            m_zeroCopyThreshold = threshold;
+        }
+
+        //! Hold back partial segments until a response is complete
+        /*!
+         * With this set, output of a request still being produced is written
+         * with MSG_MORE so the kernel waits for more before sending a partial
+         * segment. The END_REQUEST record, or anything that isn't response
+         * data, goes out without it and pushes everything. Small responses
+         * then leave in a single segment. Handlers that stream output slowly
+         * may see it held for up to the kernel's cork timeout (200 ms on
+         * Linux) so this is off by default.
+         *
+         * @param[in] value True to cork responses.
+         */
+        void cork(bool value)
+        {
+            m_cork = value;
+        }
+
+        //! Close connections that stall in the middle of a record header
+        /*!
+         * Once the first byte of a record has arrived, the rest of its header
+         * must follow within this time or the connection is closed. The
+         * default is zero which turns this off.
+         */
+        void headerTimeout(std::chrono::milliseconds timeout)
+        {
+            m_headerTimeout = static_cast<unsigned>(timeout.count());
+        }
+
+        //! Close connections that stall in the middle of a record body
+        /*!
+         * Once a record's header has arrived, its content and padding must
+         * follow within this time or the connection is closed. The default
+         * is zero which turns this off.
+         */
+        void bodyTimeout(std::chrono::milliseconds timeout)
+        {
+            m_bodyTimeout = static_cast<unsigned>(timeout.count());
+        }
+
+        //! Close connections that have nothing going on
+        /*!
+         * A connection is closed once nothing has been received on it for
+         * this long, provided it has no requests in progress and nothing
+         * queued to send. The other side simply opens a new one when it needs
+         * it. The default is zero which turns this off.
+         */
+        void idleTimeout(std::chrono::milliseconds timeout)
+        {
+            m_idleTimeout = static_cast<unsigned>(timeout.count());
+        }
+
+        //! Give up on requests that take too long
+        /*!
+         * Once this long has passed since a request's BEGIN_REQUEST record
+         * arrived, it is passed a Message of type Message::timeout. Requests
+         * respond to that with Request::timeoutHandler() and complete. The
+         * default is zero which turns this off.
+         */
+        void requestTimeout(std::chrono::milliseconds timeout)
+        {
+            m_requestTimeout = static_cast<unsigned>(timeout.count());
+        }
+
+        //! Set the maximum number of connections open at a time
+        /*!
+         * Every request begun on a connection opened beyond this limit is
+         * answered straight away with an OVERLOADED status and the
+         * connection is closed. The limit is reported as FCGI_MAX_CONNS. The
+         * default is zero which means no limit.
+         */
+        void maxConnections(unsigned connections)
+        {
+            m_maxConnections = connections;
+        }
+
+        //! The maximum number of connections open at a time
+        unsigned maxConnections() const
+        {
+            return m_maxConnections;
+        }
+
+        //! Set the maximum number of requests in progress at a time
+        /*!
+         * A request begun beyond this limit is answered straight away with an
+         * OVERLOADED status so the other side can try elsewhere. Nothing is
+         * allocated for it and the rest of its records are ignored. The limit
+         * is reported as FCGI_MAX_REQS. The default is zero which means no
+         * limit.
+         */
+        void maxRequests(unsigned requests)
+        {
+            m_maxRequests = requests;
+        }
+
+        //! The maximum number of requests in progress at a time
+        unsigned maxRequests() const
+        {
+            return m_maxRequests;
+        }
+
+        //! Call once a request passed on with a BEGIN_REQUEST record is gone
+        /*!
+         * This makes room for another one under maxRequests(). It must be
+         * called exactly once for every BEGIN_REQUEST record passed to the
+         * message function, whether or not a request was made for it.
+         */
+        void requestEnded()
+        {
+            --m_requestCount;
+        }
+
+        //! Call before listen() to change the number of reactors
+        /*!
+         * Each reactor polls, receives and transmits in its own pair of
+         * threads so socket I/O can scale past a single core. The default is a
+         * single reactor. With more than one, a listen socket they share wakes
+         * only one of them per incoming connection. If the Transceiver is
+         * already running this will do nothing.
+         *
+         * @param[in] count Number of reactors. Zero is treated as one.
+         */
+        void reactors(unsigned count);
+
+        //! How many reactors are we running
+        unsigned reactors() const
+        {
+            return m_reactors.size();
+        }
+
+        //! Call before start() to pin the reactor threads to CPUs
+        /*!
+         * Both threads of reactor n are pinned to cpus[n], wrapping around if
+         * there are more reactors than CPUs. Leave those CPUs out of
+         * Manager_base::workerCpus() to keep socket I/O on cores of its own.
+         * The connection table pages and receive buffers are first touched by
+         * the receive threads so they end up on the NUMA nodes of these CPUs.
+         * This only has an effect on Linux.
+         *
+         * @param[in] cpus CPUs to pin reactors to. Empty (default) leaves
+         *                 placement to the OS.
+         */
+        void reactorCpus(const std::vector<unsigned>& cpus)
+        {
+            m_reactorCpus = cpus;
+        }
+
+        //! The CPUs reactor threads are pinned to
+        const std::vector<unsigned>& reactorCpus() const
+        {
+            return m_reactorCpus;
+        }
     private:
-        //! Container associating sockets with their receive buffers
-        std::map<Socket, std::shared_ptr<Block> > m_receiveBuffers;
-        std::mutex m_recvBufferMutex;
 
         //! Simple FastCGI record to queue up for transmission
         struct Record
         {
-            const Socket socket;
+            const SocketId socket;
             const Block data;
             const char* read;
             const bool kill;
 			bool bSend2;
+
+            //! True if the other side is waiting on this record
+            /*!
+             * This is anything other than OUTPUT or ERR data. A corked
+             * connection is pushed once such a record is written.
+             */
+            bool push;
+
+            //! File to transmit from once the data is out, if any
+            const std::shared_ptr<const File> file;
+
+            //! Where in the file to continue from
+            uint64_t offset;
+
+            //! Bytes left to transmit from the file
+            size_t length;
+
+            //! Zero bytes left to transmit after the file
+            size_t padding;
+
+            //! True if some of the data went out with zero copy
+            bool pinned;
+
+            //! Socket::zeroCopySent() after the last zero copy write of it
+            uint32_t release;
+
+            //! Next record in a connection's incoming stack
+            Record* next;
+
             Record(
-                    const Socket& socket_,
+                    const SocketId& socket_,
                     Block&& data_,
                     bool kill_,bool send2):
                 socket(socket_),
                 data(std::move(data_)),
                 read(data.begin()),
                 kill(kill_)
-                ,bSend2(send2)
+                ,bSend2(send2),
+                push(kill_),
+                offset(0),
+                length(0),
+                padding(0),
+                pinned(false),
+                release(0),
+                next(nullptr)
+            {}
+
+            Record(
+                    const SocketId& socket_,
+                    const std::shared_ptr<const File>& file_,
+                    uint64_t offset_,
+                    size_t length_,
+                    size_t padding_):
+                socket(socket_),
+                read(data.begin()),
+                kill(false),
+                bSend2(false),
+                push(false),
+                file(file_),
+                offset(offset_),
+                length(length_),
+                padding(padding_),
+                pinned(false),
+                release(0),
+                next(nullptr)
+            {}
+
+            //! Bytes left to transmit
+            size_t remaining() const
+            {
+                return data.end()-read+length+padding;
+            }
+
+            //! Move past bytes that have been transmitted
+            void advance(size_t bytes)
+            {
+                const size_t inData = data.end()-read;
+                if(bytes <= inData)
+                    read += bytes;
+                else
+                {
+                    read = data.end();
+                    bytes -= inData;
+                    const size_t inFile = std::min(bytes, length);
+                    offset += inFile;
+                    length -= inFile;
+                    padding -= bytes-inFile;
+                }
+            }
+        };
+
+        struct Reactor;
+
+        //! What the receive side of a connection is waiting for
+        enum class Deadline
+        {
+            IDLE,
+            HEADER,
+            BODY
+        };
+
+        //! Everything we keep for a single connection
+        /*!
+         * Connections live in a table indexed directly by the OS level socket
+         * identifier. Since identifiers get reused, a slot also records the
+         * generation of the socket occupying it and anything referring to
+         * another generation is stale. A socket claims its slot the first
+         * time we receive from it, so records queued by SocketId can be
+         * resolved to the Socket here.
+         *
+         * Any number of threads push records onto the incoming stack without
+         * locking. The transmit side moves them over to the records list under
+         * the mutex, which in practice is only ever held by one thread.
+         */
+        struct Connection
+        {
+            //! Thread safe the transmit side of the connection
+            std::mutex mutex;
+
+            //! Generation of the socket we are transmitting to
+            uint32_t generation;
+
+            //! The socket we are transmitting to
+            Socket socket;
+
+            //! Reactor owning the socket
+            /*!
+             * This is read without the mutex to pick the ready list to put
+             * the connection in. If it is stale the transmit thread passes the
+             * connection on to the right one.
+             */
+            std::atomic<Reactor*> reactor;
+
+            //! Records waiting to be transmitted in order
+            std::list<std::unique_ptr<Record>> records;
+
+            //! Sent records the kernel may still be reading from
+            /*!
+             * These went out with zero copy and are kept in the order they
+             * were sent until the socket says they have been released.
+             */
+            std::list<std::unique_ptr<Record>> pinned;
+
+            //! True if the socket should be closed once nothing is pinned
+            bool lingering;
+
+            //! Records queued by send() in reverse order
+            std::atomic<Record*> incoming;
+
+            //! Bytes queued on this connection but not yet sent
+            std::atomic_size_t queued;
+
+            //! Bytes this connection may still send in the current round
+            size_t deficit;
+
+            //! True if the kernel buffer is full
+            /*!
+             * Records stay queued until the poll reports the socket writable
+             * again.
+             */
+            bool blocked;
+
+            //! True while the connection is waiting in a ready list
+            std::atomic_bool ready;
+
+            //! Next connection in the ready list
+            Connection* nextReady;
+
+            //! Generation of the socket the receive buffer belongs to
+            uint32_t receiveGeneration;
+
+            //! Partially received records
+            /*!
+             * Only the receive thread of the reactor owning the socket
+             * touches this so it isn't protected by the mutex. The same goes
+             * for the deadlines below, which are armed in that reactor's
+             * wheel.
+             */
+            Block receiveBuffer;
+
+            //! What the receive deadline is currently for
+            Deadline deadline;
+
+            //! Closes the connection when receiving takes too long
+            Timer receiveTimer;
+
+            //! Times out requests by FastCGI request id
+            std::map<Protocol::FcgiId, Timer> requestTimers;
+
+            //! Requests whose END_REQUEST went out with their timers still set
+            /*!
+             * The transmit thread fills this as it collects the records and
+             * the receive thread cancels the timers. Protected by mutex.
+             */
+            std::vector<Protocol::FcgiId> endedRequests;
+
+            //! True if endedRequests may have something in it
+            std::atomic_bool requestsEnded;
+
+            //! Number of requests begun and not yet ended
+            std::atomic_uint requests;
+
+            //! True if opened while we were over maxConnections()
+            bool overloaded;
+
+            //! Requests turned away whose remaining records are ignored
+            std::set<Protocol::FcgiId> rejected;
+
+            Connection():
+                generation(0),
+                reactor(nullptr),
+                lingering(false),
+                incoming(nullptr),
+                queued(0),
+                deficit(0),
+                blocked(false),
+                ready(false),
+                nextReady(nullptr),
+                receiveGeneration(0),
+                deadline(Deadline::IDLE),
+                requestsEnded(false),
+                requests(0),
+                overloaded(false)
             {}
+
+            ~Connection();
+        };
+
+        //! A gathered write to a connection waiting to go out in a batch
+        struct Transmission
+        {
+            //! Connection being written to
+            Connection* connection;
+
+            //! Holds the connection's mutex until the write is retired
+            std::unique_lock<std::mutex> lock;
+
+            //! The write itself
+            SocketGroup::Write write;
+
+            //! File record being written instead of the chunks, if any
+            const Record* file;
+
+            //! Socket::zeroCopySent() before the write
+            uint32_t zeroCopySent;
         };
 
-        //! %Buffer for transmitting data
-        std::map<socket_t,std::list<std::unique_ptr<Record>> > m_sendBuffer;
-        std::atomic_int m_sendBufferSize;
+        //! A single I/O shard with its own poll, ready list and threads
+        struct Reactor
+        {
+            //! Listen for connections with this
+            SocketGroup socketGroup;
+
+            //! Connections with records to transmit in reverse order
+            /*!
+             * This is a lock-free stack. The transmit thread takes the whole
+             * thing at once.
+             */
+            std::atomic<Connection*> ready;
+
+            //! Set when there is something queued that handler() hasn't seen
+            bool sendPending;
+            std::mutex wakeMutex;
+            std::condition_variable wakeSend;
+
+            //! Thread our transmit handler is running in
+            std::thread thread;
+
+            //! Thread our receive handler is running in
+            std::thread threadRecv;
+
+            //! CPUs our threads are pinned to or empty if they aren't
+            std::vector<unsigned> cpus;
+
+            //! Deadlines of the connections we receive from
+            /*!
+             * Only the receive thread touches this.
+             */
+            TimingWheel wheel;
+
+            //! Writes gathered by the transmit thread
+            /*!
+             * Only the first batched are waiting to go out. The rest are kept
+             * around so their chunks needn't be allocated again.
+             */
+            std::vector<Transmission> batch;
+
+            //! Number of writes waiting in batch
+            unsigned batched;
+
+            //! Pointers to the writes for SocketGroup::write()
+            std::vector<SocketGroup::Write*> writes;
+
+            Reactor():
+                ready(nullptr),
+                sendPending(false),
+                batched(0)
+            {}
+        };
+
+        //! Number of connections in a page of the connection table
+        static const size_t s_connectionPage = 1024;
+
+        //! Number of pages in the connection table
+        static const size_t s_connectionPages = 1024;
+
+        //! The connection table indexed by OS level socket identifier
+        /*!
+         * Pages are allocated on first use and never move or get freed until
+         * we are destroyed so connections can be looked up without a lock.
+         */
+        std::atomic<Connection*> m_connections[s_connectionPages];
+
+        //! Find the connection slot for a socket
+        /*!
+         * @param[in] socket Socket identifier to look up.
+         * @return Pointer to the slot or nullptr if the identifier is too
+         *         large for the table.
+         */
+        Connection* connection(socket_t socket);
+
+        //! Make sure a connection slot belongs to a socket
+        /*!
+         * If the socket is newer than the slot's occupant, the slot is reset
+         * and handed to it. Call with the connection's mutex locked.
+         *
+         * @return False if the socket is older than the occupant.
+         */
+        bool claim(Connection& connection, const Socket& socket);
+
+        //! Start receiving from a socket in its connection slot
+        /*!
+         * The receive buffer and deadlines are reset and the slot is claimed.
+         * Call from the receive thread of the reactor owning the socket.
+         *
+         * @return False if the socket is older than the occupant.
+         */
+        bool attach(
+                Reactor& reactor,
+                Connection& connection,
+                const Socket& socket);
+
+        //! Push records onto a connection's incoming stack and schedule it
+        /*!
+         * The records are pushed together in a single operation so nothing
+         * queued by another thread can land between them.
+         *
+         * @param[in] socket Connection the records are for
+         * @param[in] newest Last record to transmit. Records are linked from
+         *                   here to @p oldest with Record::next.
+         * @param[in] oldest First record to transmit
+         * @param[in] size Total bytes in the records
+         * @param[in] wait True to wait while the connection is throttled.
+         *                 The reactor threads pass false since they are what
+         *                 drains it.
+         */
+        void queue(
+                const SocketId& socket,
+                Record* newest,
+                Record* oldest,
+                size_t size,
+                bool wait=true);
+
+        //! send() with a choice of waiting on a throttled connection
+        void enqueue(const SocketId& socket, Block&& data, bool kill, bool wait);
+
+        //! Move everything on the incoming stack over to the records list
+        /*!
+         * Records for any socket but the one that claimed the slot are
+         * discarded. Call with the connection's mutex locked.
+         */
+        void collect(Connection& connection);
+
+        //! Put a connection in a reactor's ready list if it isn't already
+        /*!
+         * This is lock-free and can be called from any thread. The transmit
+         * thread is only woken if the list was empty.
+         */
+        void ready(Reactor& reactor, Connection& connection);
+
+        //! All our reactors. There is always at least one.
+        std::vector<std::unique_ptr<Reactor>> m_reactors;
+
+        //! CPUs to pin the reactors to
+        std::vector<unsigned> m_reactorCpus;
+
+        //! Find the reactor that owns a socket
+        Reactor& reactor(const Socket& socket);
+
+        //! Have all other reactors share listeners new to the first one
+        /*!
+         * @param[in] before The listeners of the first reactor before the
+         *                   new ones were added.
+         */
+        void shareListeners(const std::set<socket_t>& before);
+
+        //! Ceiling on bytes queued across all connections
         std::atomic_int m_maxSendBufferSize;
-        //! Thread safe the send buffer
-        std::mutex m_sendBufferMutex;
-        std::mutex m_wakeMutex;
-		std::condition_variable m_wakeSend;
+
+        //! Limit on bytes queued on a single connection
+        std::atomic_int m_maxConnectionBufferSize;
+
+        //! Bytes queued for transmission across all connections
+        std::atomic_size_t m_sendBufferSize;
+
+        //! Number of connections with anything queued
+        std::atomic_uint m_busyConnections;
+
+        //! Number of producers waiting in send()
+        std::atomic_uint m_waiting;
+
+        //! Thread safe waiting on m_drained
+        std::mutex m_drainedMutex;
+
+        //! Signalled when queued data has been sent or dropped
+        std::condition_variable m_drained;
+
+        //! Should a producer on this connection wait before queueing more
+        /*!
+         * A connection with nothing queued never waits. Otherwise it waits
+         * if it is over its own budget, or if the ceiling has been reached
+         * and it holds at least its fair share of it.
+         */
+        bool throttled(const Connection& connection) const;
+
+        //! Account for bytes leaving a connection's queue
+        void dequeued(Connection& connection, size_t bytes);
+
+        //! Bytes each connection may send per visit of the transmit thread
+        /*!
+         * This is larger than any FastCGI record so every visit sends at
+         * least one.
+         */
+        static const size_t s_quantum = 128*1024;
+
+        //! Should sockets be set to reuse address
+        bool m_reuseAddress;
+
+        //! Maximum number of connections accepted per wakeup
+        unsigned m_acceptBatch;
 
         //! Function to call to pass messages to requests
         const std::function<void(Protocol::RequestId, Message&&)> m_sendMessage;
 
-        //! Listen for connections with this
-        SocketGroup m_socketGroup;
+        //! General transceiver transmit handler
+        /*!
+         * This function runs in its own thread for each reactor and transmits
+         * data passed to it from requests.
+         */
+        void handler(Reactor& reactor);
+
+        //! General transceiver receive handler
+        /*!
+         * This function runs in its own thread for each reactor and relays
+         * received data back to requests as a Message.
+         */
+        void recvHandler(Reactor& reactor);
 
         //! Transmit all buffered data possible
         /*!
+         * All records queued for a socket are gathered into a single write so
+         * that a response and its END_REQUEST, or the output of several
+         * multiplexed requests, go out in one system call. Connections are
+         * served by deficit round robin so each gets the same number of bytes
+         * per round no matter how much it has queued. The writes of several
+         * connections are batched together if the socket group can make them
+         * with a single system call.
+         *
          * @return True if we successfully sent all data that was queued up.
          */
-        inline bool transmit();
+        inline bool transmit(Reactor& reactor);
+
+        //! Make every write batched by transmit() and retire them
+        inline void flush(Reactor& reactor);
+
+        //! Account for a write to a connection once it has been made
+        /*!
+         * Every record that made it out is retired and the connection is
+         * blocked, closed or put back in the ready list as needed. Call with
+         * the connection's mutex locked.
+         */
+        inline void retire(Reactor& reactor, Transmission& transmission);
+
+        //! Maximum number of records gathered into a single write
+        static const unsigned s_maxGather = 64;
+
+        //! Zeros to pad out records that end in file data
+        static const char s_padding[Protocol::chunkSize];
 
         //! Receive data on the specified socket.
-        inline void receive(Socket& socket);
+        /*!
+         * Data is read into the socket's receive buffer in chunks of
+         * s_receiveSize bytes and every complete record in it is passed along
+         * as its own Message. A partial record at the end stays in the buffer
+         * until the rest of it arrives.
+         */
+        inline void receive(Reactor& reactor, Socket& socket);
+
+        //! Minimum size of each socket's receive buffer
+        static const size_t s_receiveSize = 64*1024;
+
+        //! Discard everything queued on a connection
+        /*!
+         * Call with the connection's mutex locked.
+         */
+        void dropRecords(Connection& connection);
+
+        //! Called from the poll when a blocked socket can be written again
+        void writable(Reactor& reactor, const Socket& socket);
+
+        //! Called from the poll when the kernel releases zero copy data
+        void zeroCopied(const Socket& socket);
+
+        //! Free every pinned record the kernel is done with
+        /*!
+         * A lingering connection is closed once nothing is left. Call with
+         * the connection's mutex locked.
+         */
+        void unpin(Connection& connection);
+
+        //! Called from the poll when a new connection is accepted
+        void opened(Reactor& reactor, const Socket& socket);
+
+        //! Called from the poll just before a socket is closed
+        /*!
+         * This disarms the connection's deadlines while we're still in the
+         * thread owning them and before the identifier can be reused.
+         */
+        void closed(const Socket& socket);
+
+        //! Arm the receive deadline of a connection
+        void deadline(
+                Reactor& reactor,
+                Connection& connection,
+                Deadline deadline);
+
+        //! Called from the wheel when a receive deadline passes
+        void expired(Reactor& reactor, Connection& connection);
+
+        //! Called from the wheel when a request deadline passes
+        void requestExpired(
+                const Protocol::RequestId& id,
+                Connection& connection);
+
+        //! Cancel the timers of requests that have ended
+        /*!
+         * Only call from the receive thread of the reactor owning the
+         * connection.
+         */
+        void cancelEnded(Connection& connection);
+
+        //! Milliseconds allowed to complete a record header
+        std::atomic_uint m_headerTimeout;
+
+        //! Milliseconds allowed to complete a record body
+        std::atomic_uint m_bodyTimeout;
+
+        //! Milliseconds a connection may sit idle
+        std::atomic_uint m_idleTimeout;
+
+        //! Milliseconds a request may take
+        std::atomic_uint m_requestTimeout;
+
+        //! Maximum number of connections or zero
+        std::atomic_uint m_maxConnections;
+
+        //! Maximum number of requests or zero
+        std::atomic_uint m_maxRequests;
+
+        //! Number of connections open
+        std::atomic_uint m_connectionCount;
+
+        //! Number of requests passed on and not yet ended
+        std::atomic_uint m_requestCount;
+
+        //! Count a new request if it fits under maxRequests()
+        bool reserveRequest();
+
+        //! Answer a BEGIN_REQUEST record with an OVERLOADED status
+        void overloaded(
+                const Protocol::RequestId& id,
+                const Protocol::Header& header,
+                Connection& connection);
+
+        //! Records at least this big are sent with zero copy
+        std::atomic_size_t m_zeroCopyThreshold;
+
+        //! Should partial responses be written with MSG_MORE
+        std::atomic_bool m_cork;
+
+        //! Create a reactor and hook it up to our handlers
+        void addReactor();
 
         //! True when handler() should be terminating
         std::atomic_bool m_terminate;
@@ -262,10 +1061,6 @@ namespace Fastcgipp
         //! True when handler() should be stopping
         std::atomic_bool m_stop;
 
-        //! Thread our handler is running in
-        std::thread m_thread;
-        std::thread m_threadRecv;
-
         //! Cleanup a dead socket
         void cleanupSocket(const Socket& socket);
 
@@ -284,6 +1079,9 @@ namespace Fastcgipp
 
         //! Debug counter for bytes received
         std::atomic_ullong m_recordsReceived;
+
+        //! Debug counter for requests answered with OVERLOADED
+        std::atomic_ullong m_overloadedCount;
 #endif
     };
 }
@@ -0,0 +1,230 @@
+/*!
+ * @file       wheel.hpp
+ * @brief      Declares the Fastcgipp::TimingWheel class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_WHEEL_HPP
+#define FASTCGIPP_WHEEL_HPP
+
+#include <chrono>
+#include <functional>
+#include <cstdint>
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    class TimingWheel;
+
+    //! A deadline that can be armed in a TimingWheel
+    /*!
+     * Timers link themselves into the wheel so arming and cancelling never
+     * allocate. A timer must not be moved or copied while it is armed. It is
+     * cancelled automatically when destroyed.
+     */
+    class Timer
+    {
+    public:
+        //! Construct a timer that calls a function when it expires
+        /*!
+         * @param[in] expire Function to call from TimingWheel::advance() once
+         *                   the deadline has passed. It may arm or cancel any
+         *                   timer, including this one.
+         */
+        Timer(const std::function<void()>& expire=std::function<void()>()):
+            m_wheel(nullptr),
+            m_next(nullptr),
+            m_prev(nullptr),
+            m_expiry(0),
+            m_level(0),
+            m_expire(expire)
+        {}
+
+        Timer(const Timer&) =delete;
+        Timer& operator=(const Timer&) =delete;
+
+        ~Timer();
+
+        //! True if the timer is waiting to expire
+        bool armed() const
+        {
+            return m_wheel != nullptr;
+        }
+
+        //! Disarm the timer. This does nothing if it isn't armed.
+        void cancel();
+
+        //! Change the function called when the timer expires
+        void onExpire(const std::function<void()>& expire)
+        {
+            m_expire = expire;
+        }
+
+    private:
+        friend class TimingWheel;
+
+        //! The wheel we are armed in or nullptr
+        TimingWheel* m_wheel;
+
+        //! Next timer in the same slot
+        Timer* m_next;
+
+        //! Previous timer in the same slot
+        Timer* m_prev;
+
+        //! Tick on which we expire
+        uint64_t m_expiry;
+
+        //! Level of the wheel we are linked into
+        unsigned m_level;
+
+        //! Function to call when we expire
+        std::function<void()> m_expire;
+    };
+
+    //! Hierarchical timing wheel for connection and request deadlines
+    /*!
+     * Time is cut into ticks of a fixed resolution. The wheel has a few
+     * levels of slots, each level covering 64 times the span of the one below
+     * it. A timer is linked into the slot of the lowest level that can hold
+     * its deadline so arming and cancelling are constant time regardless of
+     * how many timers there are. As time advances the slots of the upper
+     * levels are redistributed into the lower ones until the timers reach the
+     * bottom and expire.
+     *
+     * Deadlines are rounded up to the next tick so timers never expire early.
+     * A deadline further out than the wheel spans is parked in the top level
+     * and re-armed until it is due.
+     *
+     * <em>The wheel isn't thread safe. It belongs to the thread that calls
+     * advance().</em>
+     */
+    class TimingWheel
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        //! Constructor
+        /*!
+         * @param[in] resolution Length of a tick. Deadlines are only ever
+         *                       honoured to within this much.
+         */
+        TimingWheel(
+                std::chrono::milliseconds resolution
+                    =std::chrono::milliseconds(100));
+
+        TimingWheel(const TimingWheel&) =delete;
+        TimingWheel& operator=(const TimingWheel&) =delete;
+
+        ~TimingWheel();
+
+        //! Arm a timer to expire at a specific time
+        /*!
+         * If the timer is already armed it is moved to the new deadline.
+         */
+        void arm(Timer& timer, Clock::time_point deadline);
+
+        //! Arm a timer to expire after some time has passed
+        void arm(Timer& timer, std::chrono::milliseconds timeout)
+        {
+            arm(timer, Clock::now()+timeout);
+        }
+
+        //! Disarm a timer. This does nothing if it isn't armed.
+        void cancel(Timer& timer);
+
+        //! Expire every timer whose deadline has passed
+        /*!
+         * @param[in] now Current time.
+         * @return Number of timers expired.
+         */
+        unsigned advance(Clock::time_point now=Clock::now());
+
+        //! How long a poll can wait before advance() has work to do
+        /*!
+         * @param[in] now Current time.
+         * @return Milliseconds until the next tick something could expire or
+         *         cascade on. -1 if nothing is armed.
+         */
+        int timeout(Clock::time_point now=Clock::now()) const;
+
+        //! Number of armed timers
+        size_t size() const
+        {
+            return m_size;
+        }
+
+    private:
+        //! Number of bits of the tick that index a level
+        static const unsigned s_bits = 6;
+
+        //! Number of slots in each level
+        static const unsigned s_slots = 1<<s_bits;
+
+        //! Number of levels
+        static const unsigned s_levels = 4;
+
+        //! Length of a tick
+        const Clock::duration m_resolution;
+
+        //! Time of tick zero
+        const Clock::time_point m_start;
+
+        //! The last tick that has been processed
+        uint64_t m_tick;
+
+        //! Number of armed timers
+        size_t m_size;
+
+        //! Number of armed timers in each level
+        size_t m_levelSize[s_levels];
+
+        //! Circular list heads for every slot of every level
+        Timer m_slots[s_levels][s_slots];
+
+        //! Link a timer into the slot its expiry belongs in
+        void place(Timer& timer);
+
+        //! Unlink a timer from its slot without disarming it
+        void unlink(Timer& timer);
+
+        //! Move every timer in a slot of an upper level down
+        void cascade(unsigned level);
+
+        //! Tick a point in time falls in
+        uint64_t tick(Clock::time_point time) const;
+
+        //! Point in time a tick starts at
+        Clock::time_point time(uint64_t tick) const
+        {
+            return m_start+m_resolution*static_cast<Clock::rep>(tick);
+        }
+
+        //! Move every timer in one list to the end of another
+        static void splice(Timer& from, Timer& to);
+    };
+}
+
+#endif
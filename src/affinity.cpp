@@ -0,0 +1,115 @@
+/*!
+ * @file       affinity.cpp
+ * @brief      Defines the CPU placement functions
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/config.hpp"
+#include "fastcgi++/affinity.hpp"
+#include "fastcgi++/log.hpp"
+
+#if defined(FASTCGIPP_LINUX)
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+
+std::vector<unsigned> Fastcgipp::allowedCpus()
+{
+    std::vector<unsigned> cpus;
+    cpu_set_t set;
+    if(pthread_getaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        return cpus;
+    for(unsigned cpu=0; cpu<CPU_SETSIZE; ++cpu)
+        if(CPU_ISSET(cpu, &set))
+            cpus.push_back(cpu);
+    return cpus;
+}
+
+std::vector<unsigned> Fastcgipp::nodeCpus(unsigned node)
+{
+    // The kernel lists them as ranges like "0-3,8-11"
+    std::vector<unsigned> cpus;
+    std::ifstream file(
+            "/sys/devices/system/node/node"+std::to_string(node)+"/cpulist");
+    std::string range;
+    while(std::getline(file, range, ','))
+    {
+        std::istringstream stream(range);
+        unsigned first;
+        unsigned last;
+        if(!(stream >> first))
+            continue;
+        last = first;
+        if(stream.get() == '-' && !(stream >> last))
+            last = first;
+        for(unsigned cpu=first; cpu<=last; ++cpu)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+bool Fastcgipp::pinThread(const std::vector<unsigned>& cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(const auto cpu: cpus)
+        if(cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    if(CPU_COUNT(&set) == 0)
+    {
+        ERR_LOG("No valid CPUs to pin a thread to")
+        return false;
+    }
+
+    const int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if(error != 0)
+    {
+        ERR_LOG("Unable to pin a thread to " << cpus.size() << " CPUs: " \
+                << std::strerror(error))
+        return false;
+    }
+    return true;
+}
+#else
+std::vector<unsigned> Fastcgipp::allowedCpus()
+{
+    return std::vector<unsigned>();
+}
+
+std::vector<unsigned> Fastcgipp::nodeCpus(unsigned)
+{
+    return std::vector<unsigned>();
+}
+
+bool Fastcgipp::pinThread(const std::vector<unsigned>&)
+{
+    WARNING_LOG("Pinning threads to CPUs isn't supported")
+    return false;
+}
+#endif
@@ -41,6 +41,7 @@
 
 void Fastcgipp::SQL::Connection::handler()
 {
+    Poll::Result pollResults[Poll::maxBatch];
     killAll();
     while(!m_terminate && !(m_stop && m_queue.empty()))
     {
@@ -106,9 +107,13 @@ void Fastcgipp::SQL::Connection::handler()
 
 
         // Let's see if any data is waiting for us from the connections
-        const auto pollResult = m_poll.poll(connected()?-1:m_retry);
-        if(pollResult)
+        const unsigned count = m_poll.poll(
+                pollResults,
+                Poll::maxBatch,
+                connected()?-1:m_retry);
+        for(unsigned i=0; i<count; ++i)
         {
+            const auto& pollResult = pollResults[i];
             if(pollResult.socket() == m_wakeSockets[1])
             {
                 // Looks like it's time to wake up
@@ -38,6 +38,7 @@ void Fastcgipp::Curler::handler()
     std::unique_lock<std::mutex> lock(m_mutex);
     int handles = 0;
     long timeout = -1;
+    Poll::Result pollResults[Poll::maxBatch];
 
     while(!m_terminate && !(m_stop && m_queue.empty() && m_handles.empty()))
     {
@@ -64,30 +65,41 @@ void Fastcgipp::Curler::handler()
             curl_multi_timeout(multiHandle, &timeout);
         else
             timeout = -1;
-        const auto pollResult = m_poll.poll(timeout);
-        if(pollResult.socket() == m_wakeSockets[1])
+        const unsigned count = m_poll.poll(
+                pollResults,
+                Poll::maxBatch,
+                timeout);
+        if(count == 0)
+            curl_multi_socket_action(
+                    multiHandle,
+                    CURL_SOCKET_TIMEOUT,
+                    0,
+                    &handles);
+
+        bool woken = false;
+        for(unsigned i=0; i<count; ++i)
         {
-            if(pollResult.onlyIn())
+            const auto& pollResult = pollResults[i];
+            if(pollResult.socket() == m_wakeSockets[1])
             {
-                lock.lock();
-                char x[256];
-                if(read(m_wakeSockets[1], x, 256)<1)
-                    FAIL_LOG("Unable to read out of Curler wakeup socket: " << \
-                            std::strerror(errno))
-                m_waking=false;
-                continue;
+                if(pollResult.onlyIn())
+                {
+                    woken = true;
+                    continue;
+                }
+                else if(pollResult.hup() || pollResult.rdHup())
+                    FAIL_LOG("The Curler wakeup socket hung up.")
+                else if(pollResult.err())
+                    FAIL_LOG("Error in the Curler wakeup socket.")
             }
-            else if(pollResult.hup() || pollResult.rdHup())
-                FAIL_LOG("The Curler wakeup socket hung up.")
-            else if(pollResult.err())
-                FAIL_LOG("Error in the Curler wakeup socket.")
+
+            curl_multi_socket_action(
+                    multiHandle,
+                    pollResult.socket(),
+                    0,
+                    &handles);
         }
 
-        curl_multi_socket_action(
-                multiHandle,
-                pollResult.socket(),
-                0,
-                &handles);
         int messages = 1;
         while(messages)
         {
@@ -105,6 +117,14 @@ void Fastcgipp::Curler::handler()
         }
 
         lock.lock();
+        if(woken)
+        {
+            char x[256];
+            if(read(m_wakeSockets[1], x, 256)<1)
+                FAIL_LOG("Unable to read out of Curler wakeup socket: " << \
+                        std::strerror(errno))
+            m_waking=false;
+        }
     }
 }
 int Fastcgipp::Curler::socketCallback(
@@ -81,6 +81,7 @@ namespace Fastcgipp
                 record.size()-header.contentLength-sizeof(Protocol::Header);
 
             send(m_id.m_socket, std::move(record));
+            m_sent = true;
         }
 
         this->setp(m_buffer, m_buffer+s_buffSize);
@@ -120,6 +121,7 @@ namespace Fastcgipp
                 record.size()-header.contentLength-sizeof(Protocol::Header);
 
             send(m_id.m_socket, std::move(record));
+            m_sent = true;
         }
 
         this->setp(m_buffer, m_buffer+s_buffSize);
@@ -158,6 +160,7 @@ void Fastcgipp::FcgiStreambuf<charT, traits>::dump(
             record.size()-header.contentLength-sizeof(Protocol::Header);
 
         send(m_id.m_socket, std::move(record));
+        m_sent = true;
     }
 }
 template <class charT, class traits>
@@ -191,6 +194,7 @@ void Fastcgipp::FcgiStreambuf<charT, traits>::dump2(
             record.size()-header.contentLength-sizeof(Protocol::Header);
 
         send2(m_id.m_socket, std::move(record));
+        m_sent = true;
     }
 }
 
@@ -223,8 +227,53 @@ void Fastcgipp::FcgiStreambuf<charT, traits>::dump(
             record.size()-header.contentLength-sizeof(Protocol::Header);
 
         send(m_id.m_socket, std::move(record));
+        m_sent = true;
     }
 }
 
+template <class charT, class traits>
+bool Fastcgipp::FcgiStreambuf<charT, traits>::dumpFile(
+        int fd,
+        uint64_t offset,
+        size_t size)
+{
+    const std::shared_ptr<const File> file(new File(fd));
+    if(!file->valid())
+        return false;
+
+    emptyBuffer();
+
+    while(size != 0)
+    {
+        // Each record goes out whole with its own padding
+        Block record(sizeof(Protocol::Header));
+
+        Protocol::Header& header
+            = *reinterpret_cast<Protocol::Header*>(record.begin());
+        header.contentLength = std::min(size, static_cast<size_t>(0xffffU));
+
+        header.version = Protocol::version;
+        header.type = m_type;
+        header.fcgiId = m_id.m_id;
+        header.paddingLength = Protocol::getRecordSize(header.contentLength)
+            -header.contentLength-sizeof(Protocol::Header);
+
+        const size_t contentLength = header.contentLength;
+        const size_t padding = header.paddingLength;
+        sendFile(
+                m_id.m_socket,
+                std::move(record),
+                file,
+                offset,
+                contentLength,
+                padding);
+        m_sent = true;
+
+        size -= contentLength;
+        offset += contentLength;
+    }
+    return true;
+}
+
 template class Fastcgipp::FcgiStreambuf<wchar_t, std::char_traits<wchar_t>>;
 template class Fastcgipp::FcgiStreambuf<char, std::char_traits<char>>;
@@ -438,6 +438,40 @@ void Fastcgipp::Http::Environment<charT>::fillPostBuffer(
     m_postBuffer.insert(m_postBuffer.end(), start, end);
 }
 
+template<class charT>
+void Fastcgipp::Http::Environment<charT>::clear()
+{
+    host.clear();
+    origin.clear();
+    userAgent.clear();
+    acceptContentTypes.clear();
+    acceptLanguages.clear();
+    acceptCharsets.clear();
+    authorization.clear();
+    referer.clear();
+    contentType.clear();
+    root.clear();
+    scriptName.clear();
+    requestMethod = RequestMethod::ERR;
+    requestUri.clear();
+    pathInfo.clear();
+    etag = 0;
+    keepAlive = 0;
+    contentLength = 0;
+    serverAddress.zero();
+    remoteAddress.zero();
+    serverPort = 0;
+    remotePort = 0;
+    ifModifiedSince = 0;
+    others.clear();
+    cookies.clear();
+    gets.clear();
+    posts.clear();
+    files.clear();
+    boundary.clear();
+    m_postBuffer.clear();
+}
+
 template<class charT>
 bool Fastcgipp::Http::Environment<charT>::parsePostBuffer()
 {
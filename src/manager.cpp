@@ -28,6 +28,17 @@
 
 #include "fastcgi++/log.hpp"
 #include "fastcgi++/manager.hpp"
+#include "fastcgi++/affinity.hpp"
+
+#if ! defined(FASTCGIPP_WINDOWS)
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdio>
+#endif
 
 Fastcgipp::Manager_base* Fastcgipp::Manager_base::instance=nullptr;
 
@@ -37,9 +48,15 @@ Fastcgipp::Manager_base::Manager_base(unsigned threads):
 				this,
 				std::placeholders::_1,
 				std::placeholders::_2)),
+	m_requestsSize(0),
 	m_terminate(true),
 	m_stop(true),
-	m_threads(threads<=2?threads:threads-2)//
+	m_threads(threads<=2?threads:threads-2),//
+	m_perCore(false)
+#if ! defined(FASTCGIPP_WINDOWS)
+	,m_takeOver(-1),
+	m_handOver(-1)
+#endif
 #if FASTCGIPP_LOG_LEVEL > 3
 	,m_requestCount(0),
 	m_maxRequests(0),
@@ -54,38 +71,68 @@ Fastcgipp::Manager_base::Manager_base(unsigned threads):
 	if(instance != nullptr)
 		FAIL_LOG("You're not allowed to have multiple manager instances")
 	instance = this;
+	for(auto& page: m_requests)
+		page.store(nullptr);
+	m_scheduler.workers(m_threads.size());
+#if ! defined(FASTCGIPP_WINDOWS)
+	m_handOverWake[0] = m_handOverWake[1] = -1;
+#endif
 	DIAG_LOG("Manager_base::Manager_base(): Initialized")
 }
 
 void Fastcgipp::Manager_base::terminate()
 {
-	std::lock_guard<std::mutex> lock(m_tasksMutex);
+	std::lock_guard<std::mutex> lock(m_startStopMutex);
 	m_terminate=true;
 	m_transceiver.terminate();
-	m_wake.notify_all();
+	m_scheduler.wake();
+#if ! defined(FASTCGIPP_WINDOWS)
+	if(m_handOver != -1)
+		shutdown(m_handOverWake[0]);
+#endif
 }
 
 void Fastcgipp::Manager_base::stop()
 {
-	std::lock_guard<std::mutex> lock(m_tasksMutex);
+	std::lock_guard<std::mutex> lock(m_startStopMutex);
 	m_stop=true;
 	m_transceiver.stop();
-	m_wake.notify_all();
+	m_scheduler.wake();
+#if ! defined(FASTCGIPP_WINDOWS)
+	if(m_handOver != -1)
+		shutdown(m_handOverWake[0]);
+#endif
 }
 
 void Fastcgipp::Manager_base::start()
 {
-	std::lock_guard<std::mutex> lock(m_tasksMutex);
+	std::lock_guard<std::mutex> lock(m_startStopMutex);
 	DIAG_LOG("Starting fastcgi++ manager")
 	m_stop=false;
 	m_terminate=false;
 	m_transceiver.start();
-	for(auto& thread: m_threads)
-		if(!thread.joinable())
+	for(unsigned index=0; index<m_threads.size(); ++index)
+		if(!m_threads[index].joinable())
 		{
-			std::thread newThread(&Fastcgipp::Manager_base::handler, this);
-			thread.swap(newThread);
+			std::thread newThread(
+					&Fastcgipp::Manager_base::handler,
+					this,
+					index);
+			m_threads[index].swap(newThread);
 		}
+
+#if ! defined(FASTCGIPP_WINDOWS)
+	// We're accepting now so the process we took over from can stop
+	if(m_takeOver != -1)
+	{
+		const char ready=1;
+		if(::send(m_takeOver, &ready, 1, MSG_NOSIGNAL) != 1)
+			ERR_LOG("Unable to tell the process we took over from that we " \
+					"have started: " << std::strerror(errno))
+		closesocket(m_takeOver);
+		m_takeOver=-1;
+	}
+#endif
 }
 
 void Fastcgipp::Manager_base::join()
@@ -94,9 +141,166 @@ void Fastcgipp::Manager_base::join()
 		if(thread.joinable())
 			thread.join();
 	m_transceiver.join();
+#if ! defined(FASTCGIPP_WINDOWS)
+	if(m_handOverThread.joinable())
+		m_handOverThread.join();
+#endif
 }
 
 #if ! defined(FASTCGIPP_WINDOWS)
+bool Fastcgipp::Manager_base::takeOver(const char* name)
+{
+	sockaddr_un address;
+	if(std::strlen(name) >= sizeof(address.sun_path))
+	{
+		ERR_LOG("Upgrade socket name \"" << name << "\" is too long")
+		return false;
+	}
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	std::strncpy(address.sun_path, name, sizeof(address.sun_path)-1);
+
+	const socket_t channel = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if(channel == -1)
+	{
+		ERR_LOG("Unable to create upgrade socket: " << std::strerror(errno))
+		return false;
+	}
+	if(::connect(
+				channel,
+				reinterpret_cast<sockaddr*>(&address),
+				sizeof(address)) == -1)
+	{
+		DIAG_LOG("No process to take over from at \"" << name << "\": " \
+				<< std::strerror(errno))
+		closesocket(channel);
+		return false;
+	}
+	if(!m_transceiver.adoptListeners(channel))
+	{
+		ERR_LOG("Unable to take over listen sockets from \"" << name << '"')
+		closesocket(channel);
+		return false;
+	}
+
+	DIAG_LOG("Took over listen sockets from \"" << name << '"')
+	if(m_takeOver != -1)
+		closesocket(m_takeOver);
+	m_takeOver = channel;
+	return true;
+}
+
+bool Fastcgipp::Manager_base::handOver(const char* name)
+{
+	if(m_handOver != -1)
+	{
+		ERR_LOG("Already handing over at \"" << m_handOverName.c_str() << '"')
+		return false;
+	}
+
+	sockaddr_un address;
+	if(std::strlen(name) >= sizeof(address.sun_path))
+	{
+		ERR_LOG("Upgrade socket name \"" << name << "\" is too long")
+		return false;
+	}
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	std::strncpy(address.sun_path, name, sizeof(address.sun_path)-1);
+
+	const socket_t fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd == -1)
+	{
+		ERR_LOG("Unable to create upgrade socket: " << std::strerror(errno))
+		return false;
+	}
+
+	// The process we took over from may still be bound to the name
+	std::remove(name);
+	if(::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address))<0)
+	{
+		ERR_LOG("Unable to bind to upgrade socket \"" << name << "\": " \
+				<< std::strerror(errno))
+		closesocket(fd);
+		return false;
+	}
+
+	// Whoever connects gets our listen sockets and shuts us down
+	if(::chmod(name, S_IRUSR | S_IWUSR) < 0
+			|| ::listen(fd, 1) < 0
+			|| ::socketpair(AF_UNIX, SOCK_STREAM, 0, m_handOverWake) < 0)
+	{
+		ERR_LOG("Unable to listen on upgrade socket \"" << name << "\": " \
+				<< std::strerror(errno))
+		closesocket(fd);
+		std::remove(name);
+		return false;
+	}
+
+	m_handOver = fd;
+	m_handOverName = name;
+	std::thread thread(&Fastcgipp::Manager_base::handOverHandler, this);
+	m_handOverThread.swap(thread);
+	return true;
+}
+
+void Fastcgipp::Manager_base::handOverHandler()
+{
+	// Wait for a socket to be readable or for us to be stopped
+	const auto wait = [this] (socket_t socket) -> bool
+	{
+		pollfd fds[2];
+		fds[0].fd = socket;
+		fds[0].events = POLLIN;
+		fds[1].fd = m_handOverWake[1];
+		fds[1].events = POLLIN;
+		while(true)
+		{
+			fds[0].revents = fds[1].revents = 0;
+			if(::poll(fds, 2, -1) < 0)
+			{
+				if(errno == EINTR)
+					continue;
+				ERR_LOG("Unable to poll upgrade socket: " \
+						<< std::strerror(errno))
+				return false;
+			}
+			return fds[1].revents == 0;
+		}
+	};
+
+	bool handedOver = false;
+	while(!handedOver && wait(m_handOver))
+	{
+		const socket_t channel = ::accept(m_handOver, nullptr, nullptr);
+		if(channel == -1)
+			continue;
+
+		DIAG_LOG("Handing our listen sockets over to a new process")
+		char ready=0;
+		if(m_transceiver.sendListeners(channel)
+				&& wait(channel)
+				&& ::recv(channel, &ready, 1, 0) == 1)
+		{
+			m_transceiver.releaseListeners();
+			handedOver = true;
+		}
+		else
+			WARNING_LOG("The new process didn't start so we carry on " \
+					"accepting")
+		closesocket(channel);
+	}
+
+	if(handedOver)
+	{
+		// The name belongs to the new process now
+		DIAG_LOG("Listen sockets handed over. Stopping fastcgi++ manager.")
+		stop();
+	}
+	else
+		std::remove(m_handOverName.c_str());
+}
+
 #include <signal.h>
 void Fastcgipp::Manager_base::setupSignals()
 {
@@ -147,7 +351,7 @@ void Fastcgipp::Manager_base::setupSignals()
 void Fastcgipp::Manager_base::localHandler()
 {
 	Message message;
-	Socket socket;
+	SocketId socket;
 	{
 		std::lock_guard<std::mutex> lock(m_messagesMutex);
 		message = std::move(m_messages.front().first);
@@ -166,63 +370,38 @@ void Fastcgipp::Manager_base::localHandler()
 				const char* name;
 				const char* value;
 				const char* end;
+				std::vector<std::pair<std::string, std::string>> values;
+				const unsigned maxConnections = m_transceiver.maxConnections();
+				const unsigned maxRequests = m_transceiver.maxRequests();
 
+				const char* data = message.data.begin()+sizeof(header);
+				const char* const dataEnd = data+header.contentLength;
 				while(Protocol::processParamHeader(
-						message.data.begin()+sizeof(header),
-						message.data.end(),
+						data,
+						dataEnd,
 						name,
 						value,
 						end))
 				{
-					switch(value-name)
-					{
-						case 14:
-						{
-							if(std::equal(name, value, "FCGI_MAX_CONNS"))
-							{
-								Block record(
-										reinterpret_cast<const char*>(
-											&Protocol::maxConnsReply),
-										sizeof(Protocol::maxConnsReply));
-								m_transceiver.send(
-										socket,
-										std::move(record),
-										false);
-							}
-							break;
-						}
-						case 13:
-						{
-							if(std::equal(name, value, "FCGI_MAX_REQS"))
-							{
-								Block record(
-										reinterpret_cast<const char*>(
-											&Protocol::maxReqsReply),
-										sizeof(Protocol::maxReqsReply));
-								m_transceiver.send(
-										socket,
-										std::move(record),
-										false);
-							}
-							break;
-						}
-						case 15:
-						{
-							if(std::equal(name, value, "FCGI_MPXS_CONNS"))
-							{
-								Block record(
-										reinterpret_cast<const char*>(
-											&Protocol::mpxsConnsReply),
-										sizeof(Protocol::mpxsConnsReply));
-								m_transceiver.send(
-										socket,
-										std::move(record),
-										false);
-							}
-							break;
-						}
-					}
+					// Limits of zero aren't limits so there's nothing to report
+					const std::string variable(name, value);
+					if(variable == "FCGI_MAX_CONNS" && maxConnections != 0)
+						values.emplace_back(
+								variable,
+								std::to_string(maxConnections));
+					else if(variable == "FCGI_MAX_REQS" && maxRequests != 0)
+						values.emplace_back(
+								variable,
+								std::to_string(maxRequests));
+					else if(variable == "FCGI_MPXS_CONNS")
+						values.emplace_back(variable, "1");
+					data = end;
 				}
+
+				m_transceiver.send(
+						socket,
+						Protocol::valuesResult(values),
+						false);
 				break;
 			}
 
@@ -255,86 +434,106 @@ void Fastcgipp::Manager_base::localHandler()
 		ERR_LOG("Got a non-FastCGI record destined for the manager")
 }
 
-void Fastcgipp::Manager_base::handler()
+void Fastcgipp::Manager_base::handler(unsigned thread)
 {
-	std::unique_lock<std::shared_timed_mutex> requestsWriteLock(
-			m_requestsMutex,
-			std::defer_lock);
-	std::unique_lock<std::mutex> tasksLock(m_tasksMutex);
-	std::shared_lock<std::shared_timed_mutex> requestsReadLock(m_requestsMutex);
+	if(!m_workerCpus.empty())
+	{
+		if(m_perCore)
+			pinThread({m_workerCpus[thread%m_workerCpus.size()]});
+		else
+			pinThread(m_workerCpus);
+	}
 
-	while(!m_terminate && !(m_stop && m_requests.empty()))
+	Protocol::RequestId id;
+
+	while(true)
 	{
-		requestsReadLock.unlock();
-		while(!m_tasks.empty())
+		while(m_scheduler.pop(thread, id))
 		{
-			auto id = m_tasks.front();
-			m_tasks.pop();
-			tasksLock.unlock();
-
 			if(id.m_id == 0)
 				localHandler();
 			else
 			{
-				requestsReadLock.lock();
-				auto request = m_requests.find(id);
-				if(request != m_requests.end())
+				Requests* const requests = this->requests(id.m_socket);
+				if(requests == nullptr)
+					continue;
+
+				std::unique_lock<std::mutex> requestsLock(requests->mutex);
+				const auto owner = find(*requests, id);
+				if(owner == nullptr)
+					continue;
+				Request_base& request = **owner;
+
+				// With affinity we are the only thread that ever handles or
+				// erases the request
+				std::unique_lock<std::mutex> requestLock;
+				if(!m_scheduler.affinity())
 				{
-					std::unique_lock<std::mutex> requestLock(
-							request->second->mutex,
+					requestLock = std::unique_lock<std::mutex>(
+							request.mutex,
 							std::try_to_lock);
-					requestsReadLock.unlock();
+					if(!requestLock)
+						continue;
+				}
+				requestsLock.unlock();
 
-					if(requestLock)
-					{
-						auto lock = request->second->handler();
-						if(!lock || !id.m_socket.valid())
-						{
+				auto lock = request.handler();
+				if(!lock || !id.m_socket.valid())
+				{
 #if FASTCGIPP_LOG_LEVEL > 3
-							if(!id.m_socket.valid())
-								++m_badSocketKillCount;
+					if(!id.m_socket.valid())
+						++m_badSocketKillCount;
 #endif
-							if(lock)
-								lock.unlock();
-							requestsWriteLock.lock();
-							requestLock.unlock();
-							m_requests.erase(request);
-							requestsWriteLock.unlock();
-						}
-						else
-						{
-							requestLock.unlock();
-							lock.unlock();
-						}
-					}
+					if(lock)
+						lock.unlock();
+					requestsLock.lock();
+					if(requestLock)
+						requestLock.unlock();
+					auto finished = erase(*requests, id);
+					requestsLock.unlock();
+					m_transceiver.requestEnded();
+					recycle(std::move(finished));
 				}
 				else
-					requestsReadLock.unlock();
+				{
+					if(requestLock)
+						requestLock.unlock();
+					lock.unlock();
+				}
 			}
-			tasksLock.lock();
+			if(m_terminate)
+				break;
 		}
 
-		requestsReadLock.lock();
-		if(m_terminate || (m_stop && m_requests.empty()))
+		// Taken first so a wake() after the checks below isn't missed
+		const unsigned generation = m_scheduler.generation();
+		if(m_terminate || (m_stop && m_requestsSize == 0))
+		{
+			// We may have completed the last request of a stop() so the
+			// others won't be woken up by anything else
+			m_scheduler.release(thread);
+			m_scheduler.wake();
 			break;
-		requestsReadLock.unlock();
+		}
 #if FASTCGIPP_LOG_LEVEL > 3
 		--m_activeThreads;
 #endif
-		m_wake.wait(tasksLock);
+		m_scheduler.idle(thread, generation);
 #if FASTCGIPP_LOG_LEVEL > 3
 		if(!m_stop && !m_terminate)
 		{
-			++m_activeThreads;
-			m_maxActiveThreads = std::max(m_activeThreads, m_maxActiveThreads);
+			const unsigned active = ++m_activeThreads;
+			unsigned max = m_maxActiveThreads;
+			while(active > max
+					&& !m_maxActiveThreads.compare_exchange_weak(max, active));
 		}
 #endif
-		requestsReadLock.lock();
 	}
 }
 
 void Fastcgipp::Manager_base::push(Protocol::RequestId id, Message&& message)
 {
+	unsigned priority = 0;
 	if(id.m_id == 0)
 	{
 #if FASTCGIPP_LOG_LEVEL > 3
@@ -348,25 +547,68 @@ void Fastcgipp::Manager_base::push(Protocol::RequestId id, Message&& message)
 #if FASTCGIPP_LOG_LEVEL > 3
 		++m_badSocketMessageCount;
 #endif
-		std::lock_guard<std::shared_timed_mutex> lock(m_requestsMutex);
-		const auto range = m_requests.equal_range(id.m_socket);
-		auto request = range.first;
-		while(request != range.second)
+		Requests* const requests = this->requests(id.m_socket);
+		if(requests == nullptr)
+			return;
+
+		std::unique_lock<std::mutex> lock(requests->mutex);
+		if(m_scheduler.affinity())
 		{
+			// Only the request's own thread may erase it so we have it notice
+			// the dead socket instead
+			if(requests->generation == id.m_socket.generation())
+				for(unsigned fcgiId=0;
+						fcgiId<requests->requests.size();
+						++fcgiId)
+					if(requests->requests[fcgiId])
+						m_scheduler.push(
+								Protocol::RequestId(fcgiId, id.m_socket),
+								requests->requests[fcgiId]->priority);
+			for(const auto& orphan: requests->orphans)
+				if(orphan.first.m_socket == id.m_socket)
+					m_scheduler.push(orphan.first, orphan.second->priority);
+			return;
+		}
+
+		std::vector<std::unique_ptr<Request_base>> killed;
+		const auto kill = [&] (std::unique_ptr<Request_base>& request)
+		{
+			if(!request)
+				return;
 			std::unique_lock<std::mutex> lock(
-					request->second->mutex,
+					request->mutex,
 					std::try_to_lock);
 			if(lock)
 			{
 				lock.unlock();
-				request = m_requests.erase(request);
+				killed.push_back(std::move(request));
+				--m_requestsSize;
+				m_transceiver.requestEnded();
 #if FASTCGIPP_LOG_LEVEL > 3
 				++m_badSocketKillCount;
 #endif
 			}
-			else
-				++request;
-		}
+		};
+		if(requests->generation == id.m_socket.generation())
+			for(auto& request: requests->requests)
+				kill(request);
+		for(auto& orphan: requests->orphans)
+			if(orphan.first.m_socket == id.m_socket)
+				kill(orphan.second);
+		requests->orphans.erase(
+				std::remove_if(
+					requests->orphans.begin(),
+					requests->orphans.end(),
+					[] (const std::pair<
+						Protocol::RequestId,
+						std::unique_ptr<Request_base>>& orphan)
+					{
+						return !orphan.second;
+					}),
+				requests->orphans.end());
+		lock.unlock();
+		for(auto& request: killed)
+			recycle(std::move(request));
 		return;
 	}
 	else
@@ -374,53 +616,164 @@ void Fastcgipp::Manager_base::push(Protocol::RequestId id, Message&& message)
 #if FASTCGIPP_LOG_LEVEL > 3
 		++m_messageCount;
 #endif
-		std::unique_lock<std::shared_timed_mutex> lock(m_requestsMutex);
-		auto request = m_requests.find(id);
-		if(request == m_requests.end())
+		// Every BEGIN_REQUEST the transceiver passed on has to be accounted
+		// for whether or not a request comes of it
+		const bool begin = message.type == 0
+			&& reinterpret_cast<Protocol::Header*>(message.data.begin())->type
+				== Protocol::RecordType::BEGIN_REQUEST;
+
+		Requests* const requests = this->requests(id.m_socket);
+		if(requests == nullptr)
+		{
+			if(begin)
+			{
+				WARNING_LOG("Dropping a BEGIN_REQUEST record for an " \
+						"unsupported socket " << id.m_socket.socket())
+				m_transceiver.requestEnded();
+			}
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock(requests->mutex);
+		if(requests->generation != id.m_socket.generation()
+				&& Socket::newer(
+					id.m_socket.generation(),
+					requests->generation))
 		{
-			if(message.type == 0)
+			// A new connection is using the socket so whatever is still
+			// running from the old one moves out of its way
+			for(unsigned fcgiId=0; fcgiId<requests->requests.size(); ++fcgiId)
+				if(requests->requests[fcgiId])
+					requests->orphans.emplace_back(
+							Protocol::RequestId(
+								fcgiId,
+								SocketId(
+									id.m_socket.socket(),
+									requests->generation)),
+							std::move(requests->requests[fcgiId]));
+			requests->requests.clear();
+			requests->generation = id.m_socket.generation();
+		}
+
+		auto request = find(*requests, id);
+		if(request == nullptr)
+		{
+			if(begin)
 			{
-				const Protocol::Header& header=
-					*reinterpret_cast<Protocol::Header*>(message.data.begin());
-				if(header.type == Protocol::RecordType::BEGIN_REQUEST)
+				if(requests->generation == id.m_socket.generation())
 				{
 					const Protocol::BeginRequest& body
 						= *reinterpret_cast<Protocol::BeginRequest*>(
 								message.data.begin()
-								+sizeof(header));
-
-					request = m_requests.emplace(
-							std::piecewise_construct,
-							std::forward_as_tuple(id),
-							std::forward_as_tuple()).first;
-					bool bKill = body.kill();
-					if (bKill)
-					{
-						int onkill = 1;
-						++onkill;
-					}
-					request->second = makeRequest(
+								+sizeof(Protocol::Header));
+
+					if(requests->requests.size() <= id.m_id)
+						requests->requests.resize(id.m_id+1);
+					requests->requests[id.m_id] = makeRequest(
 							id,
 							body.role,
 							body.kill());
+					++m_requestsSize;
 					lock.unlock();
 #if FASTCGIPP_LOG_LEVEL > 3
 					++m_requestCount;
-					m_maxRequests = std::max(m_maxRequests, m_requests.size());
+					const size_t size = m_requestsSize;
+					size_t max = m_maxRequests;
+					while(size > max
+							&& !m_maxRequests.compare_exchange_weak(max, size));
 #endif
 				}
 				else
-					WARNING_LOG("Got a non BEGIN_REQUEST record for a request"\
-							" that doesn't exist")
+				{
+					lock.unlock();
+					WARNING_LOG("Dropping a BEGIN_REQUEST record from a "\
+							"connection that has since been replaced")
+					m_transceiver.requestEnded();
+				}
 			}
+			else if(message.type == 0)
+				WARNING_LOG("Got a non BEGIN_REQUEST record for a request"\
+						" that doesn't exist")
 			return;
 		}
 		else
-			request->second->push(std::move(message));
+		{
+			// A request has already been made for this one
+			if(begin)
+				m_transceiver.requestEnded();
+			(*request)->push(std::move(message));
+			priority = (*request)->priority;
+		}
 	}
-	std::lock_guard<std::mutex> lock(m_tasksMutex);
-	m_tasks.push(id);
-	m_wake.notify_one();
+	m_scheduler.push(id, priority);
+}
+
+Fastcgipp::Manager_base::Requests* Fastcgipp::Manager_base::requests(
+		const SocketId& socket)
+{
+	const size_t index = static_cast<size_t>(socket.socket());
+	const size_t page = index/s_requestsPage;
+	if(page >= s_requestsPages)
+		return nullptr;
+
+	Requests* requests = m_requests[page].load(std::memory_order_acquire);
+	if(requests == nullptr)
+	{
+		Requests* const fresh = new Requests[s_requestsPage];
+		if(m_requests[page].compare_exchange_strong(
+					requests,
+					fresh,
+					std::memory_order_acq_rel))
+			requests = fresh;
+		else
+			delete[] fresh;
+	}
+	return requests + index%s_requestsPage;
+}
+
+std::unique_ptr<Fastcgipp::Request_base>* Fastcgipp::Manager_base::find(
+		Requests& requests,
+		const Protocol::RequestId& id)
+{
+	if(requests.generation == id.m_socket.generation())
+	{
+		if(id.m_id < requests.requests.size() && requests.requests[id.m_id])
+			return &requests.requests[id.m_id];
+		return nullptr;
+	}
+
+	for(auto& orphan: requests.orphans)
+		if(orphan.first.m_socket == id.m_socket
+				&& orphan.first.m_id == id.m_id)
+			return &orphan.second;
+	return nullptr;
+}
+
+std::unique_ptr<Fastcgipp::Request_base> Fastcgipp::Manager_base::erase(
+		Requests& requests,
+		const Protocol::RequestId& id)
+{
+	std::unique_ptr<Request_base> request;
+	if(requests.generation == id.m_socket.generation())
+	{
+		if(id.m_id < requests.requests.size())
+			request = std::move(requests.requests[id.m_id]);
+	}
+	else
+		for(auto orphan=requests.orphans.begin();
+				orphan!=requests.orphans.end();
+				++orphan)
+			if(orphan->first.m_socket == id.m_socket
+					&& orphan->first.m_id == id.m_id)
+			{
+				request = std::move(orphan->second);
+				requests.orphans.erase(orphan);
+				break;
+			}
+
+	if(request)
+		--m_requestsSize;
+	return request;
 }
 
 void Fastcgipp::Manager_base::resizeThreads(unsigned threads)
@@ -428,16 +781,48 @@ void Fastcgipp::Manager_base::resizeThreads(unsigned threads)
 	if(m_stop)
 	{
 		m_threads.resize(threads);
+		m_scheduler.workers(threads);
 #if FASTCGIPP_LOG_LEVEL > 3
 		m_activeThreads = threads;
 #endif
 	}
 }
 
+void Fastcgipp::Manager_base::workerCpus(
+		const std::vector<unsigned>& cpus,
+		bool perCore)
+{
+	if(!m_stop)
+		return;
+
+	m_perCore = perCore;
+	m_workerCpus = cpus;
+	if(m_workerCpus.empty() && m_perCore)
+	{
+		// Keep off the cores the reactors have to themselves
+		const auto& reactorCpus = m_transceiver.reactorCpus();
+		for(const auto cpu: allowedCpus())
+			if(std::find(reactorCpus.cbegin(), reactorCpus.cend(), cpu)
+					== reactorCpus.cend())
+				m_workerCpus.push_back(cpu);
+		if(m_workerCpus.empty())
+			WARNING_LOG("No CPUs left for request handling threads after "\
+					"the reactors")
+	}
+}
+
 Fastcgipp::Manager_base::~Manager_base()
 {
 	instance=nullptr;
 	terminate();
+#if ! defined(FASTCGIPP_WINDOWS)
+	if(m_handOverThread.joinable())
+		m_handOverThread.join();
+	for(const auto socket:
+			{m_takeOver, m_handOver, m_handOverWake[0], m_handOverWake[1]})
+		if(socket != -1)
+			closesocket(socket);
+#endif
 	DIAG_LOG("Manager_base::~Manager_base(): New requests ============== " \
 			<< m_requestCount)
 	DIAG_LOG("Manager_base::~Manager_base(): Max concurrent requests === " \
@@ -453,9 +838,11 @@ Fastcgipp::Manager_base::~Manager_base()
 	DIAG_LOG("Manager_base::~Manager_base(): Maximum active threads ==== " \
 			<< m_maxActiveThreads)
 	DIAG_LOG("Manager_base::~Manager_base(): Remaining requests ======== " \
-			<< m_requests.size())
+			<< m_requestsSize)
 	DIAG_LOG("Manager_base::~Manager_base(): Remaining tasks =========== " \
-			<< m_tasks.size())
+			<< m_scheduler.size())
 	DIAG_LOG("Manager_base::~Manager_base(): Remaining local messages == " \
 			<< m_messages.size())
+	for(auto& page: m_requests)
+		delete[] page.load();
 }
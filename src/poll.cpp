@@ -37,6 +37,15 @@
 #else
 #ifdef FASTCGIPP_LINUX
 #include <sys/epoll.h>
+#ifdef FASTCGIPP_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+#endif
 #elif defined FASTCGIPP_UNIX
 #include <algorithm>
 #endif
@@ -50,17 +59,20 @@
 extern int getLastSocketError();
 #ifdef FASTCGIPP_LINUX
 const unsigned Fastcgipp::Poll::Result::pollIn = EPOLLIN;
+const unsigned Fastcgipp::Poll::Result::pollOut = EPOLLOUT;
 const unsigned Fastcgipp::Poll::Result::pollErr = EPOLLERR;
 const unsigned Fastcgipp::Poll::Result::pollHup = EPOLLHUP;
 //const unsigned Fastcgipp::Poll::Result::pollRdHup = EPOLLRDHUP;
 const unsigned Fastcgipp::Poll::Result::pollRdHup = EPOLLHUP;
 #elif defined FASTCGIPP_UNIX
 const unsigned Fastcgipp::Poll::Result::pollIn = POLLIN;
+const unsigned Fastcgipp::Poll::Result::pollOut = POLLOUT;
 const unsigned Fastcgipp::Poll::Result::pollErr = POLLERR;
 const unsigned Fastcgipp::Poll::Result::pollHup = POLLHUP;
 const unsigned Fastcgipp::Poll::Result::pollRdHup = POLLRDHUP;
 #elif defined FASTCGIPP_WINDOWS
 const unsigned Fastcgipp::Poll::Result::pollIn = POLLRDNORM;
+const unsigned Fastcgipp::Poll::Result::pollOut = POLLWRNORM;
 const unsigned Fastcgipp::Poll::Result::pollErr = POLLERR;
 const unsigned Fastcgipp::Poll::Result::pollHup = POLLHUP;
 #endif
@@ -148,29 +160,937 @@ void Fastcgipp::set_reuse(socket_t sock)
 	WARNING_LOG("SocketGroup::set_reuse_address(true) not implemented");
 #endif
 }
+void Fastcgipp::set_reuseport(socket_t sock)
+{
+#if defined(SO_REUSEPORT)
+	int x = 1;
+	if (::setsockopt(
+		sock,
+		SOL_SOCKET,
+		SO_REUSEPORT,
+		&x,
+		sizeof(int)) != 0)
+		WARNING_LOG("Socket setsockopt(SO_REUSEPORT, 1) error on fd " \
+			<< sock << ": " << strerror(getLastSocketError()))
+#else
+	WARNING_LOG("SocketGroup::reusePort(true) not implemented");
+#endif
+}
+#ifdef FASTCGIPP_IO_URING
+//! A minimal io_uring for our sockets
+/*!
+ * Sockets go in the ring in one of three ways.
+ *
+ *  - Listen sockets passed to accept() have a multishot IORING_OP_ACCEPT
+ *    armed. Every connection it accepts is reported as a result for the
+ *    listener.
+ *  - Connections passed to receive() have a multishot IORING_OP_RECV armed
+ *    that takes its buffers out of a ring we provide. Whatever it receives is
+ *    queued with the socket until read() copies it out and hands the buffers
+ *    back. The socket is reported readable for as long as anything is queued
+ *    so reading it once per report never strands data. A one-shot poll
+ *    watches for errors, zero copy completions and, when asked for, write
+ *    readiness.
+ *  - Anything else, like the SocketGroup wakeup socket, has a one-shot
+ *    IORING_OP_POLL_ADD armed. A poll is checked when it is armed so this
+ *    gives the same level-triggered behaviour as our epoll usage.
+ *
+ * Polls handed out by poll() and multishots the kernel has stopped are armed
+ * again at the start of the next poll(). They go to the kernel in the same
+ * io_uring_enter() that waits for completions. The user data of each request
+ * holds the socket in the low 32 bits, a generation in the next 30 and the
+ * kind of request in the top two. That way completions of cancelled requests
+ * are recognized and dropped. A user data of zero marks our own
+ * cancellations.
+ *
+ * Poll::send() uses a ring of its own without any buffers.
+ */
+struct Fastcgipp::Poll::Ring
+{
+	//! Kinds of request we put in the ring
+	enum Request: uint64_t
+	{
+		CANCEL=0,
+		POLL=1,
+		ACCEPT=2,
+		RECV=3
+	};
+
+	//! Data received into one of our buffers but not yet read
+	struct Received
+	{
+		uint16_t buffer;
+		uint32_t offset;
+		uint32_t size;
+	};
+
+	//! State of a single socket
+	struct Entry
+	{
+		//! ACCEPT or RECV if a multishot is used. POLL if only the poll is.
+		Request mode;
+
+		//! Events we're polling for
+		unsigned events;
+
+		//! Generation of the currently armed poll
+		uint32_t generation;
+
+		//! Generation of the current multishot
+		uint32_t stream;
+
+		//! True if a poll is armed in the kernel
+		bool armed;
+
+		//! True if the multishot is armed in the kernel
+		bool streaming;
+
+		//! True if the socket is waiting in readable
+		bool listed;
+
+		//! True once the other side has stopped sending
+		bool ended;
+
+		//! True once receiving has failed
+		bool failed;
+
+		//! Data received in order
+		std::deque<Received> received;
+	};
+
+	//! Number of buffers we provide for receiving
+	static const unsigned bufferCount = 1024;
+
+	//! Size of each buffer we provide for receiving
+	static const unsigned bufferSize = 8192;
+
+	//! Generations only have 30 bits in the user data
+	static const uint32_t generationMask = 0x3fffffffU;
+
+	int fd;
+	io_uring_params params;
+
+	void* sqRing;
+	size_t sqRingSize;
+	void* cqRing;
+	size_t cqRingSize;
+	io_uring_sqe* sqes;
+	size_t sqesSize;
+
+	unsigned* sqHead;
+	unsigned* sqTail;
+	unsigned* sqArray;
+	unsigned sqMask;
+	unsigned* cqHead;
+	unsigned* cqTail;
+	io_uring_cqe* cqes;
+	unsigned cqMask;
+
+	//! Ring we provide receive buffers through
+	io_uring_buf_ring* buffers;
+
+	//! The receive buffers themselves
+	char* data;
+
+	//! Number of buffers the kernel can currently pick from
+	unsigned available;
+
+	//! True if accept() and receive() can be used
+	bool multishot;
+
+	//! Generation to hand out to the next request
+	uint32_t generation;
+
+	//! All sockets in the ring
+	std::map<socket_t, Entry> entries;
+
+	//! Sockets handed out by the last poll() waiting to be re-armed
+	std::vector<socket_t> rearm;
+
+	//! Sockets whose multishot the kernel stopped
+	std::vector<socket_t> restart;
+
+	//! Received sockets waiting to be reported
+	std::deque<socket_t> readable;
+
+	//! Thread safe the submission queue and entries
+	std::mutex mutex;
+
+	Ring():
+		fd(-1),
+		sqRing(MAP_FAILED),
+		cqRing(MAP_FAILED),
+		sqes(static_cast<io_uring_sqe*>(MAP_FAILED)),
+		buffers(static_cast<io_uring_buf_ring*>(MAP_FAILED)),
+		data(static_cast<char*>(MAP_FAILED)),
+		available(0),
+		multishot(false),
+		generation(1)
+	{}
+
+	~Ring()
+	{
+		if(sqes != MAP_FAILED)
+		{
+			// Connections accepted since the last poll() are ours to close
+			unsigned head = *cqHead;
+			const unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+			for(; head != tail; ++head)
+			{
+				const io_uring_cqe& cqe = cqes[head & cqMask];
+				if(cqe.user_data>>62 == ACCEPT && cqe.res >= 0)
+					close(cqe.res);
+			}
+		}
+		if(fd != -1)
+			close(fd);
+		if(data != MAP_FAILED)
+			munmap(data, bufferCount*bufferSize);
+		if(buffers != MAP_FAILED)
+			munmap(buffers, bufferCount*sizeof(io_uring_buf));
+		if(sqes != MAP_FAILED)
+			munmap(sqes, sqesSize);
+		if(cqRing != MAP_FAILED && cqRing != sqRing)
+			munmap(cqRing, cqRingSize);
+		if(sqRing != MAP_FAILED)
+			munmap(sqRing, sqRingSize);
+	}
+
+	//! Set up a ring. Returns nullptr if the kernel can't give us one.
+	static std::unique_ptr<Ring> create(unsigned size)
+	{
+		std::unique_ptr<Ring> ring(new Ring);
+		std::memset(&ring->params, 0, sizeof(ring->params));
+		ring->fd = syscall(__NR_io_uring_setup, size, &ring->params);
+		if(ring->fd < 0)
+		{
+			WARNING_LOG("Unable to set up io_uring, falling back to epoll: " \
+				<< std::strerror(errno))
+			return nullptr;
+		}
+		if(!(ring->params.features & IORING_FEAT_EXT_ARG))
+		{
+			WARNING_LOG("Kernel io_uring lacks IORING_FEAT_EXT_ARG, " \
+				"falling back to epoll")
+			return nullptr;
+		}
+
+		const auto& sq = ring->params.sq_off;
+		const auto& cq = ring->params.cq_off;
+		ring->sqRingSize = sq.array + ring->params.sq_entries*sizeof(unsigned);
+		ring->cqRingSize = cq.cqes
+			+ ring->params.cq_entries*sizeof(io_uring_cqe);
+		const bool single = ring->params.features & IORING_FEAT_SINGLE_MMAP;
+		if(single)
+			ring->sqRingSize = ring->cqRingSize = std::max(
+				ring->sqRingSize,
+				ring->cqRingSize);
+
+		ring->sqRing = mmap(
+			nullptr,
+			ring->sqRingSize,
+			PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE,
+			ring->fd,
+			IORING_OFF_SQ_RING);
+		if(ring->sqRing == MAP_FAILED)
+			return nullptr;
+		if(single)
+			ring->cqRing = ring->sqRing;
+		else
+		{
+			ring->cqRing = mmap(
+				nullptr,
+				ring->cqRingSize,
+				PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE,
+				ring->fd,
+				IORING_OFF_CQ_RING);
+			if(ring->cqRing == MAP_FAILED)
+				return nullptr;
+		}
+		ring->sqesSize = ring->params.sq_entries*sizeof(io_uring_sqe);
+		ring->sqes = static_cast<io_uring_sqe*>(mmap(
+			nullptr,
+			ring->sqesSize,
+			PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE,
+			ring->fd,
+			IORING_OFF_SQES));
+		if(ring->sqes == MAP_FAILED)
+			return nullptr;
+
+		char* const sqBase = static_cast<char*>(ring->sqRing);
+		char* const cqBase = static_cast<char*>(ring->cqRing);
+		ring->sqHead = reinterpret_cast<unsigned*>(sqBase + sq.head);
+		ring->sqTail = reinterpret_cast<unsigned*>(sqBase + sq.tail);
+		ring->sqArray = reinterpret_cast<unsigned*>(sqBase + sq.array);
+		ring->sqMask = *reinterpret_cast<unsigned*>(sqBase + sq.ring_mask);
+		ring->cqHead = reinterpret_cast<unsigned*>(cqBase + cq.head);
+		ring->cqTail = reinterpret_cast<unsigned*>(cqBase + cq.tail);
+		ring->cqes = reinterpret_cast<io_uring_cqe*>(cqBase + cq.cqes);
+		ring->cqMask = *reinterpret_cast<unsigned*>(cqBase + cq.ring_mask);
+
+		DIAG_LOG("Poll::Poll(): Using io_uring with " \
+			<< ring->params.sq_entries << " entries")
+		return ring;
+	}
+
+	//! Provide receive buffers and see if the kernel can fill them
+	/*!
+	 * Buffer rings and multishot accept came with Linux 5.19 and multishot
+	 * recv with 6.0. There is no feature flag for the latter so a recv is
+	 * tried on a socket pair. If any of it is missing we stick to polls.
+	 */
+	void provide()
+	{
+		buffers = static_cast<io_uring_buf_ring*>(mmap(
+			nullptr,
+			bufferCount*sizeof(io_uring_buf),
+			PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS,
+			-1,
+			0));
+		data = static_cast<char*>(mmap(
+			nullptr,
+			bufferCount*bufferSize,
+			PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS,
+			-1,
+			0));
+		if(buffers == MAP_FAILED || data == MAP_FAILED)
+			return;
+
+		io_uring_buf_reg reg;
+		std::memset(&reg, 0, sizeof(reg));
+		reg.ring_addr = reinterpret_cast<uint64_t>(buffers);
+		reg.ring_entries = bufferCount;
+		reg.bgid = 0;
+		if(syscall(
+				__NR_io_uring_register,
+				fd,
+				IORING_REGISTER_PBUF_RING,
+				&reg,
+				1) != 0)
+		{
+			DIAG_LOG("Poll::Poll(): No io_uring buffer rings, polling " \
+				"for readiness: " << std::strerror(errno))
+			return;
+		}
+		for(unsigned buffer=0; buffer<bufferCount; ++buffer)
+			giveBack(buffer);
+
+		int pair[2];
+		if(socketpair(
+				AF_UNIX,
+				SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+				0,
+				pair) != 0)
+			return;
+		const uint64_t probe = userData(RECV, 0, pair[0]);
+		io_uring_sqe& recv = sqe();
+		recv.opcode = IORING_OP_RECV;
+		recv.fd = pair[0];
+		recv.ioprio = IORING_RECV_MULTISHOT;
+		recv.flags = IOSQE_BUFFER_SELECT;
+		recv.buf_group = 0;
+		recv.user_data = probe;
+		static const char x = 0;
+		if(::write(pair[1], &x, 1) == 1)
+		{
+			__kernel_timespec ts;
+			ts.tv_sec = 1;
+			ts.tv_nsec = 0;
+			io_uring_getevents_arg arg;
+			std::memset(&arg, 0, sizeof(arg));
+			arg.ts = reinterpret_cast<uint64_t>(&ts);
+			syscall(
+				__NR_io_uring_enter,
+				fd,
+				pending(),
+				1,
+				IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+				&arg,
+				sizeof(arg));
+			const unsigned head = *cqHead;
+			if(head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+			{
+				const io_uring_cqe& cqe = cqes[head & cqMask];
+				if(cqe.flags & IORING_CQE_F_BUFFER)
+				{
+					--available;
+					giveBack(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+				}
+				multishot = cqe.user_data == probe
+					&& cqe.res == 1
+					&& cqe.flags & IORING_CQE_F_MORE;
+				__atomic_store_n(cqHead, head+1, __ATOMIC_RELEASE);
+			}
+		}
+
+		// Generation zero is never handed out so anything left of the probe
+		// is dropped like any other cancelled request
+		io_uring_sqe& cancel = sqe();
+		cancel.opcode = IORING_OP_ASYNC_CANCEL;
+		cancel.fd = -1;
+		cancel.addr = probe;
+		cancel.user_data = CANCEL;
+		submit();
+		close(pair[0]);
+		close(pair[1]);
+
+		if(multishot)
+			DIAG_LOG("Poll::Poll(): Accepting and receiving with io_uring " \
+				"multishots into " << bufferCount << " buffers")
+		else
+			DIAG_LOG("Poll::Poll(): No io_uring multishot recv, polling " \
+				"for readiness")
+	}
+
+	//! Queued submissions the kernel hasn't seen yet
+	unsigned pending() const
+	{
+		return *sqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+	}
+
+	//! Hand queued submissions to the kernel. Call with mutex locked.
+	void submit()
+	{
+		while(const unsigned count = pending())
+		{
+			const int submitted = syscall(
+				__NR_io_uring_enter,
+				fd,
+				count,
+				0,
+				0,
+				nullptr,
+				0);
+			if(submitted < 0 && errno == EINTR)
+				continue;
+			if(submitted <= 0)
+			{
+				ERR_LOG("Unable to submit to io_uring: " \
+					<< std::strerror(submitted<0 ? errno : EBUSY))
+				break;
+			}
+		}
+	}
+
+	//! Get the next free submission entry. Call with mutex locked.
+	io_uring_sqe& sqe()
+	{
+		unsigned tail = *sqTail;
+		if(tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE)
+				== params.sq_entries)
+			submit();
+		io_uring_sqe& entry = sqes[tail & sqMask];
+		std::memset(&entry, 0, sizeof(entry));
+		sqArray[tail & sqMask] = tail & sqMask;
+		__atomic_store_n(sqTail, tail+1, __ATOMIC_RELEASE);
+		return entry;
+	}
+
+	//! User data identifying a request
+	static uint64_t userData(
+			Request request,
+			uint32_t generation,
+			socket_t socket)
+	{
+		return (static_cast<uint64_t>(request) << 62)
+			| (static_cast<uint64_t>(generation & generationMask) << 32)
+			| static_cast<uint32_t>(socket);
+	}
+
+	//! Hand out a generation for a new request. Call with mutex locked.
+	uint32_t next()
+	{
+		const uint32_t current = generation;
+		generation = (generation+1) & generationMask;
+		if(generation == 0)
+			generation = 1;
+		return current;
+	}
+
+	//! Give a buffer back to the kernel. Call with mutex locked.
+	void giveBack(uint16_t buffer)
+	{
+		const uint16_t tail = buffers->tail;
+		// Not buffers->bufs since __DECLARE_FLEX_ARRAY() misplaces it in C++
+		io_uring_buf& entry = reinterpret_cast<io_uring_buf*>(buffers)[
+			tail & (bufferCount-1)];
+		entry.addr = reinterpret_cast<uint64_t>(
+			data + static_cast<size_t>(buffer)*bufferSize);
+		entry.len = bufferSize;
+		entry.bid = buffer;
+		__atomic_store_n(&buffers->tail, tail+1, __ATOMIC_RELEASE);
+		++available;
+	}
+
+	//! Arm a one-shot poll for a socket. Call with mutex locked.
+	void arm(socket_t socket, Entry& entry)
+	{
+		entry.generation = next();
+		io_uring_sqe& poll = sqe();
+		poll.opcode = IORING_OP_POLL_ADD;
+		poll.fd = socket;
+		poll.poll32_events = entry.events;
+		poll.user_data = userData(POLL, entry.generation, socket);
+		entry.armed = true;
+	}
+
+	//! Cancel the armed poll for a socket. Call with mutex locked.
+	void disarm(socket_t socket, Entry& entry)
+	{
+		if(!entry.armed)
+			return;
+		io_uring_sqe& remove = sqe();
+		remove.opcode = IORING_OP_POLL_REMOVE;
+		remove.fd = -1;
+		remove.addr = userData(POLL, entry.generation, socket);
+		remove.user_data = CANCEL;
+		entry.armed = false;
+	}
+
+	//! Arm the multishot of a socket. Call with mutex locked.
+	void start(socket_t socket, Entry& entry)
+	{
+		entry.stream = next();
+		io_uring_sqe& request = sqe();
+		request.fd = socket;
+		request.user_data = userData(entry.mode, entry.stream, socket);
+		if(entry.mode == ACCEPT)
+		{
+			request.opcode = IORING_OP_ACCEPT;
+			request.ioprio = IORING_ACCEPT_MULTISHOT;
+			request.accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+		}
+		else
+		{
+			request.opcode = IORING_OP_RECV;
+			request.ioprio = IORING_RECV_MULTISHOT;
+			request.flags = IOSQE_BUFFER_SELECT;
+			request.buf_group = 0;
+		}
+		entry.streaming = true;
+	}
+
+	//! Cancel the multishot of a socket. Call with mutex locked.
+	void stop(socket_t socket, Entry& entry)
+	{
+		if(!entry.streaming)
+			return;
+		io_uring_sqe& cancel = sqe();
+		cancel.opcode = IORING_OP_ASYNC_CANCEL;
+		cancel.fd = -1;
+		cancel.addr = userData(entry.mode, entry.stream, socket);
+		cancel.user_data = CANCEL;
+		entry.streaming = false;
+	}
+
+	//! Queue a received socket to be reported. Call with mutex locked.
+	void list(socket_t socket, Entry& entry)
+	{
+		if(entry.listed)
+			return;
+		entry.listed = true;
+		readable.push_back(socket);
+	}
+
+	bool add(socket_t socket, unsigned events)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto entry = entries.emplace(socket, Entry{POLL, events});
+		if(!entry.second)
+			return false;
+		arm(socket, entry.first->second);
+		submit();
+		return true;
+	}
+
+	//! Add a socket with a multishot
+	/*!
+	 * This is only called from the polling thread so the multishot simply
+	 * goes to the kernel with the next wait.
+	 */
+	bool add(socket_t socket, Request mode)
+	{
+		if(!multishot)
+			return false;
+		std::lock_guard<std::mutex> lock(mutex);
+		// Receiving sockets still need polling for errors and writability
+		const auto entry = entries.emplace(
+			socket,
+			Entry{mode, mode==RECV ? EPOLLERR : 0U});
+		if(!entry.second)
+			return false;
+		if(mode == RECV)
+			arm(socket, entry.first->second);
+		start(socket, entry.first->second);
+		return true;
+	}
+
+	bool del(socket_t socket)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto entry = entries.find(socket);
+		if(entry == entries.end())
+			return false;
+		disarm(socket, entry->second);
+		stop(socket, entry->second);
+		for(const auto& received: entry->second.received)
+			giveBack(received.buffer);
+		entries.erase(entry);
+		submit();
+		return true;
+	}
+
+	//! Change the events polled for
+	/*!
+	 * This is only called from the polling thread so the new poll simply
+	 * goes to the kernel with the next wait.
+	 */
+	bool modify(socket_t socket, unsigned events)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto entry = entries.find(socket);
+		if(entry == entries.end())
+			return false;
+		if(entry->second.mode == ACCEPT)
+			return true;
+		if(entry->second.mode == RECV)
+			events &= ~EPOLLIN;
+		if(entry->second.events == events)
+			return true;
+		entry->second.events = events;
+		if(entry->second.armed)
+		{
+			disarm(socket, entry->second);
+			arm(socket, entry->second);
+		}
+		else if(entry->second.mode == RECV)
+			arm(socket, entry->second);
+		return true;
+	}
+
+	size_t read(socket_t socket, char* buffer, size_t size)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto found = entries.find(socket);
+		if(found == entries.end())
+			return 0;
+		Entry& entry = found->second;
+
+		size_t count = 0;
+		while(count < size && !entry.received.empty())
+		{
+			Received& received = entry.received.front();
+			const size_t chunk = std::min(
+				size-count,
+				static_cast<size_t>(received.size));
+			std::memcpy(
+				buffer+count,
+				data
+					+ static_cast<size_t>(received.buffer)*bufferSize
+					+ received.offset,
+				chunk);
+			count += chunk;
+			received.offset += chunk;
+			received.size -= chunk;
+			if(received.size == 0)
+			{
+				giveBack(received.buffer);
+				entry.received.pop_front();
+			}
+		}
+
+		// Keep reporting the socket until everything is read and then once
+		// more so the reader sees the end
+		if(!entry.received.empty()
+				|| (count != 0 && (entry.ended || entry.failed)))
+			list(socket, entry);
+		return count;
+	}
+
+	//! Fill in a result
+	static void result(
+			Result& result,
+			socket_t socket,
+			unsigned events,
+			socket_t accepted=-1)
+	{
+		result.m_data = true;
+		result.m_socket = socket;
+		result.m_events = events;
+		result.m_accepted = accepted;
+	}
+
+	//! Handle a single completion. Call with mutex locked.
+	void complete(const io_uring_cqe& cqe, Result* results, unsigned& count)
+	{
+		const Request request = static_cast<Request>(cqe.user_data >> 62);
+		if(request == CANCEL)
+			return;
+		const socket_t socket = static_cast<socket_t>(
+			cqe.user_data & 0xffffffffU);
+		const uint32_t generation = (cqe.user_data >> 32) & generationMask;
+		const bool buffer = cqe.flags & IORING_CQE_F_BUFFER;
+		if(buffer)
+			--available;
+		const auto found = entries.find(socket);
+		Entry* const entry = found==entries.end() ? nullptr : &found->second;
+
+		if(request == POLL)
+		{
+			if(entry == nullptr || entry->generation != generation)
+				return;
+			entry->armed = false;
+			if(cqe.res == -ECANCELED)
+				return;
+			// A receiving socket hanging up is left to the recv
+			const unsigned events = cqe.res<0 ?
+				EPOLLERR :
+				cqe.res & (entry->events | EPOLLERR | EPOLLHUP);
+			if(events == 0)
+				return;
+			Poll::Ring::result(results[count++], socket, events);
+			rearm.push_back(socket);
+			return;
+		}
+
+		if(entry == nullptr
+				|| entry->mode != request
+				|| entry->stream != generation)
+		{
+			// Left over from a cancelled multishot. Connections it accepted
+			// are still handed out rather than dropped.
+			if(buffer)
+				giveBack(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+			else if(request == ACCEPT && cqe.res >= 0)
+				Poll::Ring::result(results[count++], socket, EPOLLIN, cqe.res);
+			return;
+		}
+
+		if(!(cqe.flags & IORING_CQE_F_MORE))
+			entry->streaming = false;
+		if(request == ACCEPT)
+		{
+			if(cqe.res >= 0)
+				Poll::Ring::result(results[count++], socket, EPOLLIN, cqe.res);
+			else if(cqe.res != -ECANCELED)
+				ERR_LOG("Unable to accept() with fd " << socket << ": " \
+					<< std::strerror(-cqe.res))
+		}
+		else if(buffer)
+		{
+			entry->received.push_back(Received{
+				static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT),
+				0,
+				static_cast<uint32_t>(cqe.res)});
+			list(socket, *entry);
+		}
+		else if(cqe.res == 0)
+		{
+			entry->ended = true;
+			list(socket, *entry);
+		}
+		else if(cqe.res != -ENOBUFS && cqe.res != -ECANCELED)
+		{
+			WARNING_LOG("Socket recv() error on fd " << socket << ": " \
+				<< std::strerror(-cqe.res))
+			entry->failed = true;
+			list(socket, *entry);
+		}
+		if(!entry->streaming && !entry->ended && !entry->failed)
+			restart.push_back(socket);
+	}
+
+	//! Move completions into results. Call with mutex locked.
+	unsigned reap(Result* results, unsigned max)
+	{
+		unsigned count = 0;
+		unsigned head = *cqHead;
+		const unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+		for(; head != tail && count < max; ++head)
+			complete(cqes[head & cqMask], results, count);
+		__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+
+		while(count < max && !readable.empty())
+		{
+			const socket_t socket = readable.front();
+			readable.pop_front();
+			const auto entry = entries.find(socket);
+			if(entry == entries.end() || !entry->second.listed)
+				continue;
+			entry->second.listed = false;
+			unsigned events = EPOLLIN;
+			if(entry->second.ended)
+				events |= EPOLLHUP;
+			if(entry->second.failed)
+				events |= EPOLLERR;
+			result(results[count++], socket, events);
+		}
+		return count;
+	}
+
+	unsigned poll(Result* results, unsigned max, int timeout)
+	{
+		unsigned queued;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for(const auto socket: rearm)
+			{
+				const auto entry = entries.find(socket);
+				if(entry != entries.end() && !entry->second.armed)
+					arm(socket, entry->second);
+			}
+			rearm.clear();
+
+			// Receives stopped for want of buffers wait until some are back
+			auto waiting = restart.begin();
+			for(const auto socket: restart)
+			{
+				const auto entry = entries.find(socket);
+				if(entry == entries.end() || entry->second.streaming)
+					continue;
+				if(entry->second.mode == RECV && available == 0)
+					*waiting++ = socket;
+				else
+					start(socket, entry->second);
+			}
+			restart.erase(waiting, restart.end());
+
+			// Anything queued goes in with the next wait
+			const unsigned count = reap(results, max);
+			if(count)
+				return count;
+			queued = pending();
+			if(queued == 0 && timeout == 0)
+				return 0;
+		}
+
+		__kernel_timespec ts;
+		io_uring_getevents_arg arg;
+		std::memset(&arg, 0, sizeof(arg));
+		if(timeout > 0)
+		{
+			ts.tv_sec = timeout/1000;
+			ts.tv_nsec = (timeout%1000)*1000000LL;
+			arg.ts = reinterpret_cast<uint64_t>(&ts);
+		}
+		const bool wait = timeout != 0;
+		if(syscall(
+				__NR_io_uring_enter,
+				fd,
+				queued,
+				wait ? 1 : 0,
+				wait ? IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG : 0,
+				wait ? &arg : nullptr,
+				wait ? sizeof(arg) : 0) < 0
+				&& errno != EINTR
+				&& errno != ETIME
+				&& errno != EBUSY)
+			FAIL_LOG("Error on io_uring poll: " << std::strerror(errno))
+
+		std::lock_guard<std::mutex> lock(mutex);
+		return reap(results, max);
+	}
+
+	bool send(Send* sends, unsigned count)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for(unsigned first=0; first<count;)
+		{
+			const unsigned batch = std::min(count-first, params.sq_entries);
+			for(unsigned i=first; i<first+batch; ++i)
+			{
+				io_uring_sqe& send = sqe();
+				send.opcode = IORING_OP_SENDMSG;
+				send.fd = sends[i].socket;
+				send.addr = reinterpret_cast<uint64_t>(sends[i].message);
+				// Don't have the kernel wait for room in the socket
+				send.msg_flags = sends[i].flags | MSG_DONTWAIT;
+				send.user_data = i;
+			}
+
+			// Sends that can't block all complete inside the enter
+			for(unsigned completed=0; completed<batch;)
+			{
+				if(syscall(
+						__NR_io_uring_enter,
+						fd,
+						pending(),
+						batch-completed,
+						IORING_ENTER_GETEVENTS,
+						nullptr,
+						0) < 0
+						&& errno != EINTR
+						&& errno != EAGAIN
+						&& errno != EBUSY)
+					FAIL_LOG("Error on io_uring send: " << std::strerror(errno))
+
+				unsigned head = *cqHead;
+				const unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+				for(; head != tail; ++head, ++completed)
+				{
+					const io_uring_cqe& cqe = cqes[head & cqMask];
+					sends[cqe.user_data].result = cqe.res;
+				}
+				__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+			}
+			first += batch;
+		}
+		return true;
+	}
+};
+#endif
+
 Fastcgipp::Poll::Poll()
-#ifdef FASTCGIPP_LINUX
+#ifdef FASTCGIPP_IO_URING
+    :m_ring(Ring::create(4096)),
+    m_poll(m_ring ? -1 : epoll_create(1024))
+#elif defined FASTCGIPP_LINUX
     //:m_poll(epoll_create1(0))
     :m_poll(epoll_create(1024))
 #endif
-{}
+{
+#ifdef FASTCGIPP_IO_URING
+    if(m_ring)
+    {
+        m_ring->provide();
+        m_sendRing = Ring::create(maxSends);
+    }
+#endif
+}
 
 Fastcgipp::Poll::~Poll()
 {
 #ifdef FASTCGIPP_LINUX
-    close(m_poll);
+    if(m_poll != -1)
+        close(m_poll);
 #endif
 }
 
 Fastcgipp::Poll::Result Fastcgipp::Poll::poll(int timeout)
 {
+	Result result;
+	poll(&result, 1, timeout);
+	return result;
+}
+
+unsigned Fastcgipp::Poll::poll(Result* results, unsigned max, int timeout)
+{
+#ifdef FASTCGIPP_IO_URING
+	if (m_ring)
+		return m_ring->poll(results, max, timeout);
+#endif
 	int pollResult;
 #ifdef FASTCGIPP_LINUX
-	epoll_event epollEvent;
+	epoll_event epollEvents[maxBatch];
 	pollResult = epoll_wait(
 		m_poll,
-		&epollEvent,
-		1,
+		epollEvents,
+		max < maxBatch ? max : maxBatch,
 		timeout);
 #elif defined FASTCGIPP_UNIX
 	pollResult = ::poll(
@@ -184,7 +1104,7 @@ Fastcgipp::Poll::Result Fastcgipp::Poll::poll(int timeout)
 		timeout);
 #endif
 
-	Result result;
+	unsigned count = 0;
 	int err = getLastSocketError();
 #if defined(FASTCGIPP_WINDOWS)
 	if (pollResult < 0)
@@ -203,54 +1123,73 @@ Fastcgipp::Poll::Result Fastcgipp::Poll::poll(int timeout)
 #endif
 	else if (pollResult > 0)
 	{
-		result.m_data = true;
 #ifdef FASTCGIPP_LINUX
-		result.m_socket = epollEvent.data.fd;
-		result.m_events = epollEvent.events;
-		DEBUG_LOG("New Poll Message on fd:" << result.m_socket)
-#elif defined FASTCGIPP_UNIX
-		const auto fd = std::find_if(
-			m_poll.begin(),
-			m_poll.end(),
-			[](const pollfd& x)
+		for (; count < static_cast<unsigned>(pollResult); ++count)
+		{
+			Result& result = results[count];
+			result.m_data = true;
+			result.m_socket = epollEvents[count].data.fd;
+			result.m_events = epollEvents[count].events;
+			DEBUG_LOG("New Poll Message on fd:" << result.m_socket)
+		}
+#else
+		for (auto fd = m_poll.begin(); fd != m_poll.end() && count < max;)
+		{
+			if (fd->revents == 0)
 			{
-				return x.revents != 0;
-			});
-		if (fd == m_poll.end())
-			FAIL_LOG("poll() gave a result >0 but no revents are non-zero")
-			result.m_socket = fd->fd;
-		result.m_events = fd->revents;
-#elif defined FASTCGIPP_WINDOWS
-		const auto fd = std::find_if(
-			m_poll.begin(),
-			m_poll.end(),
-			[](const pollfd& x)
+				++fd;
+				continue;
+			}
+#if defined(FASTCGIPP_WINDOWS)
+			if (fd->revents == POLLNVAL)
 			{
-				return x.revents != 0;
-			});
-		if (fd == m_poll.end())
-			FAIL_LOG("poll() gave a result >0 but no revents are non-zero")
-		result.m_socket = fd->fd;
-		result.m_events = fd->revents;
-		if (result.m_events == POLLNVAL)
+				fd = m_poll.erase(fd);
+				continue;
+			}
+#endif
+			Result& result = results[count++];
+			result.m_data = true;
+			result.m_socket = fd->fd;
+			result.m_events = fd->revents;
+			++fd;
+		}
+		if (count == 0 && pollResult > 0)
 		{
-			result.m_socket = -1;
-			result.m_data = false;
-			m_poll.erase(fd);
+#if defined(FASTCGIPP_WINDOWS)
+			return 0;
+#else
+			FAIL_LOG("poll() gave a result >0 but no revents are non-zero")
+#endif
 		}
 #endif
-    }
+	}
 
-    return result;
+	return count;
 }
 
-bool Fastcgipp::Poll::add(const socket_t socket)
+bool Fastcgipp::Poll::add(const socket_t socket, bool exclusive)
 {
 #ifdef FASTCGIPP_LINUX
 	DEBUG_LOG("New Poll fd:" << socket)
+#ifdef FASTCGIPP_IO_URING
+	if (m_ring)
+		return m_ring->add(socket, EPOLLIN | EPOLLERR | EPOLLHUP);
+#endif
 	epoll_event event;
 	event.data.fd = socket;
 	event.events = EPOLLIN | EPOLLERR | EPOLLHUP/* | EPOLLRDHUP*/;
+#ifdef EPOLLEXCLUSIVE
+	if (exclusive)
+	{
+		event.events |= EPOLLEXCLUSIVE;
+		if (epoll_ctl(m_poll, EPOLL_CTL_ADD, socket, &event) != -1)
+			return true;
+		// Kernels before 4.5 don't know about it
+		if (errno != EINVAL)
+			return false;
+		event.events &= ~EPOLLEXCLUSIVE;
+	}
+#endif
 	return epoll_ctl(m_poll, EPOLL_CTL_ADD, socket, &event) != -1;
 #elif defined FASTCGIPP_UNIX
 	const auto fd = std::find_if(
@@ -285,9 +1224,67 @@ bool Fastcgipp::Poll::add(const socket_t socket)
 #endif
 }
 
+bool Fastcgipp::Poll::pollOut(const socket_t socket, bool out)
+{
+#ifdef FASTCGIPP_LINUX
+	epoll_event event;
+	event.data.fd = socket;
+	event.events = EPOLLIN | EPOLLERR | EPOLLHUP;
+	if(out)
+		event.events |= EPOLLOUT;
+#ifdef FASTCGIPP_IO_URING
+	if(m_ring)
+		return m_ring->modify(socket, event.events);
+#endif
+	return epoll_ctl(m_poll, EPOLL_CTL_MOD, socket, &event) != -1;
+#else
+	const auto fd = std::find_if(
+		m_poll.begin(),
+		m_poll.end(),
+		[&socket](const pollfd& x)
+		{
+			return x.fd == socket;
+		});
+	if (fd == m_poll.end())
+		return false;
+
+	if(out)
+		fd->events |= Result::pollOut;
+	else
+		fd->events &= ~Result::pollOut;
+	return true;
+#endif
+}
+
+#ifdef FASTCGIPP_IO_URING
+bool Fastcgipp::Poll::accept(const socket_t listener)
+{
+	return m_ring && m_ring->add(listener, Ring::ACCEPT);
+}
+
+bool Fastcgipp::Poll::receive(const socket_t socket)
+{
+	return m_ring && m_ring->add(socket, Ring::RECV);
+}
+
+size_t Fastcgipp::Poll::read(const socket_t socket, char* buffer, size_t size)
+{
+	return m_ring ? m_ring->read(socket, buffer, size) : 0;
+}
+
+bool Fastcgipp::Poll::send(Send* sends, unsigned count)
+{
+	return m_sendRing && m_sendRing->send(sends, count);
+}
+#endif
+
 bool Fastcgipp::Poll::del(const socket_t socket)
 {
 #ifdef FASTCGIPP_LINUX
+#ifdef FASTCGIPP_IO_URING
+	if (m_ring)
+		return m_ring->del(socket);
+#endif
 	return epoll_ctl(m_poll, EPOLL_CTL_DEL, socket, nullptr) != -1;
 #elif defined FASTCGIPP_UNIX
 	const auto fd = std::find_if(
@@ -359,6 +1356,28 @@ bool Fastcgipp::Poll::del(const socket_t socket)
 #endif
 }
 
+#ifdef FASTCGIPP_IO_URING
+bool Fastcgipp::Poll::accept(const socket_t listener)
+{
+	return m_ring && m_ring->add(listener, Ring::ACCEPT);
+}
+
+bool Fastcgipp::Poll::receive(const socket_t socket)
+{
+	return m_ring && m_ring->add(socket, Ring::RECV);
+}
+
+size_t Fastcgipp::Poll::read(const socket_t socket, char* buffer, size_t size)
+{
+	return m_ring ? m_ring->read(socket, buffer, size) : 0;
+}
+
+bool Fastcgipp::Poll::send(Send* sends, unsigned count)
+{
+	return m_sendRing && m_sendRing->send(sends, count);
+}
+#endif
+
 bool Fastcgipp::Poll::del(const socket_t socket)
 {
 #ifdef FASTCGIPP_LINUX
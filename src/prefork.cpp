@@ -0,0 +1,219 @@
+/*!
+ * @file       prefork.cpp
+ * @brief      Defines the Fastcgipp::Prefork_base class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/prefork.hpp"
+
+#if ! defined(FASTCGIPP_WINDOWS)
+#include "fastcgi++/affinity.hpp"
+#include "fastcgi++/log.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+Fastcgipp::Prefork_base::Prefork_base(unsigned workers):
+    m_pin(false),
+    m_workers(std::max(workers, 1U))
+{
+    sigemptyset(&m_mask);
+    for(auto& worker: m_workers)
+        worker.pid = -1;
+}
+
+bool Fastcgipp::Prefork_base::run()
+{
+    if(m_listeners.listeners().empty())
+    {
+        ERR_LOG("Prefork_base::run(): Nothing to listen to")
+        return false;
+    }
+
+    // Signals are only ever handled synchronously by sigtimedwait() below.
+    // The workers get the mask back to set up handlers of their own.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGCHLD);
+    sigaddset(&signals, SIGUSR1);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &m_mask);
+
+    for(unsigned slot=0; slot<m_workers.size(); ++slot)
+        spawn(slot);
+
+    bool stopping = false;
+    while(true)
+    {
+        // Reap whatever has exited and schedule restarts
+        int status;
+        pid_t pid;
+        while((pid = waitpid(-1, &status, WNOHANG)) > 0)
+        {
+            const auto worker = std::find_if(
+                    m_workers.begin(),
+                    m_workers.end(),
+                    [pid] (const Worker& worker) { return worker.pid == pid; });
+            if(worker == m_workers.end())
+                continue;
+            worker->pid = -1;
+            if(stopping)
+                continue;
+
+            if(WIFSIGNALED(status))
+                ERR_LOG("Worker " << pid << " killed by signal " \
+                        << WTERMSIG(status))
+            else
+                WARNING_LOG("Worker " << pid << " exited with status " \
+                        << WEXITSTATUS(status))
+
+            // Don't spin on a worker that can't stay up
+            const auto now = Clock::now();
+            worker->restart = now;
+            if(now-worker->started < std::chrono::seconds(1))
+                worker->restart += std::chrono::seconds(1);
+        }
+
+        if(stopping)
+        {
+            if(std::none_of(
+                        m_workers.cbegin(),
+                        m_workers.cend(),
+                        [] (const Worker& worker) { return worker.pid != -1; }))
+                break;
+        }
+        else
+        {
+            const auto now = Clock::now();
+            for(unsigned slot=0; slot<m_workers.size(); ++slot)
+                if(m_workers[slot].pid == -1 && m_workers[slot].restart <= now)
+                    spawn(slot);
+        }
+
+        // Sleep until a signal comes in or a restart is due
+        Clock::duration wait = std::chrono::seconds(1);
+        if(!stopping)
+            for(const auto& worker: m_workers)
+                if(worker.pid == -1)
+                    wait = std::min(wait, worker.restart-Clock::now());
+        wait = std::max(wait, Clock::duration::zero());
+        const auto seconds =
+            std::chrono::duration_cast<std::chrono::seconds>(wait);
+        timespec timeout;
+        timeout.tv_sec = seconds.count();
+        timeout.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                wait-seconds).count();
+
+        switch(sigtimedwait(&signals, nullptr, &timeout))
+        {
+            case SIGUSR1:
+            {
+                DIAG_LOG("Received SIGUSR1. Stopping workers.")
+                stopping = true;
+                forward(SIGUSR1);
+                break;
+            }
+            case SIGTERM:
+            {
+                DIAG_LOG("Received SIGTERM. Terminating workers.")
+                stopping = true;
+                forward(SIGTERM);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    pthread_sigmask(SIG_SETMASK, &m_mask, nullptr);
+    return true;
+}
+
+void Fastcgipp::Prefork_base::spawn(unsigned slot)
+{
+    Worker& process = m_workers[slot];
+    process.started = Clock::now();
+    process.restart = process.started+std::chrono::seconds(1);
+
+    const pid_t pid = fork();
+    if(pid == -1)
+    {
+        ERR_LOG("Unable to fork worker " << slot << ": " \
+                << std::strerror(errno))
+        return;
+    }
+    if(pid == 0)
+    {
+        // The listen sockets and their files belong to the supervisor so we
+        // never return or unwind back into it
+        pthread_sigmask(SIG_SETMASK, &m_mask, nullptr);
+        if(m_pin)
+            pinTo(slot);
+        try
+        {
+            worker(slot);
+        }
+        catch(const std::exception& e)
+        {
+            ERR_LOG("Worker " << slot << " threw: " << e.what())
+            _exit(EXIT_FAILURE);
+        }
+        catch(...)
+        {
+            ERR_LOG("Worker " << slot << " threw")
+            _exit(EXIT_FAILURE);
+        }
+        _exit(EXIT_SUCCESS);
+    }
+
+    DIAG_LOG("Started worker " << slot << " as process " << pid)
+    process.pid = pid;
+}
+
+void Fastcgipp::Prefork_base::pinTo(unsigned slot)
+{
+    // We're still single threaded here so the thread is the whole process
+    const auto allowed = allowedCpus();
+    if(allowed.empty())
+    {
+        WARNING_LOG("Unable to pin worker " << slot << " to a CPU")
+        return;
+    }
+    pinThread({allowed[slot%allowed.size()]});
+}
+
+void Fastcgipp::Prefork_base::forward(int signum)
+{
+    for(const auto& worker: m_workers)
+        if(worker.pid != -1)
+            kill(worker.pid, signum);
+}
+#endif
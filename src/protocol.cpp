@@ -79,15 +79,60 @@ bool Fastcgipp::Protocol::processParamHeader(
         return true;
 }
 
-const Fastcgipp::Protocol::ManagementReply<14, 2>
-Fastcgipp::Protocol::maxConnsReply("FCGI_MAX_CONNS", "10");
-
-const Fastcgipp::Protocol::ManagementReply<13, 2>
-Fastcgipp::Protocol::maxReqsReply("FCGI_MAX_REQS", "50");
-
 const Fastcgipp::Protocol::ManagementReply<15, 1>
 Fastcgipp::Protocol::mpxsConnsReply("FCGI_MPXS_CONNS", "1");
 
+Fastcgipp::Block Fastcgipp::Protocol::valuesResult(
+        const std::vector<std::pair<std::string, std::string>>& values)
+{
+    const auto lengthSize = [] (size_t length) -> size_t
+    {
+        return length>0x7f? sizeof(uint32_t): 1;
+    };
+    const auto writeLength = [] (char*& data, size_t length)
+    {
+        if(length>0x7f)
+        {
+            *reinterpret_cast<BigEndian<uint32_t>*>(data)
+                = static_cast<uint32_t>(length) | 0x80000000U;
+            data += sizeof(uint32_t);
+        }
+        else
+            *data++ = static_cast<char>(length);
+    };
+
+    size_t contentLength = 0;
+    for(const auto& value: values)
+        contentLength += lengthSize(value.first.size())
+            +lengthSize(value.second.size())
+            +value.first.size()
+            +value.second.size();
+    if(contentLength > 0xffffU)
+        contentLength = 0;
+
+    Block record(getRecordSize(contentLength));
+    Header& header = *reinterpret_cast<Header*>(record.begin());
+    header.version = version;
+    header.type = RecordType::GET_VALUES_RESULT;
+    header.fcgiId = 0;
+    header.contentLength = static_cast<uint16_t>(contentLength);
+    header.paddingLength = static_cast<uint8_t>(
+            record.size()-sizeof(Header)-contentLength);
+
+    if(contentLength != 0)
+    {
+        char* data = record.begin()+sizeof(Header);
+        for(const auto& value: values)
+        {
+            writeLength(data, value.first.size());
+            writeLength(data, value.second.size());
+            data = std::copy(value.first.cbegin(), value.first.cend(), data);
+            data = std::copy(value.second.cbegin(), value.second.cend(), data);
+        }
+    }
+    return record;
+}
+
 const char Fastcgipp::version[]=FASTCGIPP_VERSION;
 
 size_t Fastcgipp::Protocol::getRecordSize(size_t contentLength)
@@ -163,6 +163,7 @@ std::unique_lock<std::mutex>Fastcgipp::Request<charT>::handler()
                             goto exit;
                         }
                         m_state = Protocol::RecordType::INPUT;
+                        priority = classify();
 						if(paramsEndProcess() != PR_CONTINUE_PROCESS)
 						{
                             complete();
@@ -202,6 +203,19 @@ std::unique_lock<std::mutex>Fastcgipp::Request<charT>::handler()
             }
         }
 
+        if(message.type == Message::timeout)
+        {
+            WARNING_LOG("Request timed out")
+            // A second status line can't go in the middle of a response so
+            // one that has begun is cut off along with the connection
+            if(m_outStreamBuffer.written())
+                m_kill = true;
+            else
+                timeoutHandler();
+            complete();
+            break;
+        }
+
         m_message = std::move(message);
         if(responseProcess())
         {
@@ -265,12 +279,35 @@ template<class charT> void Fastcgipp::Request<charT>::unknownContentErrorHandler
 "</html>";
 }
 
+template<class charT> void Fastcgipp::Request<charT>::timeoutHandler()
+{
+        out << \
+"Status: 504 Gateway Timeout\n"\
+"Content-Type: text/html; charset=utf-8\r\n\r\n"\
+"<!DOCTYPE html>"\
+"<html lang='en'>"\
+    "<head>"\
+        "<title>504 Gateway Timeout</title>"\
+    "</head>"\
+    "<body>"\
+        "<h1>504 Gateway Timeout</h1>"\
+    "</body>"\
+"</html>";
+}
+
 template<class charT> void Fastcgipp::Request<charT>::configure(
         const Protocol::RequestId& id,
         const Protocol::Role& role,
         bool kill,
-        const std::function<void(const Socket&, Block&&, bool)> send,
-		const std::function<void(const Socket&, Block&&, bool)> send2,
+        const std::function<void(const SocketId&, Block&&, bool)> send,
+		const std::function<void(const SocketId&, Block&&, bool)> send2,
+        const std::function<void(
+            const SocketId&,
+            Block&&,
+            const std::shared_ptr<const File>&,
+            uint64_t,
+            size_t,
+            size_t)> sendFile,
         const std::function<void(Message)> callback)
 {
     using namespace std::placeholders;
@@ -285,12 +322,52 @@ template<class charT> void Fastcgipp::Request<charT>::configure(
             id,
             Protocol::RecordType::OUTPUT,
             std::bind(send, _1, _2, false),
-            std::bind(send2, _1, _2, false));
+            std::bind(send2, _1, _2, false),
+            sendFile);
     m_errStreamBuffer.configure(
             id,
             Protocol::RecordType::ERR,
             std::bind(send, _1, _2, false),
-            std::bind(send2, _1, _2, false));
+            std::bind(send2, _1, _2, false),
+            sendFile);
+}
+
+template<class charT> void Fastcgipp::Request<charT>::configure(
+        const Protocol::RequestId& id,
+        const Protocol::Role& role,
+        bool kill,
+        const std::function<void(Message)> callback)
+{
+    m_kill=kill;
+    m_id=id;
+    m_role=role;
+    m_callback=callback;
+
+    m_outStreamBuffer.configure(id);
+    m_errStreamBuffer.configure(id);
+}
+
+template<class charT> void Fastcgipp::Request<charT>::reset()
+{
+    // Whatever is left goes out just as it would on destruction
+    out.flush();
+    err.flush();
+    for(auto stream: {&out, &err})
+    {
+        stream->clear();
+        *stream << Encoding::NONE;
+        if(stream->getloc() != std::locale::classic())
+            stream->imbue(std::locale::classic());
+    }
+
+    m_environment.clear();
+    m_state = Protocol::RecordType::PARAMS;
+    m_status = Protocol::ProtocolStatus::REQUEST_COMPLETE;
+    priority = 0;
+    m_message = Message();
+    std::lock_guard<std::mutex> lock(m_messagesMutex);
+    while(!m_messages.empty())
+        m_messages.pop();
 }
 
 template<class charT> unsigned Fastcgipp::Request<charT>::pickLocale(
@@ -0,0 +1,411 @@
+/*!
+ * @file       scheduler.cpp
+ * @brief      Defines the Fastcgipp::Scheduler class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/scheduler.hpp"
+
+#include <algorithm>
+#include <thread>
+
+namespace
+{
+    //! How many times an idle worker checks for tasks before parking
+    const unsigned s_spins = 64;
+
+    //! Most tasks taken from a victim at once
+    const size_t s_stealBatch = 32;
+
+    //! The scheduler whose worker the calling thread is, if any
+    thread_local const Fastcgipp::Scheduler* t_scheduler = nullptr;
+
+    //! Which of its workers the calling thread is
+    thread_local unsigned t_worker = 0;
+}
+
+Fastcgipp::Scheduler::Scheduler(unsigned workers):
+    m_affinity(false),
+    m_next(0),
+    m_size(0),
+    m_spinning(0),
+    m_parked(0),
+    m_generation(0)
+{
+    classes({{1, 0}});
+    this->workers(workers);
+}
+
+void Fastcgipp::Scheduler::workers(unsigned count)
+{
+    count = std::max(count, 1U);
+    while(m_queues.size() < count)
+        m_queues.emplace_back(new Queue(m_classes.size()));
+    while(m_queues.size() > count)
+    {
+        Queue& front = *m_queues.front();
+        Queue& back = *m_queues.back();
+        for(unsigned i=0; i<m_classes.size(); ++i)
+            front.tasks[i].insert(
+                    front.tasks[i].end(),
+                    back.tasks[i].begin(),
+                    back.tasks[i].end());
+        front.size += back.size;
+        m_queues.pop_back();
+    }
+}
+
+void Fastcgipp::Scheduler::classes(const std::vector<Class>& classes)
+{
+    m_classes.assign(
+            classes.begin(),
+            classes.begin()+std::min<size_t>(classes.size(), maxClasses));
+    if(m_classes.empty())
+        m_classes.push_back({1, 0});
+    for(auto& priority: m_classes)
+        priority.weight = std::max(priority.weight, 1U);
+    const size_t count = m_classes.size();
+
+    m_queued.reset(new std::atomic_size_t[count]);
+    m_handling.reset(new std::atomic_uint[count]);
+    for(unsigned i=0; i<count; ++i)
+    {
+        m_queued[i] = 0;
+        m_handling[i] = 0;
+    }
+
+    for(auto& queue: m_queues)
+    {
+        for(unsigned i=count; i<queue->tasks.size(); ++i)
+            queue->tasks[count-1].insert(
+                    queue->tasks[count-1].end(),
+                    queue->tasks[i].begin(),
+                    queue->tasks[i].end());
+        queue->tasks.resize(count);
+        queue->credit.assign(count, 0);
+        queue->handling = -1;
+        for(unsigned i=0; i<count; ++i)
+            m_queued[i] += queue->tasks[i].size();
+    }
+}
+
+unsigned Fastcgipp::Scheduler::worker(const Protocol::RequestId& task) const
+{
+    // The generation is left out so the mix stays the same for a request
+    uint64_t key = static_cast<uint64_t>(task.m_socket.socket())<<16;
+    key |= task.m_id;
+    key *= 0x9e3779b97f4a7c15ULL;
+    return static_cast<unsigned>(key>>32) % m_queues.size();
+}
+
+void Fastcgipp::Scheduler::push(
+        const Protocol::RequestId& task,
+        unsigned priority)
+{
+    priority = std::min<unsigned>(priority, m_classes.size()-1);
+
+    if(m_affinity)
+    {
+        Queue& queue = *m_queues[worker(task)];
+        ++m_size;
+        ++m_queued[priority];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks[priority].push_back(task);
+        ++queue.size;
+        if(queue.parked)
+            queue.wake.notify_one();
+        return;
+    }
+
+    Queue& queue = t_scheduler==this && t_worker<m_queues.size()
+        ? *m_queues[t_worker]
+        : *m_queues[m_next++ % m_queues.size()];
+
+    // Counting first means m_size never reads lower than what is queued
+    ++m_size;
+    ++m_queued[priority];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks[priority].push_back(task);
+        ++queue.size;
+    }
+    unpark();
+}
+
+bool Fastcgipp::Scheduler::pop(unsigned worker, Protocol::RequestId& task)
+{
+    t_scheduler = this;
+    t_worker = worker;
+    release(worker);
+
+    if(m_size == 0)
+        return false;
+
+    {
+        Queue& queue = *m_queues[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        const int priority = choose(worker, queue);
+        if(priority >= 0)
+        {
+            auto& tasks = queue.tasks[priority];
+            task = tasks.front();
+            tasks.pop_front();
+            --queue.size;
+            --m_queued[priority];
+            --m_size;
+            queue.handling = priority;
+            return true;
+        }
+    }
+
+    if(m_affinity)
+        return false;
+    for(unsigned i=1; i<m_queues.size(); ++i)
+        if(steal(worker, (worker+i)%m_queues.size(), task))
+            return true;
+    return false;
+}
+
+void Fastcgipp::Scheduler::release(unsigned worker)
+{
+    Queue& queue = *m_queues[worker];
+    if(queue.handling < 0)
+        return;
+    const unsigned priority = queue.handling;
+    queue.handling = -1;
+
+    const unsigned limit = m_classes[priority].limit;
+    if(limit == 0)
+        return;
+    if(m_handling[priority]-- == limit && m_queued[priority] != 0)
+    {
+        // Whoever is waiting on the class may be parked
+        if(m_affinity)
+            for(auto& other: m_queues)
+            {
+                std::lock_guard<std::mutex> lock(other->mutex);
+                if(other->parked)
+                    other->wake.notify_one();
+            }
+        else
+            unpark();
+    }
+}
+
+int Fastcgipp::Scheduler::choose(unsigned worker, const Queue& queue)
+{
+    std::vector<int>& credit = m_queues[worker]->credit;
+    uint64_t skipped = 0;
+
+    while(true)
+    {
+        uint64_t eligible = 0;
+        int chosen = -1;
+        int total = 0;
+        for(unsigned i=0; i<m_classes.size(); ++i)
+        {
+            if(queue.tasks[i].empty() || skipped & (uint64_t(1)<<i))
+                continue;
+            const Class& priority = m_classes[i];
+            if(priority.limit != 0 && m_handling[i] >= priority.limit)
+                continue;
+            eligible |= uint64_t(1)<<i;
+            total += priority.weight;
+            if(chosen < 0
+                    || credit[i]+int(priority.weight)
+                        > credit[chosen]+int(m_classes[chosen].weight))
+                chosen = i;
+        }
+        if(chosen < 0)
+            return -1;
+
+        // Another worker may have taken the last spot since we looked
+        const unsigned limit = m_classes[chosen].limit;
+        if(limit != 0)
+        {
+            unsigned handling = m_handling[chosen];
+            while(handling < limit
+                    && !m_handling[chosen].compare_exchange_weak(
+                        handling,
+                        handling+1));
+            if(handling >= limit)
+            {
+                skipped |= uint64_t(1)<<chosen;
+                continue;
+            }
+        }
+
+        // Every class in the running gains its weight and the winner pays
+        // for it with all of them
+        for(unsigned i=0; i<m_classes.size(); ++i)
+            if(eligible & (uint64_t(1)<<i))
+                credit[i] += m_classes[i].weight;
+        credit[chosen] -= total;
+        return chosen;
+    }
+}
+
+bool Fastcgipp::Scheduler::runnable() const
+{
+    for(unsigned i=0; i<m_classes.size(); ++i)
+        if(m_queued[i] != 0 && (m_classes[i].limit == 0
+                    || m_handling[i] < m_classes[i].limit))
+            return true;
+    return false;
+}
+
+bool Fastcgipp::Scheduler::runnable(const Queue& queue) const
+{
+    for(unsigned i=0; i<m_classes.size(); ++i)
+        if(!queue.tasks[i].empty() && (m_classes[i].limit == 0
+                    || m_handling[i] < m_classes[i].limit))
+            return true;
+    return false;
+}
+
+bool Fastcgipp::Scheduler::steal(
+        unsigned worker,
+        unsigned victim,
+        Protocol::RequestId& task)
+{
+    // Only one queue is ever locked at a time so stealing can't deadlock
+    Protocol::RequestId batch[s_stealBatch];
+    size_t count;
+    int priority;
+    {
+        Queue& queue = *m_queues[victim];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        priority = choose(worker, queue);
+        if(priority < 0)
+            return false;
+        auto& tasks = queue.tasks[priority];
+        count = std::min((tasks.size()+1)/2, s_stealBatch);
+        std::copy(tasks.end()-count, tasks.end(), batch);
+        tasks.erase(tasks.end()-count, tasks.end());
+        queue.size -= count;
+    }
+
+    task = batch[0];
+    --m_queued[priority];
+    --m_size;
+    Queue& queue = *m_queues[worker];
+    queue.handling = priority;
+    if(count > 1)
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks[priority].insert(
+                queue.tasks[priority].end(),
+                batch+1,
+                batch+count);
+        queue.size += count-1;
+    }
+    return true;
+}
+
+void Fastcgipp::Scheduler::idle(unsigned worker, unsigned generation)
+{
+    t_scheduler = this;
+    t_worker = worker;
+    release(worker);
+
+    if(m_affinity)
+    {
+        idleAlone(worker, generation);
+        return;
+    }
+
+    ++m_spinning;
+    for(unsigned spin=0; spin<s_spins; ++spin)
+    {
+        if(runnable() || m_generation != generation)
+        {
+            // Pushes skipped waking anyone while we were spinning
+            if(--m_spinning == 0 && m_size > 1)
+                unpark();
+            return;
+        }
+        std::this_thread::yield();
+    }
+    --m_spinning;
+
+    {
+        std::unique_lock<std::mutex> lock(m_wakeMutex);
+        ++m_parked;
+        while(!runnable() && m_generation == generation)
+            m_wake.wait(lock);
+        --m_parked;
+    }
+
+    // Pass the wake up along while there is more than we can take
+    if(m_size > 1)
+        unpark();
+}
+
+void Fastcgipp::Scheduler::idleAlone(unsigned worker, unsigned generation)
+{
+    // Nobody else takes our tasks so we only ever watch our own queue
+    Queue& queue = *m_queues[worker];
+    for(unsigned spin=0; spin<s_spins; ++spin)
+    {
+        if(m_generation != generation)
+            return;
+        if(queue.size != 0)
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if(runnable(queue))
+                return;
+        }
+        std::this_thread::yield();
+    }
+
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    queue.parked = true;
+    while(!runnable(queue) && m_generation == generation)
+        queue.wake.wait(lock);
+    queue.parked = false;
+}
+
+void Fastcgipp::Scheduler::wake()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        ++m_generation;
+        m_wake.notify_all();
+    }
+    for(auto& queue: m_queues)
+    {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->wake.notify_all();
+    }
+}
+
+void Fastcgipp::Scheduler::unpark()
+{
+    if(m_spinning == 0 && m_parked != 0)
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_wake.notify_one();
+    }
+}
@@ -29,6 +29,8 @@
 #include "fastcgi++/sockets.hpp"
 #include "fastcgi++/log.hpp"
 
+#include <algorithm>
+
 int getLastSocketError()
 {
 #if defined(FASTCGIPP_WINDOWS)
@@ -41,6 +43,7 @@ int getLastSocketError()
 #if defined(FASTCGIPP_WINDOWS)
 #include <WS2tcpip.h>
 #include <WSPiApi.h>
+#include <io.h>
 typedef SOCKET socket_t;
 #else
 #include <sys/socket.h>
@@ -54,7 +57,13 @@ typedef SOCKET socket_t;
 #include <fcntl.h>
 #include <pwd.h>
 #include <grp.h>
+#include <climits>
 #include <cstring>
+#include <cstddef>
+#ifdef FASTCGIPP_LINUX
+#include <sys/sendfile.h>
+#include <linux/errqueue.h>
+#endif
 
 /*ssize_t Fastcgipp::Socket::read(char* buffer, size_t size) const
 {
@@ -643,6 +652,68 @@ void Fastcgipp::SocketGroup::createSocket(const socket_t listener)
 
 */
 #endif
+namespace
+{
+	//! Number of identifiers in a page of the live socket table
+	const size_t s_livePage = 1024;
+
+	//! Number of pages in the live socket table
+	const size_t s_livePages = 1024;
+
+	//! Generation of the valid socket using each OS level identifier
+	/*!
+	 * Pages are allocated on first use and never freed so they can be read
+	 * without a lock.
+	 */
+	std::atomic<std::atomic_uint_least32_t*> s_live[s_livePages];
+
+	//! Our stand in slot for identifiers beyond the table
+	std::atomic_uint_least32_t s_liveOverflow(0);
+
+	std::atomic_uint_least32_t& liveSlot(Fastcgipp::socket_t socket)
+	{
+		const size_t index = static_cast<size_t>(socket);
+		const size_t page = index / s_livePage;
+		if (page >= s_livePages)
+			return s_liveOverflow;
+
+		std::atomic_uint_least32_t* slots =
+			s_live[page].load(std::memory_order_acquire);
+		if (slots == nullptr)
+		{
+			std::atomic_uint_least32_t* const fresh =
+				new std::atomic_uint_least32_t[s_livePage];
+			for (size_t i = 0; i < s_livePage; ++i)
+				fresh[i].store(0, std::memory_order_relaxed);
+			if (s_live[page].compare_exchange_strong(
+				slots,
+				fresh,
+				std::memory_order_acq_rel))
+				slots = fresh;
+			else
+				delete[] fresh;
+		}
+		return slots[index % s_livePage];
+	}
+}
+
+uint32_t Fastcgipp::Socket::live(socket_t socket)
+{
+	const size_t page = static_cast<size_t>(socket) / s_livePage;
+	if (page >= s_livePages
+		|| s_live[page].load(std::memory_order_acquire) == nullptr)
+		return 0;
+	return liveSlot(socket).load(std::memory_order_acquire);
+}
+
+void Fastcgipp::Socket::Data::invalidate()
+{
+	m_valid = false;
+	// Leave the slot alone if a newer socket has already taken it
+	uint_least32_t generation = m_generation;
+	liveSlot(m_socket).compare_exchange_strong(generation, 0);
+}
+
 Fastcgipp::Socket::Socket(
 	const socket_t& socket,
 	SocketGroup& group,
@@ -650,6 +721,8 @@ Fastcgipp::Socket::Socket(
 	m_data(new Data(socket, valid, group)),
 	m_original(true)
 {
+	if (valid)
+		liveSlot(socket).store(m_data->m_generation, std::memory_order_release);
 	/*if (!group.m_poll.add(socket))
 	{
 		int errNum = getLastSocketError();
@@ -680,8 +753,14 @@ ssize_t Fastcgipp::Socket::read(char* buffer, size_t size) const
 
 	//add by zhangc for transmit send and recv concurrent
 	ssize_t count = 0;
+#if defined(FASTCGIPP_IO_URING)
+	// The kernel has already received it for us
+	if (m_data->m_buffered)
+		count = m_data->m_group.m_poll.read(m_data->m_socket, buffer, size);
+	else
+#endif
 	{
-		std::lock_guard<std::mutex> lock(m_sockDataMutex);
+		std::lock_guard<std::mutex> lock(m_data->m_mutex);
 #if defined(FASTCGIPP_WINDOWS)
 		count = ::recv(m_data->m_socket, buffer, size, 0);
 #else
@@ -733,7 +812,7 @@ ssize_t Fastcgipp::Socket::write(const char* buffer, size_t size) const
 	//add by zhangc for transmit send and recv concurrent
 	ssize_t count = 0;
 	{
-		std::lock_guard<std::mutex> lock(m_sockDataMutex);
+		std::lock_guard<std::mutex> lock(m_data->m_mutex);
 #if defined(FASTCGIPP_WINDOWS)
 		count = ::send(m_data->m_socket, buffer, size, 0);
 #else
@@ -782,11 +861,282 @@ ssize_t Fastcgipp::Socket::write2(const char* buffer, size_t size) const
 
 	return count;*/
 }
+ssize_t Fastcgipp::Socket::write(
+	const std::vector<Chunk>& chunks,
+	bool zeroCopy,
+	bool more) const
+{
+	if (!valid() || m_data->m_closing)
+		return -1;
+	if (chunks.empty())
+		return 0;
+	ssize_t count = 0;
+#if defined(FASTCGIPP_WINDOWS)
+	std::vector<WSABUF> buffers(chunks.size());
+	for (size_t i = 0; i < chunks.size(); ++i)
+	{
+		buffers[i].buf = const_cast<CHAR*>(chunks[i].first);
+		buffers[i].len = static_cast<ULONG>(chunks[i].second);
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_data->m_mutex);
+		DWORD sent = 0;
+		if (WSASend(m_data->m_socket, buffers.data(), static_cast<DWORD>(buffers.size()), &sent, 0, nullptr, nullptr) == 0)
+			count = sent;
+		else
+			count = -1;
+	}
+#else
+	std::vector<iovec> buffers;
+	msghdr message;
+	const int flags = gather(chunks, zeroCopy, more, buffers, message);
+	{
+		std::lock_guard<std::mutex> lock(m_data->m_mutex);
+		count = sent(
+			::sendmsg(m_data->m_socket, &message, flags),
+			message,
+			flags);
+	}
+#endif
+	return written(count);
+}
+#if ! defined(FASTCGIPP_WINDOWS)
+int Fastcgipp::Socket::gather(
+	const std::vector<Chunk>& chunks,
+	bool zeroCopy,
+	bool more,
+	std::vector<iovec>& buffers,
+	msghdr& message) const
+{
+	buffers.resize(std::min(chunks.size(), static_cast<size_t>(IOV_MAX)));
+	for (size_t i = 0; i < buffers.size(); ++i)
+	{
+		buffers[i].iov_base = const_cast<char*>(chunks[i].first);
+		buffers[i].iov_len = chunks[i].second;
+	}
+	std::memset(&message, 0, sizeof(message));
+	message.msg_iov = buffers.data();
+	message.msg_iovlen = buffers.size();
+	int flags = MSG_NOSIGNAL;
+#if defined(FASTCGIPP_LINUX)
+	if (zeroCopy && enableZeroCopy())
+		flags |= MSG_ZEROCOPY;
+	if (more)
+		flags |= MSG_MORE;
+#endif
+	return flags;
+}
+ssize_t Fastcgipp::Socket::sent(
+	ssize_t count,
+	const msghdr& message,
+	int flags) const
+{
+#if defined(FASTCGIPP_LINUX)
+	if (flags & MSG_ZEROCOPY)
+	{
+		// Out of memory to pin pages with so copy this one
+		if (count < 0 && getLastSocketError() == ENOBUFS)
+			count = ::sendmsg(
+				m_data->m_socket,
+				&message,
+				flags & ~MSG_ZEROCOPY);
+		else if (count > 0)
+			++m_data->m_zeroCopySent;
+	}
+#endif
+	return count;
+}
+#endif
+ssize_t Fastcgipp::Socket::written(ssize_t count) const
+{
+	if (count < 0)
+	{
+#if defined(FASTCGIPP_WINDOWS)
+		if (getLastSocketError() == WSAEWOULDBLOCK)
+#else
+		if (getLastSocketError() == EAGAIN || getLastSocketError() == EWOULDBLOCK)
+#endif
+			return 0;
+		WARNING_LOG("Socket write() error on fd " \
+			<< m_data->m_socket << ": " << strerror(getLastSocketError()))
+		close();
+		return -1;
+	}
+#if FASTCGIPP_LOG_LEVEL > 3
+	m_data->m_group.m_bytesSent += count;
+#endif
+
+	return count;
+}
+ssize_t Fastcgipp::Socket::write(
+	const File& file,
+	uint64_t offset,
+	size_t size) const
+{
+	if (!valid() || m_data->m_closing)
+		return -1;
+	if (size == 0)
+		return 0;
+	ssize_t count = 0;
+#if defined(FASTCGIPP_LINUX)
+	off_t position = offset;
+	{
+		std::lock_guard<std::mutex> lock(m_data->m_mutex);
+		count = ::sendfile(m_data->m_socket, file.get(), &position, size);
+	}
+#else
+	char buffer[16384];
+	const ssize_t read = file.read(
+		buffer,
+		std::min(size, sizeof(buffer)),
+		offset);
+	if (read > 0)
+		return write(buffer, read);
+	count = read;
+#endif
+	if (count < 0)
+	{
+#if defined(FASTCGIPP_WINDOWS)
+		if (getLastSocketError() == WSAEWOULDBLOCK)
+#else
+		if (getLastSocketError() == EAGAIN || getLastSocketError() == EWOULDBLOCK)
+#endif
+			return 0;
+		WARNING_LOG("Socket write() of file " << file.get() << " error on fd " \
+			<< m_data->m_socket << ": " << strerror(getLastSocketError()))
+		close();
+		return -1;
+	}
+	if (count == 0)
+	{
+		WARNING_LOG("File " << file.get() << " ended early writing to fd " \
+			<< m_data->m_socket)
+		close();
+		return -1;
+	}
+#if FASTCGIPP_LOG_LEVEL > 3
+	m_data->m_group.m_bytesSent += count;
+#endif
+
+	return count;
+}
+Fastcgipp::File::File(int fd) :
+#if defined(FASTCGIPP_WINDOWS)
+	m_fd(_dup(fd))
+#else
+	m_fd(::dup(fd))
+#endif
+{
+	if (m_fd == -1)
+		ERR_LOG("Unable to duplicate file descriptor " << fd << ": " \
+			<< std::strerror(errno))
+}
+Fastcgipp::File::~File()
+{
+	if (m_fd != -1)
+#if defined(FASTCGIPP_WINDOWS)
+		_close(m_fd);
+#else
+		::close(m_fd);
+#endif
+}
+ssize_t Fastcgipp::File::read(char* buffer, size_t size, uint64_t offset) const
+{
+#if defined(FASTCGIPP_WINDOWS)
+	if (_lseeki64(m_fd, offset, SEEK_SET) < 0)
+		return -1;
+	return _read(m_fd, buffer, static_cast<unsigned>(size));
+#else
+	return ::pread(m_fd, buffer, size, offset);
+#endif
+}
+bool Fastcgipp::Socket::enableZeroCopy() const
+{
+#if defined(FASTCGIPP_LINUX)
+	if (m_data->m_zeroCopy == ZeroCopy::UNTRIED)
+	{
+		const int on = 1;
+		if (setsockopt(
+			m_data->m_socket,
+			SOL_SOCKET,
+			SO_ZEROCOPY,
+			&on,
+			sizeof(on)) == 0)
+			m_data->m_zeroCopy = ZeroCopy::ON;
+		else
+		{
+			DIAG_LOG("Unable to set SO_ZEROCOPY on fd " << m_data->m_socket \
+				<< ": " << std::strerror(getLastSocketError()))
+			m_data->m_zeroCopy = ZeroCopy::UNAVAILABLE;
+		}
+	}
+	return m_data->m_zeroCopy == ZeroCopy::ON;
+#else
+	return false;
+#endif
+}
+bool Fastcgipp::Socket::reapZeroCopy() const
+{
+#if defined(FASTCGIPP_LINUX)
+	const ZeroCopy state = m_data->m_zeroCopy;
+	if (state != ZeroCopy::ON && state != ZeroCopy::COPYING)
+		return false;
+
+	bool reaped = false;
+	while (true)
+	{
+		char control[128];
+		msghdr message;
+		std::memset(&message, 0, sizeof(message));
+		message.msg_control = control;
+		message.msg_controllen = sizeof(control);
+		ssize_t count;
+		{
+			std::lock_guard<std::mutex> lock(m_data->m_mutex);
+			count = ::recvmsg(m_data->m_socket, &message, MSG_ERRQUEUE);
+		}
+		if (count < 0)
+			break;
+
+		for (cmsghdr* header = CMSG_FIRSTHDR(&message);
+			header != nullptr;
+			header = CMSG_NXTHDR(&message, header))
+		{
+			if (!(header->cmsg_level == SOL_IP
+					&& header->cmsg_type == IP_RECVERR)
+				&& !(header->cmsg_level == SOL_IPV6
+					&& header->cmsg_type == IPV6_RECVERR))
+				continue;
+			const sock_extended_err& error =
+				*reinterpret_cast<const sock_extended_err*>(CMSG_DATA(header));
+			if (error.ee_errno != 0
+				|| error.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				return false;
+
+			// The kernel had to copy the data after all so stop asking
+			if (error.ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+				m_data->m_zeroCopy = ZeroCopy::COPYING;
+
+			// Completions on a TCP socket come in order so everything up
+			// to the end of the range is done
+			const uint32_t done = error.ee_data + 1;
+			if (newer(done, m_data->m_zeroCopyDone))
+				m_data->m_zeroCopyDone = done;
+			reaped = true;
+		}
+	}
+	return reaped;
+#else
+	return false;
+#endif
+}
 void Fastcgipp::Socket::delayClose()const
 {
-	std::lock_guard<std::mutex> lock(m_sockDataMutex);
+	if (!valid())
+		return;
+	std::lock_guard<std::mutex> lock(m_data->m_mutex);
 	//shutdown(m_data->m_socket);
-	m_data->m_group.del(m_data->m_socket);
+	m_data->m_group.del(m_data->m_socket, m_data->m_generation);
 	//m_data->m_valid = false;
 #if FASTCGIPP_LOG_LEVEL > 3
 	if (!m_data->m_closing)
@@ -799,11 +1149,12 @@ void Fastcgipp::Socket::close() const
 	{
 		//WARNING_LOG("Socket " << m_data->m_socket << " ready to close")
 		//add by zhangc for transmit send and recv concurrent
-		std::lock_guard<std::mutex> lock(m_sockDataMutex);
+		std::lock_guard<std::mutex> lock(m_data->m_mutex);
 		shutdown(m_data->m_socket);
-		closesocket(m_data->m_socket);
-		m_data->m_valid = false;
-		m_data->m_group.m_sockets.erase(m_data->m_socket);
+		m_data->invalidate();
+		// The group closes the OS level socket so the identifier can't be
+		// reused while it still has it
+		m_data->m_group.del(m_data->m_socket, m_data->m_generation);
 #if FASTCGIPP_LOG_LEVEL > 3
 		if (!m_data->m_closing)
 			++m_data->m_group.m_connectionKillCount;
@@ -817,11 +1168,11 @@ Fastcgipp::Socket::~Socket()
 	if (m_original && valid())
 	{
 		//add by zhangc for transmit send and recv concurrent
-		std::lock_guard<std::mutex> lock(m_sockDataMutex);
+		std::lock_guard<std::mutex> lock(m_data->m_mutex);
 		shutdown(m_data->m_socket);
 		m_data->m_group.m_poll.del(m_data->m_socket);
 		closesocket(m_data->m_socket);
-		m_data->m_valid = false;
+		m_data->invalidate();
 	}
 }
 Fastcgipp::socket_t Fastcgipp::Socket::getHandle()const
@@ -844,11 +1195,21 @@ void Fastcgipp::Socket::Cleanup()
 }
 #endif
 
+std::atomic_uint_fast32_t Fastcgipp::Socket::Data::s_generation(0);
+
 Fastcgipp::SocketGroup::SocketGroup() :
 	m_waking(false),
 	m_reuse(false),
+	m_reusePort(false),
+	m_exclusiveListen(false),
+	m_acceptBatch(64),
+	m_handedOver(false),
 	m_accept(true),
-	m_refreshListeners(false)
+	m_refreshListeners(false),
+	m_socketCount(0),
+	m_ready(Poll::maxBatch),
+	m_readyIndex(0),
+	m_readyCount(0)
 #if FASTCGIPP_LOG_LEVEL > 3
 	, m_incomingConnectionCount(0),
 	m_outgoingConnectionCount(0),
@@ -861,23 +1222,29 @@ Fastcgipp::SocketGroup::SocketGroup() :
 	// Add our wakeup socket into the poll list
 #if defined(FASTCGIPP_WINDOWS)
 #else
-	//socketpair(AF_UNIX, SOCK_STREAM, 0, m_wakeSockets);
-	//m_poll.add(m_wakeSockets[1]);
+	socketpair(AF_UNIX, SOCK_STREAM, 0, m_wakeSockets);
+	m_poll.add(m_wakeSockets[1]);
 #endif
 	DIAG_LOG("SocketGroup::SocketGroup(): Initialized ")
 }
 
 Fastcgipp::SocketGroup::~SocketGroup()
 {
-	//Socket::closesocket(m_wakeSockets[0]);
-	//Socket::closesocket(m_wakeSockets[1]);
+#if ! defined(FASTCGIPP_WINDOWS)
+	closesocket(m_wakeSockets[0]);
+	closesocket(m_wakeSockets[1]);
+#endif
 	for (const auto& listener : m_listeners)
 	{
-		shutdown(listener);
+		if (m_sharedListeners.find(listener) != m_sharedListeners.end())
+			continue;
+		if (!m_handedOver)
+			shutdown(listener);
 		closesocket(listener);
 	}
-	for (const auto& filename : m_filenames)
-		std::remove(filename.c_str());
+	if (!m_handedOver)
+		for (const auto& filename : m_filenames)
+			std::remove(filename.c_str());
 
 	DIAG_LOG("SocketGroup::~SocketGroup(): Incoming sockets ======== " \
 		<< m_incomingConnectionCount)
@@ -888,26 +1255,24 @@ Fastcgipp::SocketGroup::~SocketGroup()
 		DIAG_LOG("SocketGroup::~SocketGroup(): Remotely closed sockets = " \
 			<< m_connectionRDHupCount)
 		DIAG_LOG("SocketGroup::~SocketGroup(): Remaining sockets ======= " \
-			<< m_sockets.size())
+			<< m_socketCount)
 		DIAG_LOG("SocketGroup::~SocketGroup(): Bytes sent ===== " << m_bytesSent)
 		DIAG_LOG("SocketGroup::~SocketGroup(): Bytes received = " \
 			<< m_bytesReceived)
 }
 void Fastcgipp::SocketGroup::wake()
 {
-	/*std::lock_guard<std::mutex> lock(m_wakingMutex);
+#if ! defined(FASTCGIPP_WINDOWS)
+	std::lock_guard<std::mutex> lock(m_wakingMutex);
 	if (!m_waking)
 	{
 		m_waking = true;
 		static const char x = 0;
-#if defined(FASTCGIPP_WINDOWS)
-		if (::send(m_wakeSockets[0], &x, 1,0) != 1)
-#else
-		if (write(m_wakeSockets[0], &x, 1) != 1)
-#endif
+		if (::write(m_wakeSockets[0], &x, 1) != 1)
 			FAIL_LOG("Unable to write to wakeup socket in SocketGroup: " \
 				<< std::strerror(getLastSocketError()))
-	}*/
+	}
+#endif
 }
 bool Fastcgipp::SocketGroup::listen()
 {
@@ -980,6 +1345,8 @@ bool Fastcgipp::SocketGroup::listen(
 			continue;
 		if (m_reuse)
 			set_reuse(fd);
+		if (m_reusePort)
+			set_reuseport(fd);
 		if (
 			bind(fd, i->ai_addr, i->ai_addrlen) == 0
 			&& ::listen(fd, 100) == 0)
@@ -996,6 +1363,15 @@ bool Fastcgipp::SocketGroup::listen(
 			return false;
 	}
 
+	// Connections are accepted until the backlog is empty
+	if (!setNonBlocking(fd))
+	{
+		ERR_LOG("Unable to set NONBLOCK on listen socket " << fd << ": " \
+			<< std::strerror(getLastSocketError()))
+		closesocket(fd);
+		return false;
+	}
+
 	if (m_listeners.find(fd) == m_listeners.end())
 	{
 		if (::listen(fd, 100) < 0)
@@ -1043,6 +1419,8 @@ bool Fastcgipp::SocketGroup::listen(
 	}
 	int fcgi_fd = ::socket(socket_type, SOCK_STREAM, 0);
 	set_reuse(fcgi_fd);
+	if (m_reusePort)
+		set_reuseport(fcgi_fd);
 	if (-1 == bind(fcgi_fd, fcgi_addr, servlen)) {
 		closesocket(fcgi_fd);
 		return -1;
@@ -1193,16 +1571,17 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::connect(
 	++m_outgoingConnectionCount;
 #endif
 
-	return m_sockets.emplace(
-		fd,
-		Socket(fd, *this)).first->second;
+	return insertSocket(fd);
 }
 
-Fastcgipp::Socket Fastcgipp::SocketGroup::poll(bool block)
+Fastcgipp::Socket Fastcgipp::SocketGroup::poll(bool block, int timeout)
 {
-	while (m_listeners.size() + m_sockets.size() > 0)
+	bool polled = false;
+	while (m_listeners.size() + m_socketCount > 0)
 	{
-		doAddDel();
+		// New connections may have given the caller something to time
+		if (doAddDel())
+			break;
 		if (m_refreshListeners)
 		{
 			for (auto& listener : m_listeners)
@@ -1210,7 +1589,10 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::poll(bool block)
 				m_poll.del(listener);
 				if (m_accept)
 				{
-					m_poll.add(listener);
+#if defined(FASTCGIPP_IO_URING)
+					if (!m_poll.accept(listener))
+#endif
+					m_poll.add(listener, m_exclusiveListen);
 				}
 				/*if (m_accept && !m_poll.add(listener))
 					FAIL_LOG("Unable to add listen socket " << listener \
@@ -1219,10 +1601,29 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::poll(bool block)
 			m_refreshListeners = false;
 		}
 
-		const auto result = m_poll.poll(block ? -1 : 0);
+		if (m_readyIndex == m_readyCount)
+		{
+			// With a timeout the caller has its own work to get back to
+			if (polled && timeout >= 0)
+				break;
+			polled = true;
+			m_readyIndex = 0;
+			m_readyCount = m_poll.poll(
+				m_ready.data(),
+				m_ready.size(),
+				block ? timeout : 0);
+		}
 
-		if (result)
+		if (m_readyIndex < m_readyCount)
 		{
+			const auto result = m_ready[m_readyIndex++];
+#if defined(FASTCGIPP_IO_URING)
+			if (result.accepted() != -1)
+			{
+				accepted(result.accepted());
+				continue;
+			}
+#endif
 			if (m_listeners.find(result.socket()) != m_listeners.end())
 			{
 				if (result.onlyIn())
@@ -1238,20 +1639,17 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::poll(bool block)
 					FAIL_LOG("Got a weird event 0x" << std::hex \
 						<< result.events() << " on listen poll.")
 			}
-			/*else if (result.socket() == m_wakeSockets[1])
+#if ! defined(FASTCGIPP_WINDOWS)
+			else if (result.socket() == m_wakeSockets[1])
 			{
 				if (result.onlyIn())
 				{
 					std::lock_guard<std::mutex> lock(m_wakingMutex);
 					char x[256];
-#if defined(FASTCGIPP_WINDOWS)
-					if (recv(m_wakeSockets[1], x, 256,0) < 1)
-#else
 					if (read(m_wakeSockets[1], x, 256) < 1)
-#endif
 						FAIL_LOG("Unable to read out of SocketGroup wakeup socket: " << \
 							std::strerror(getLastSocketError()))
-						m_waking = false;
+					m_waking = false;
 					block = false;
 					continue;
 				}
@@ -1259,37 +1657,60 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::poll(bool block)
 					FAIL_LOG("The SocketGroup wakeup socket hung up.")
 				else if (result.err())
 					FAIL_LOG("Error in the SocketGroup wakeup socket.")
-			}*/
+			}
+#endif
 			else
 			{
-				const auto socket = m_sockets.find(result.socket());
-				if (socket == m_sockets.end())
+				Socket* const socket = findSocket(result.socket());
+				if (socket == nullptr)
 				{
-					ERR_LOG("Poll gave fd " << result.socket() \
+					// Sockets closed while an earlier event in the same
+					// batch was being handled are expected here
+					DEBUG_LOG("Poll gave fd " << result.socket() \
 						<< " which isn't in m_sockets.")
 					m_poll.del(result.socket());
 					//closesocket(result.socket());
 					continue;
 				}
 
+				// Zero copy completions are reported as an error
+				bool err = result.err();
+				if (err && socket->reapZeroCopy())
+				{
+					err = false;
+					if (m_zeroCopied)
+						m_zeroCopied(*socket);
+					if (!(result.in() || result.hup() || result.out()))
+						continue;
+				}
+
+				if (result.out())
+				{
+					m_poll.pollOut(result.socket(), false);
+					if (m_writable)
+						m_writable(*socket);
+					if (!(result.in() || result.hup() || err))
+						continue;
+				}
+
 				if (result.rdHup())
-					socket->second.m_data->m_closing = true;
+					socket->m_data->m_closing = true;
 				else if (result.hup())
 				{
 					WARNING_LOG("Socket " << result.socket() << " hung up")
-					socket->second.m_data->m_closing = true;
+					socket->m_data->m_closing = true;
 				}
-				else if (result.err())
+				else if (err)
 				{
 					ERR_LOG("Error in socket " << result.socket())
-					socket->second.m_data->m_closing = true;
+					socket->m_data->m_closing = true;
 				}
 				else if (!result.in())
 				{
 					FAIL_LOG("Got a weird event 0x" << std::hex \
 						<< result.events() << " on socket poll.")
 				}
-				return socket->second;
+				return *socket;
 			}
 		}
 		break;
@@ -1374,6 +1795,15 @@ bool Fastcgipp::SocketGroup::listen(
         return false;
     }
 
+    // Connections are accepted until the backlog is empty
+    if(!setNonBlocking(fd))
+    {
+        ERR_LOG("Unable to set NONBLOCK on unix socket \"" << name << "\": " \
+                << std::strerror(getLastSocketError()));
+        close(fd);
+        return false;
+    }
+
     m_filenames.emplace_back(name);
     m_listeners.insert(fd);
     m_refreshListeners = true;
@@ -1382,84 +1812,408 @@ bool Fastcgipp::SocketGroup::listen(
 #endif
 void Fastcgipp::SocketGroup::createSocket(const socket_t listener)
 {
+	for (unsigned count = 0; count < m_acceptBatch; ++count)
+	{
+		// Leave the backlog alone once we've stopped accepting. Whoever else
+		// is listening on the socket will take the connections.
+		if (!m_accept)
+			return;
 #if defined(FASTCGIPP_WINDOWS)
-	sockaddr_in addr;
-	socklen_t addrlen = sizeof(sockaddr_in);
+		sockaddr_in addr;
+		socklen_t addrlen = sizeof(sockaddr_in);
 #else
-	sockaddr_un addr;
-	socklen_t addrlen = sizeof(sockaddr_un);
+		sockaddr_un addr;
+		socklen_t addrlen = sizeof(sockaddr_un);
+#endif
+#if defined(FASTCGIPP_LINUX)
+		const socket_t socket = ::accept4(
+			listener,
+			reinterpret_cast<sockaddr*>(&addr),
+			&addrlen,
+			SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+		const socket_t socket = ::accept(
+			listener,
+			reinterpret_cast<sockaddr*>(&addr),
+			&addrlen);
+#endif
+		if (socket < 0)
+		{
+			const int lastError = getLastSocketError();
+#if defined(FASTCGIPP_WINDOWS)
+			if (lastError != WSAEWOULDBLOCK)
+#else
+			// The backlog is empty or another group sharing the listener
+			// beat us to the connection
+			if (lastError != EAGAIN && lastError != EWOULDBLOCK)
+#endif
+				ERR_LOG("Unable to accept() with fd " \
+					<< listener << ": " \
+					<< std::strerror(lastError))
+			return;
+		}
+#if ! defined(FASTCGIPP_LINUX)
+		if (!setNonBlocking(socket))
+		{
+			ERR_LOG("Unable to set NONBLOCK on fd " << socket \
+				<< std::strerror(getLastSocketError()))
+			closesocket(socket);
+			continue;
+		}
 #endif
-	const socket_t socket = ::accept(
-		listener,
-		reinterpret_cast<sockaddr*>(&addr),
-		&addrlen);
-	if (socket < 0)
-	{
-		ERR_LOG("Unable to accept() with fd " \
-			<< listener << ": " \
-			<< std::strerror(getLastSocketError()))
-		return;
-	}
-	if (!setNonBlocking(socket))
-	{
-		ERR_LOG("Unable to set NONBLOCK on fd " << socket \
-			<< std::strerror(getLastSocketError()))
-		closesocket(socket);
-		return;
-	}
-	if (m_accept)
-	{
 		/*m_sockets.emplace(
 			socket,
 			Socket(socket, *this));*/
-		add(socket);
+		accepted(socket);
+	}
+}
+void Fastcgipp::SocketGroup::accepted(const socket_t socket)
+{
+	add(socket);
 #if FASTCGIPP_LOG_LEVEL > 3
-		++m_incomingConnectionCount;
+	++m_incomingConnectionCount;
+	{
+		sockaddr_in addrPeer;
+		socklen_t addrlen = sizeof(sockaddr_in);
+		if (0 == getpeername(socket, (sockaddr*)&addrPeer, &addrlen))
 		{
-			sockaddr_in addrPeer;
-			socklen_t addrlen = sizeof(sockaddr_in);
-			int nAddrLen = sizeof(addrPeer);
-			if (0 == getpeername(socket, (sockaddr*)&addrPeer, &nAddrLen))
-			{
-				char cB[INET_ADDRSTRLEN] = { 0 };
-				DEBUG_LOG("new Connection from " << inet_ntop(AF_INET, &addrPeer.sin_addr, cB, sizeof(cB))
-					<< ":" << ntohs(addrPeer.sin_port));
-				DEBUG_LOG(" Connection Count:"<<m_incomingConnectionCount);
-			}
+			char cB[INET_ADDRSTRLEN] = { 0 };
+			DEBUG_LOG("new Connection from " << inet_ntop(AF_INET, &addrPeer.sin_addr, cB, sizeof(cB))
+				<< ":" << ntohs(addrPeer.sin_port));
+			DEBUG_LOG(" Connection Count:"<<m_incomingConnectionCount);
 		}
+	}
 #endif
+}
+bool Fastcgipp::SocketGroup::share(socket_t listener)
+{
+	if (m_listeners.find(listener) != m_listeners.end())
+	{
+		ERR_LOG("Socket " << listener << " already being listened to")
+		return false;
 	}
-	else
-		closesocket(socket);
+	if (!setNonBlocking(listener))
+	{
+		ERR_LOG("Unable to set NONBLOCK on shared listen socket " << listener \
+			<< ": " << std::strerror(getLastSocketError()))
+		return false;
+	}
+	m_listeners.insert(listener);
+	m_sharedListeners.insert(listener);
+	m_refreshListeners = true;
+	return true;
+}
+#if ! defined(FASTCGIPP_WINDOWS)
+bool Fastcgipp::SocketGroup::adopt(socket_t listener)
+{
+	if (m_listeners.find(listener) != m_listeners.end())
+	{
+		ERR_LOG("Socket " << listener << " already being listened to")
+		return false;
+	}
+	if (!setNonBlocking(listener))
+	{
+		ERR_LOG("Unable to set NONBLOCK on adopted listen socket " \
+			<< listener << ": " << std::strerror(getLastSocketError()))
+		return false;
+	}
+
+	// Named sockets are cleaned up by whoever owns them last
+	sockaddr_un address;
+	socklen_t length = sizeof(address);
+	if (getsockname(
+			listener,
+			reinterpret_cast<sockaddr*>(&address),
+			&length) == 0
+		&& address.sun_family == AF_UNIX
+		&& length > offsetof(sockaddr_un, sun_path)
+		&& address.sun_path[0] != '\0')
+		m_filenames.emplace_back(
+			address.sun_path,
+			strnlen(
+				address.sun_path,
+				length - offsetof(sockaddr_un, sun_path)));
+
+	m_listeners.insert(listener);
+	m_refreshListeners = true;
+	return true;
+}
+
+void Fastcgipp::SocketGroup::handOver()
+{
+	m_handedOver = true;
+}
+
+bool Fastcgipp::sendSockets(
+	socket_t channel,
+	const std::vector<socket_t>& sockets)
+{
+	uint32_t count = static_cast<uint32_t>(sockets.size());
+	iovec data;
+	data.iov_base = &count;
+	data.iov_len = sizeof(count);
+
+	std::vector<cmsghdr> control(
+		(CMSG_SPACE(sizeof(int)*count) + sizeof(cmsghdr) - 1)
+		/ sizeof(cmsghdr));
+	msghdr message;
+	std::memset(&message, 0, sizeof(message));
+	message.msg_iov = &data;
+	message.msg_iovlen = 1;
+	if (count > 0)
+	{
+		message.msg_control = control.data();
+		message.msg_controllen = CMSG_SPACE(sizeof(int)*count);
+		cmsghdr* const header = CMSG_FIRSTHDR(&message);
+		header->cmsg_level = SOL_SOCKET;
+		header->cmsg_type = SCM_RIGHTS;
+		header->cmsg_len = CMSG_LEN(sizeof(int)*count);
+		std::memcpy(CMSG_DATA(header), sockets.data(), sizeof(int)*count);
+	}
+
+	ssize_t sent;
+	do
+		sent = ::sendmsg(channel, &message, 0);
+	while (sent < 0 && errno == EINTR);
+	if (sent != sizeof(count))
+	{
+		ERR_LOG("Unable to send " << count << " sockets through fd " \
+			<< channel << ": " << std::strerror(getLastSocketError()))
+		return false;
+	}
+	return true;
+}
+
+bool Fastcgipp::receiveSockets(socket_t channel, std::vector<socket_t>& sockets)
+{
+	// The most descriptors the kernel will pass in a single message
+	const unsigned maxSockets = 253;
+
+	uint32_t count = 0;
+	iovec data;
+	data.iov_base = &count;
+	data.iov_len = sizeof(count);
+
+	std::vector<cmsghdr> control(
+		(CMSG_SPACE(sizeof(int)*maxSockets) + sizeof(cmsghdr) - 1)
+		/ sizeof(cmsghdr));
+	msghdr message;
+	std::memset(&message, 0, sizeof(message));
+	message.msg_iov = &data;
+	message.msg_iovlen = 1;
+	message.msg_control = control.data();
+	message.msg_controllen = CMSG_SPACE(sizeof(int)*maxSockets);
+
+	ssize_t received;
+	do
+#if defined(FASTCGIPP_LINUX)
+		received = ::recvmsg(channel, &message, MSG_CMSG_CLOEXEC);
+#else
+		received = ::recvmsg(channel, &message, 0);
+#endif
+	while (received < 0 && errno == EINTR);
+	if (received != sizeof(count))
+	{
+		ERR_LOG("Unable to receive sockets through fd " << channel << ": " \
+			<< (received<0?std::strerror(getLastSocketError()):"short read"))
+		return false;
+	}
+
+	const size_t before = sockets.size();
+	for (cmsghdr* header = CMSG_FIRSTHDR(&message);
+		header != nullptr;
+		header = CMSG_NXTHDR(&message, header))
+	{
+		if (header->cmsg_level != SOL_SOCKET
+			|| header->cmsg_type != SCM_RIGHTS)
+			continue;
+		const size_t passed = (header->cmsg_len - CMSG_LEN(0))/sizeof(int);
+		const int* const fds = reinterpret_cast<const int*>(CMSG_DATA(header));
+		sockets.insert(sockets.end(), fds, fds+passed);
+	}
+
+	if (message.msg_flags & MSG_CTRUNC || sockets.size()-before != count)
+	{
+		ERR_LOG("Expected " << count << " sockets through fd " << channel \
+			<< " but got " << sockets.size()-before)
+		for (auto socket = sockets.begin()+before;
+			socket != sockets.end();
+			++socket)
+			closesocket(*socket);
+		sockets.resize(before);
+		return false;
+	}
+	return true;
 }
-void Fastcgipp::SocketGroup::doAddDel()
+#endif
+bool Fastcgipp::SocketGroup::doAddDel()
 {
+	bool opened = false;
 	std::lock_guard<std::mutex> lock(m_pollMutex);
 	for (auto iter = m_ready2DoSock.begin(); iter != m_ready2DoSock.end(); ++iter)
 	{
 		if (iter->second)
 		{
-			m_sockets.emplace(iter->first, Socket(iter->first, *this));
-			m_poll.add(iter->first);
+			const Socket& socket = insertSocket(iter->first.socket());
+#if defined(FASTCGIPP_IO_URING)
+			socket.m_data->m_buffered = m_poll.receive(socket.m_data->m_socket);
+			if (!socket.m_data->m_buffered)
+#endif
+			m_poll.add(iter->first.socket());
+			if (m_opened)
+			{
+				m_opened(socket);
+				opened = true;
+			}
 		}
 		else
-		{
-			m_sockets.erase(iter->first);
-			m_poll.del(iter->first);
-			shutdown(iter->first);
-			closesocket(iter->first);
-		}
+			eraseSocket(iter->first.socket(), iter->first.generation());
 	}
 	m_ready2DoSock.clear();
+	for (const auto socket : m_pollWrite)
+		if (findSocket(socket) != nullptr)
+			m_poll.pollOut(socket, true);
+	m_pollWrite.clear();
+	return opened;
+}
+Fastcgipp::Socket& Fastcgipp::SocketGroup::insertSocket(const socket_t socket)
+{
+	if (static_cast<size_t>(socket) >= m_sockets.size())
+		m_sockets.resize(socket + 1);
+	Socket& slot = m_sockets[socket];
+	if (!slot.m_data)
+		++m_socketCount;
+	slot = Socket(socket, *this);
+	return slot;
+}
+void Fastcgipp::SocketGroup::eraseSocket(
+	const socket_t socket,
+	uint32_t generation)
+{
+	// Sockets not in the group have already been closed and their
+	// identifier may have been reused so leave them be
+	Socket* const slot = findSocket(socket);
+	if (slot == nullptr || slot->m_data->m_generation != generation)
+		return;
+	if (m_closed)
+		m_closed(*slot);
+	m_poll.del(socket);
+	shutdown(socket);
+	closesocket(socket);
+	// Whatever is left of the batch polled for it would otherwise be taken
+	// for events on the next socket to get the identifier
+	m_readyCount = std::remove_if(
+		m_ready.begin() + m_readyIndex,
+		m_ready.begin() + m_readyCount,
+		[socket](const Poll::Result& result)
+		{
+			return result.socket() == socket;
+		}) - m_ready.begin();
+	slot->m_data->invalidate();
+	*slot = Socket();
+	--m_socketCount;
 }
 void Fastcgipp::SocketGroup::add(const socket_t socket)
 {
 	std::lock_guard<std::mutex> lock(m_pollMutex);
-	m_ready2DoSock.push_back(std::make_pair(socket, true));
+	m_ready2DoSock.push_back(std::make_pair(SocketId(socket, 0), true));
 }
-void Fastcgipp::SocketGroup::del(const socket_t socket)
+void Fastcgipp::SocketGroup::pollWrite(const Socket& socket)
 {
-	std::lock_guard<std::mutex> lock(m_pollMutex);
-	m_ready2DoSock.push_back(std::make_pair(socket, false));
+	if (!socket.valid())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(m_pollMutex);
+		m_pollWrite.push_back(socket.getHandle());
+	}
+	wake();
+}
+void Fastcgipp::SocketGroup::write(const std::vector<Write*>& writes)
+{
+#if defined(FASTCGIPP_IO_URING)
+	if (writes.size() > 1 && m_poll.sending())
+	{
+		std::vector<Poll::Send> sends;
+		std::vector<std::vector<iovec>> buffers(writes.size());
+		std::vector<msghdr> messages(writes.size());
+		std::vector<Write*> sending;
+		sends.reserve(writes.size());
+		sending.reserve(writes.size());
+		for (auto write : writes)
+		{
+			write->sent = 0;
+			if (!write->socket.valid() || write->socket.m_data->m_closing)
+				write->sent = -1;
+			else if (!write->chunks.empty())
+			{
+				const size_t i = sending.size();
+				sends.push_back(Poll::Send{
+					write->socket.m_data->m_socket,
+					&messages[i],
+					write->socket.gather(
+						write->chunks,
+						write->zeroCopy,
+						write->more,
+						buffers[i],
+						messages[i]),
+					0});
+				sending.push_back(write);
+			}
+		}
+		if (sending.empty())
+			return;
+
+		for (auto write : sending)
+			write->socket.m_data->m_mutex.lock();
+		if (m_poll.send(sends.data(), sends.size()))
+		{
+			for (size_t i = 0; i < sending.size(); ++i)
+			{
+				const Socket& socket = sending[i]->socket;
+				if (sends[i].result < 0)
+					errno = -sends[i].result;
+				const ssize_t count = socket.sent(
+					sends[i].result,
+					messages[i],
+					sends[i].flags);
+				const int lastError = errno;
+				socket.m_data->m_mutex.unlock();
+				errno = lastError;
+				sending[i]->sent = socket.written(count);
+			}
+			return;
+		}
+		for (auto write : sending)
+			write->socket.m_data->m_mutex.unlock();
+		for (auto write : sending)
+			write->sent = write->socket.write(
+				write->chunks,
+				write->zeroCopy,
+				write->more);
+		return;
+	}
+#endif
+	for (auto write : writes)
+		write->sent = write->socket.write(
+			write->chunks,
+			write->zeroCopy,
+			write->more);
+}
+unsigned Fastcgipp::SocketGroup::writeBatch() const
+{
+#if defined(FASTCGIPP_IO_URING)
+	if (m_poll.sending())
+		return Poll::maxSends;
+#endif
+	return 1;
+}
+void Fastcgipp::SocketGroup::del(const socket_t socket, uint32_t generation)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_pollMutex);
+		m_ready2DoSock.push_back(
+			std::make_pair(SocketId(socket, generation), false));
+	}
+	wake();
 }
 
@@ -29,6 +29,8 @@
 #include "fastcgi++/transceiver.hpp"
 
 #include "fastcgi++/log.hpp"
+#include "fastcgi++/affinity.hpp"
+#include <algorithm>
 #if ! defined(FASTCGIPP_WINDOWS)
 #include <unistd.h>
 #endif
@@ -82,219 +84,588 @@
 	}
 	return true;
 }*/
-bool Fastcgipp::Transceiver::transmit()
+
+const char Fastcgipp::Transceiver::s_padding[Protocol::chunkSize] = {};
+
+bool Fastcgipp::Transceiver::transmit(Reactor& reactor)
 {
-	int nCountDDD=0;
-	socket_t lastSocket=-1;
-	std::set<Socket> eraseRecvBufferSock;
-	while(!m_sendBuffer.empty())
+	Connection* stack;
+	while((stack = reactor.ready.exchange(nullptr)) != nullptr)
 	{
-		if(m_sendBufferSize < m_maxSendBufferSize)
+		// Flip the stack over so connections are served in the order they
+		// became ready
+		Connection* next = nullptr;
+		while(stack != nullptr)
+		{
+			Connection* const connection = stack;
+			stack = connection->nextReady;
+			connection->nextReady = next;
+			next = connection;
+		}
+
+		while(next != nullptr)
 		{
-			std::unique_ptr<Record> record;
+			Connection& connection = *next;
+			next = connection.nextReady;
+			// Anything pushed after we collect below puts it back in a list
+			connection.ready = false;
+
+			std::unique_lock<std::mutex> lock(connection.mutex);
+			collect(connection);
+			if(connection.records.empty())
+				continue;
+			if(connection.socket.group() != &reactor.socketGroup)
 			{
-				std::lock_guard<std::mutex> lock(m_sendBufferMutex);
-				std::map<socket_t,std::list<std::unique_ptr<Record>>>::const_iterator iter;
-				if(lastSocket == -1)
-				{
-					iter=m_sendBuffer.begin();
-				}
-				else
-				{
-					iter=m_sendBuffer.lower_bound(lastSocket);
-					if(iter == m_sendBuffer.end())
-					{
-						iter=m_sendBuffer.begin();
-					}
-					else
-					{
-						if(iter->first == lastSocket)//if not equal,direct use nextsocket
-						{
-							++iter;
-						}
-						if(iter == m_sendBuffer.end())
-						{
-							iter=m_sendBuffer.begin();
-						}
-					}
-				}
-				lastSocket=iter->first;
-				nCountDDD=iter->second.size();
-				++nCountDDD;
-				--nCountDDD;
-				record = std::move(m_sendBuffer[lastSocket].front());
-				m_sendBuffer[lastSocket].pop_front();
-				if(m_sendBuffer[lastSocket].empty())
-				{
-					m_sendBuffer.erase(lastSocket);
-				}
+				// The identifier was reused by a connection on another
+				// reactor since it was queued
+				ready(this->reactor(connection.socket), connection);
+				continue;
 			}
-			ssize_t sent =-1;
-			int dataSize = record->data.end()-record->read;
-			while(record->read != record->data.end())
+			if(connection.blocked)
+				continue;
+
+			if(reactor.batch.size() == reactor.batched)
+				reactor.batch.emplace_back();
+			Transmission& transmission = reactor.batch[reactor.batched];
+			std::vector<Socket::Chunk>& chunks = transmission.write.chunks;
+
+			// Gather what is queued for this socket up to its deficit,
+			// stopping after a record that kills the connection. File records
+			// go out on their own.
+			connection.deficit += s_quantum;
+			chunks.clear();
+			const Record* file=nullptr;
+			const size_t threshold = m_zeroCopyThreshold;
+			bool zeroCopy=false;
+			bool push=false;
+			size_t gathered=0;
+			for(const auto& record: connection.records)
 			{
-				sent = record->socket.write(
-					record->read,
-					record->data.end()-record->read);
-				if(sent < 0)
+				if(record->file && record->length != 0)
 				{
+					if(chunks.empty())
+						file = record.get();
 					break;
 				}
-				if(sent == 0)
-				{
-					continue;
-				}
-				record->read+=sent;
+				// Large records are gathered separately from small ones
+				const bool large =
+					threshold != 0 && record->data.size() >= threshold;
+				const size_t size = record->remaining();
+				if(!chunks.empty() && (large != zeroCopy
+							|| gathered+size > connection.deficit))
+					break;
+				zeroCopy = large;
+				// All that's left of a file record is its padding
+				chunks.emplace_back(
+						record->file? s_padding: record->read,
+						size);
+				push = record->push;
+				gathered += size;
+				if(record->kill || chunks.size() == s_maxGather)
+					break;
 			}
-			m_sendBufferSize-=dataSize;
-			if(sent < 0)
+
+			transmission.connection = &connection;
+			transmission.file = file;
+			transmission.zeroCopySent = connection.socket.zeroCopySent();
+			transmission.write.socket = connection.socket;
+			transmission.write.zeroCopy = zeroCopy;
+			transmission.write.more = m_cork && !push;
+			if(file)
 			{
-				record->socket.close(); //record->socket.delayClose();//record->socket.close();
-				std::lock_guard<std::mutex> lock(m_sendBufferMutex);
-				std::list<std::unique_ptr<Record>> &listRecord=m_sendBuffer[lastSocket];
-				for(auto iterList=listRecord.begin();iterList != listRecord.end();++iterList)
-				{
-					m_sendBufferSize-=(*iterList)->data.end()-(*iterList)->read;
-				}
-				m_sendBuffer.erase(lastSocket);
-				eraseRecvBufferSock.insert(record->socket);
+				transmission.write.sent = connection.socket.write(
+						*file->file,
+						file->offset,
+						file->length);
+				retire(reactor, transmission);
+				transmission.write.socket = Socket();
 				continue;
 			}
+
+			// The connection stays locked until its write is retired
+			transmission.lock = std::move(lock);
+			if(++reactor.batched == reactor.socketGroup.writeBatch())
+				flush(reactor);
+		}
+
+		// Anything put back in the ready list comes around in the next stack
+		// so a connection is never in the batch twice
+		flush(reactor);
+	}
+	return true;
+}
+
+void Fastcgipp::Transceiver::flush(Reactor& reactor)
+{
+	if(reactor.batched == 0)
+		return;
+
+	reactor.writes.clear();
+	for(unsigned i=0; i<reactor.batched; ++i)
+		reactor.writes.push_back(&reactor.batch[i].write);
+	reactor.socketGroup.write(reactor.writes);
+
+	for(unsigned i=0; i<reactor.batched; ++i)
+	{
+		Transmission& transmission = reactor.batch[i];
+		retire(reactor, transmission);
+		transmission.lock.unlock();
+		transmission.write.socket = Socket();
+	}
+	reactor.batched = 0;
+}
+
+void Fastcgipp::Transceiver::retire(
+		Reactor& reactor,
+		Transmission& transmission)
+{
+	Connection& connection = *transmission.connection;
+	const Record* const file = transmission.file;
+	ssize_t sent = transmission.write.sent;
+	if(sent < 0)
+	{
+		connection.socket.close();
+		dropRecords(connection);
+		connection.pinned.clear();
+		connection.lingering=false;
+		return;
+	}
+	const bool pinned =
+		connection.socket.zeroCopySent()!=transmission.zeroCopySent;
+	dequeued(connection, sent);
+	connection.deficit = static_cast<size_t>(sent)<connection.deficit?
+		connection.deficit-sent : 0;
+
+	// Retire every record that made it out and advance into the first
+	// one that didn't
+	bool kill=false;
+	bool full=false;
+	const size_t written = file? 1 : transmission.write.chunks.size();
+	for(size_t i=0; i<written; ++i)
+	{
+		Record& record = *connection.records.front();
+		const size_t remaining = record.remaining();
+		if(pinned && sent != 0)
+		{
+			record.pinned = true;
+			record.release = connection.socket.zeroCopySent();
+		}
+		if(static_cast<size_t>(sent) < remaining)
+		{
+			record.advance(sent);
+			// Only the file itself was written so its padding may be
+			// all that's left
+			full = !file || record.length != 0;
+			break;
+		}
+		sent -= remaining;
+		kill = record.kill;
 #if FASTCGIPP_LOG_LEVEL > 3
-			++m_recordsSent;
+		++m_recordsSent;
 #endif
-			if(record->kill)//after send response close socket,no new request
-			{
-				std::lock_guard<std::mutex> lock(m_sendBufferMutex);
-				std::list<std::unique_ptr<Record>> &listRecord=m_sendBuffer[lastSocket];
-				for(auto iterList=listRecord.begin();iterList != listRecord.end();++iterList)
-				{
-					m_sendBufferSize-=(*iterList)->data.end()-(*iterList)->read;
-				}
-				m_sendBuffer.erase(lastSocket);
-				record->socket.delayClose();//record->socket.close();
-				eraseRecvBufferSock.insert(record->socket);
+		if(record.pinned)
+			connection.pinned.push_back(
+					std::move(connection.records.front()));
+		connection.records.pop_front();
+	}
+
+	if(full)
+	{
+		// The socket is full. Let the poll tell us when we can
+		// continue.
+		connection.blocked=true;
+		connection.deficit=0;
+		reactor.socketGroup.pollWrite(connection.socket);
+		return;
+	}
+
+	if(kill)//after send response close socket,no new request
+	{
+		dropRecords(connection);
+		// Closing now could have the kernel send memory we've
+		// already reused
+		if(connection.pinned.empty())
+			connection.socket.delayClose();
+		else
+			connection.lingering=true;
 #if FASTCGIPP_LOG_LEVEL > 3
-				++m_connectionKillCount;
+		++m_connectionKillCount;
 #endif
+		return;
+	}
+
+	// Anything left goes to the back of the line
+	if(connection.records.empty())
+		connection.deficit=0;
+	else
+		ready(reactor, connection);
+}
+
+void Fastcgipp::Transceiver::dropRecords(Connection& connection)
+{
+	size_t bytes=0;
+	for(const auto& record: connection.records)
+		bytes += record->remaining();
+	connection.records.clear();
+	dequeued(connection, bytes);
+	connection.blocked=false;
+	connection.deficit=0;
+}
+
+bool Fastcgipp::Transceiver::throttled(const Connection& connection) const
+{
+	const size_t queued = connection.queued;
+	if(queued == 0)
+		return false;
+	if(queued >= static_cast<size_t>(m_maxConnectionBufferSize))
+		return true;
+	if(m_sendBufferSize < static_cast<size_t>(m_maxSendBufferSize))
+		return false;
+	const unsigned busy = m_busyConnections;
+	return queued >= static_cast<size_t>(m_maxSendBufferSize)/(busy?busy:1);
+}
+
+void Fastcgipp::Transceiver::dequeued(Connection& connection, size_t bytes)
+{
+	if(bytes == 0)
+		return;
+	m_sendBufferSize -= bytes;
+	if(connection.queued.fetch_sub(bytes) == bytes)
+		--m_busyConnections;
+	if(m_waiting != 0)
+	{
+		std::lock_guard<std::mutex> lock(m_drainedMutex);
+		m_drained.notify_all();
+	}
+}
+
+void Fastcgipp::Transceiver::writable(Reactor& reactor, const Socket& socket)
+{
+	Connection* const connection = this->connection(socket.getHandle());
+	if(connection == nullptr)
+		return;
+	std::lock_guard<std::mutex> lock(connection->mutex);
+	if(connection->generation != socket.generation())
+		return;
+	connection->blocked=false;
+	ready(reactor, *connection);
+}
+
+void Fastcgipp::Transceiver::zeroCopied(const Socket& socket)
+{
+	Connection* const connection = this->connection(socket.getHandle());
+	if(connection == nullptr)
+		return;
+	std::lock_guard<std::mutex> lock(connection->mutex);
+	if(connection->generation != socket.generation())
+		return;
+	unpin(*connection);
+}
+
+void Fastcgipp::Transceiver::unpin(Connection& connection)
+{
+	while(!connection.pinned.empty()
+			&& connection.socket.zeroCopied(connection.pinned.front()->release))
+		connection.pinned.pop_front();
+
+	if(connection.lingering && connection.pinned.empty())
+	{
+		connection.lingering=false;
+		connection.socket.delayClose();
+	}
+}
+
+Fastcgipp::Transceiver::Connection* Fastcgipp::Transceiver::connection(
+		socket_t socket)
+{
+	const size_t index = static_cast<size_t>(socket);
+	const size_t page = index/s_connectionPage;
+	if(page >= s_connectionPages)
+		return nullptr;
+
+	Connection* connections = m_connections[page].load(
+			std::memory_order_acquire);
+	if(connections == nullptr)
+	{
+		Connection* const fresh = new Connection[s_connectionPage];
+		if(m_connections[page].compare_exchange_strong(
+					connections,
+					fresh,
+					std::memory_order_acq_rel))
+			connections = fresh;
+		else
+			delete[] fresh;
+	}
+	return connections + index%s_connectionPage;
+}
+
+bool Fastcgipp::Transceiver::claim(
+		Connection& connection,
+		const Socket& socket)
+{
+	const uint32_t generation = socket.generation();
+	if(connection.generation == generation)
+		return true;
+	if(connection.generation != 0
+			&& !Socket::newer(generation, connection.generation))
+		return false;
+
+	dropRecords(connection);
+	connection.pinned.clear();
+	connection.lingering=false;
+	connection.socket = socket;
+	connection.generation = generation;
+	connection.reactor = &reactor(socket);
+	connection.requests = 0;
+	return true;
+}
+
+bool Fastcgipp::Transceiver::attach(
+		Reactor& reactor,
+		Connection& connection,
+		const Socket& socket)
+{
+	if(connection.receiveGeneration != 0
+			&& !Socket::newer(
+				socket.generation(),
+				connection.receiveGeneration))
+		return false;
+	connection.receiveBuffer.clear();
+	connection.receiveGeneration = socket.generation();
+	connection.requestTimers.clear();
+	connection.requestsEnded = false;
+	connection.overloaded = false;
+	connection.rejected.clear();
+	connection.receiveTimer.onExpire(std::bind(
+				&Transceiver::expired,
+				this,
+				std::ref(reactor),
+				std::ref(connection)));
+
+	{
+		// Claim the slot so anything sent back can find the socket
+		std::lock_guard<std::mutex> lock(connection.mutex);
+		connection.endedRequests.clear();
+		if(!claim(connection, socket))
+			return false;
+	}
+	deadline(reactor, connection, Deadline::IDLE);
+	return true;
+}
+
+void Fastcgipp::Transceiver::opened(Reactor& reactor, const Socket& socket)
+{
+	const unsigned connections = ++m_connectionCount;
+	Connection* const connection = this->connection(socket.getHandle());
+	if(connection != nullptr && connection->receiveGeneration != socket.generation())
+	{
+		attach(reactor, *connection, socket);
+		const unsigned limit = m_maxConnections;
+		connection->overloaded = limit != 0 && connections > limit;
+	}
+}
+
+void Fastcgipp::Transceiver::closed(const Socket& socket)
+{
+	--m_connectionCount;
+	Connection* const connection = this->connection(socket.getHandle());
+	if(connection == nullptr
+			|| connection->receiveGeneration != socket.generation())
+		return;
+	connection->receiveTimer.cancel();
+	connection->requestTimers.clear();
+	connection->deadline = Deadline::IDLE;
+	// Don't sit on a whole receive buffer until the identifier is reused
+	connection->receiveBuffer = Block();
+}
+
+void Fastcgipp::Transceiver::deadline(
+		Reactor& reactor,
+		Connection& connection,
+		Deadline deadline)
+{
+	connection.deadline = deadline;
+	unsigned timeout=0;
+	switch(deadline)
+	{
+		case Deadline::IDLE:
+			timeout = m_idleTimeout;
+			break;
+		case Deadline::HEADER:
+			timeout = m_headerTimeout;
+			break;
+		case Deadline::BODY:
+			timeout = m_bodyTimeout;
+			break;
+	}
+	if(timeout == 0)
+		connection.receiveTimer.cancel();
+	else
+		reactor.wheel.arm(
+				connection.receiveTimer,
+				std::chrono::milliseconds(timeout));
+}
+
+void Fastcgipp::Transceiver::expired(Reactor& reactor, Connection& connection)
+{
+	Socket socket;
+	{
+		std::lock_guard<std::mutex> lock(connection.mutex);
+		if(connection.generation != connection.receiveGeneration)
+			return;
+		socket = connection.socket;
+	}
+
+	switch(connection.deadline)
+	{
+		case Deadline::IDLE:
+			if(connection.requests != 0 || connection.queued != 0)
+			{
+				// Quiet, but only because a request is still being worked on
+				deadline(reactor, connection, Deadline::IDLE);
+				return;
 			}
+			DEBUG_LOG("Closing idle socket " << socket.getHandle())
+			break;
+		case Deadline::HEADER:
+			WARNING_LOG("Timed out receiving a record header on socket " \
+					<< socket.getHandle())
+			break;
+		case Deadline::BODY:
+			WARNING_LOG("Timed out receiving a record body on socket " \
+					<< socket.getHandle())
+			break;
+	}
+	if(socket.valid())
+		cleanupSocket(socket);
+}
+
+void Fastcgipp::Transceiver::requestExpired(
+		const Protocol::RequestId& id,
+		Connection& connection)
+{
+	// The END_REQUEST may have gone out since we last looked
+	cancelEnded(connection);
+	if(connection.requestTimers.erase(id.m_id) == 0)
+		return;
+	m_sendMessage(id, Message(Message::timeout));
+}
+
+void Fastcgipp::Transceiver::cancelEnded(Connection& connection)
+{
+	if(!connection.requestsEnded)
+		return;
+	std::lock_guard<std::mutex> lock(connection.mutex);
+	for(const auto id: connection.endedRequests)
+		connection.requestTimers.erase(id);
+	connection.endedRequests.clear();
+	connection.requestsEnded = false;
+}
+
+void Fastcgipp::Transceiver::collect(Connection& connection)
+{
+	// The stack has the newest record on top so flip it over
+	Record* stack = connection.incoming.exchange(nullptr);
+	Record* next = nullptr;
+	while(stack != nullptr)
+	{
+		Record* const record = stack;
+		stack = record->next;
+		record->next = next;
+		next = record;
+	}
+
+	while(next != nullptr)
+	{
+		std::unique_ptr<Record> record(next);
+		next = record->next;
+		if(connection.generation != record->socket.generation())
+		{
+			dequeued(connection, record->remaining());
+			continue;
 		}
-		else
+		if(record->data.size() >= sizeof(Protocol::Header)
+				&& reinterpret_cast<const Protocol::Header*>(
+					record->data.begin())->type
+				== Protocol::RecordType::END_REQUEST)
 		{
-			std::lock_guard<std::mutex> lock(m_sendBufferMutex);
-			int nn=m_sendBufferSize;
-			++nn;
-			--nn;
-			lastSocket = -1;
-			while(!m_sendBuffer.empty())
+			unsigned requests = connection.requests;
+			while(requests != 0 && !connection.requests.compare_exchange_weak(
+						requests,
+						requests-1));
+
+			// The wheel belongs to the receive thread so it cancels the timer
+			if(m_requestTimeout != 0)
 			{
-				std::unique_ptr<Record> record;
-				{
-					std::map<socket_t,std::list<std::unique_ptr<Record>>>::const_iterator iter;
-					if(lastSocket == -1)
-					{
-						iter=m_sendBuffer.begin();
-					}
-					else
-					{
-						iter=m_sendBuffer.lower_bound(lastSocket);
-						if(iter == m_sendBuffer.end())
-						{
-							iter=m_sendBuffer.begin();
-						}
-						else
-						{
-							if(iter->first == lastSocket)//if not equal,direct use nextsocket
-							{
-								++iter;
-							}
-							if(iter == m_sendBuffer.end())
-							{
-								iter=m_sendBuffer.begin();
-							}
-						}
-					}
-					lastSocket=iter->first;
-					nCountDDD=iter->second.size();
-					++nCountDDD;
-					--nCountDDD;
-					record = std::move(m_sendBuffer[lastSocket].front());
-					m_sendBuffer[lastSocket].pop_front();
-					if(m_sendBuffer[lastSocket].empty())
-					{
-						m_sendBuffer.erase(lastSocket);
-					}
-				}
-				ssize_t sent =-1;
-				int dataSize= record->data.end()-record->read;
-				while(record->read != record->data.end())
-				{
-					sent = record->socket.write(
-						record->read,
-						record->data.end()-record->read);
-					if(sent < 0)
-					{
-						break;
-					}
-					if(sent == 0)
-					{
-						continue;
-					}
-					record->read+=sent;
-				}
-				m_sendBufferSize-=dataSize;
-				if(sent < 0)
-				{
-					record->socket.close(); //record->socket.delayClose();//record->socket.close();
-					std::list<std::unique_ptr<Record>> &listRecord=m_sendBuffer[lastSocket];
-					for(auto iterList=listRecord.begin();iterList != listRecord.end();++iterList)
-					{
-						m_sendBufferSize-=(*iterList)->data.end()-(*iterList)->read;
-					}
-					m_sendBuffer.erase(lastSocket);
-					eraseRecvBufferSock.insert(record->socket);
-					continue;
-				}
-#if FASTCGIPP_LOG_LEVEL > 3
-				++m_recordsSent;
-#endif
-				if(record->kill)
-				{
-					record->socket.delayClose();//record->socket.close();
-					std::list<std::unique_ptr<Record>> &listRecord=m_sendBuffer[lastSocket];
-					for(auto iterList=listRecord.begin();iterList != listRecord.end();++iterList)
-					{
-						m_sendBufferSize-=(*iterList)->data.end()-(*iterList)->read;
-					}
-					m_sendBuffer.erase(lastSocket);
-					eraseRecvBufferSock.insert(record->socket);
-#if FASTCGIPP_LOG_LEVEL > 3
-					++m_connectionKillCount;
-#endif
-				}
-				if(m_sendBuffer.empty())
-				{
-					++nCountDDD;
-					--nCountDDD;
-					int nn=m_sendBufferSize;
-					++nn;
-					--nn;
-				}
+				connection.endedRequests.push_back(
+						reinterpret_cast<const Protocol::Header*>(
+							record->data.begin())->fcgiId);
+				connection.requestsEnded = true;
 			}
 		}
+		connection.records.push_back(std::move(record));
 	}
-	if(!eraseRecvBufferSock.empty())
+}
+
+void Fastcgipp::Transceiver::ready(Reactor& reactor, Connection& connection)
+{
+	if(connection.ready.exchange(true))
+		return;
+
+	Connection* head = reactor.ready.load(std::memory_order_relaxed);
+	do
+		connection.nextReady = head;
+	while(!reactor.ready.compare_exchange_weak(
+				head,
+				&connection,
+				std::memory_order_release,
+				std::memory_order_relaxed));
+
+	if(head == nullptr)
 	{
-		std::lock_guard<std::mutex> lock(m_recvBufferMutex);
-		for(auto iter=eraseRecvBufferSock.begin();iter != eraseRecvBufferSock.end();++iter)
 		{
-			m_receiveBuffers.erase(*iter);
+			std::lock_guard<std::mutex> lock(reactor.wakeMutex);
+			reactor.sendPending=true;
 		}
+		reactor.wakeSend.notify_all();
 	}
-	int nn=m_sendBufferSize;
-	++nn;
-	--nn;
-	return true;
+}
+
+Fastcgipp::Transceiver::Connection::~Connection()
+{
+	Record* record = incoming.load();
+	while(record != nullptr)
+	{
+		Record* const next = record->next;
+		delete record;
+		record = next;
+	}
+}
+
+void Fastcgipp::Transceiver::addReactor()
+{
+	m_reactors.emplace_back(new Reactor);
+	Reactor& reactor = *m_reactors.back();
+	reactor.socketGroup.reuseAddress(m_reuseAddress);
+	reactor.socketGroup.acceptBatch(m_acceptBatch);
+	reactor.socketGroup.onWritable(std::bind(
+				&Transceiver::writable,
+				this,
+				std::ref(reactor),
+				std::placeholders::_1));
+	reactor.socketGroup.onZeroCopied(std::bind(
+				&Transceiver::zeroCopied,
+				this,
+				std::placeholders::_1));
+	reactor.socketGroup.onOpened(std::bind(
+				&Transceiver::opened,
+				this,
+				std::ref(reactor),
+				std::placeholders::_1));
+	reactor.socketGroup.onClosed(std::bind(
+				&Transceiver::closed,
+				this,
+				std::placeholders::_1));
 }
 
 /*void Fastcgipp::Transceiver::handler()
@@ -310,162 +681,505 @@ bool Fastcgipp::Transceiver::transmit()
 	}
 }*/
 
-void Fastcgipp::Transceiver::handler()
+
+void Fastcgipp::Transceiver::handler(Reactor& reactor)
 {
-	std::unique_lock<std::mutex> lock(m_wakeMutex);
-	while(!m_terminate && !(m_stop && m_socketGroup.size()==0))
+	if(!reactor.cpus.empty())
+		pinThread(reactor.cpus);
+
+	std::unique_lock<std::mutex> lock(reactor.wakeMutex);
+	while(!m_terminate && !(m_stop && reactor.socketGroup.size()==0))
 	{
-		m_wakeSend.wait(lock);
-		transmit();
+		if(!reactor.sendPending)
+		{
+			reactor.wakeSend.wait(lock);
+			continue;
+		}
+		reactor.sendPending=false;
+		lock.unlock();
+		transmit(reactor);
+		lock.lock();
 	}
 }
-void Fastcgipp::Transceiver::recvHandler()
+void Fastcgipp::Transceiver::recvHandler(Reactor& reactor)
 {
+	if(!reactor.cpus.empty())
+		pinThread(reactor.cpus);
+
 	Socket socket;
 
-	while(!m_terminate && !(m_stop && m_socketGroup.size()==0))
+	while(!m_terminate && !(m_stop && reactor.socketGroup.size()==0))
 	{
-		socket = m_socketGroup.poll(true);
-		receive(socket);
+		socket = reactor.socketGroup.poll(true, reactor.wheel.timeout());
+		receive(reactor, socket);
+		reactor.wheel.advance();
+	}
+	{
+		std::lock_guard<std::mutex> lock(reactor.wakeMutex);
+		reactor.wakeSend.notify_all();
 	}
 }
 void Fastcgipp::Transceiver::stop()
 {
 	m_stop=true;
-	m_socketGroup.accept(false);
+	for(auto& reactor: m_reactors)
+		reactor->socketGroup.accept(false);
 }
 
 void Fastcgipp::Transceiver::terminate()
 {
 	m_terminate=true;
-	m_socketGroup.wake();
+	for(auto& reactor: m_reactors)
+	{
+		reactor->socketGroup.wake();
+		std::lock_guard<std::mutex> lock(reactor->wakeMutex);
+		reactor->wakeSend.notify_all();
+	}
+	std::lock_guard<std::mutex> lock(m_drainedMutex);
+	m_drained.notify_all();
 }
 
 void Fastcgipp::Transceiver::start()
 {
 	m_stop=false;
 	m_terminate=false;
-	m_socketGroup.accept(true);
-	if(!m_threadRecv.joinable())
+	for(unsigned index=0; index<m_reactors.size(); ++index)
 	{
-		std::thread thread(&Fastcgipp::Transceiver::recvHandler, this);
-		m_threadRecv.swap(thread);
+		auto& reactor = m_reactors[index];
+		reactor->socketGroup.accept(true);
+		if(!reactor->threadRecv.joinable() && !reactor->thread.joinable())
+		{
+			reactor->cpus.clear();
+			if(!m_reactorCpus.empty())
+				reactor->cpus.push_back(
+						m_reactorCpus[index%m_reactorCpus.size()]);
+		}
+		if(!reactor->threadRecv.joinable())
+		{
+			std::thread thread(
+					&Fastcgipp::Transceiver::recvHandler,
+					this,
+					std::ref(*reactor));
+			reactor->threadRecv.swap(thread);
+		}
+		if(!reactor->thread.joinable())
+		{
+			std::thread thread(
+					&Fastcgipp::Transceiver::handler,
+					this,
+					std::ref(*reactor));
+			reactor->thread.swap(thread);
+		}
 	}
-	if(!m_thread.joinable())
+}
+
+void Fastcgipp::Transceiver::join()
+{
+	for(auto& reactor: m_reactors)
 	{
-		std::thread thread(&Fastcgipp::Transceiver::handler, this);
-		m_thread.swap(thread);
+		if(reactor->threadRecv.joinable())
+		{
+			reactor->threadRecv.join();
+		}
+		if(reactor->thread.joinable())
+		{
+			reactor->thread.join();
+		}
 	}
 }
 
-void Fastcgipp::Transceiver::join()
+void Fastcgipp::Transceiver::reactors(unsigned count)
 {
-	if(m_threadRecv.joinable())
+	if(count == 0)
+		count = 1;
+	for(const auto& reactor: m_reactors)
+		if(reactor->thread.joinable() || reactor->threadRecv.joinable())
+			return;
+
+	while(m_reactors.size() > count)
+		m_reactors.pop_back();
+	while(m_reactors.size() < count)
+		addReactor();
+	for(auto& reactor: m_reactors)
+		reactor->socketGroup.exclusiveListen(m_reactors.size()>1);
+}
+
+Fastcgipp::Transceiver::Reactor& Fastcgipp::Transceiver::reactor(
+		const Socket& socket)
+{
+	const SocketGroup* const group = socket.group();
+	if(m_reactors.size() > 1 && group != nullptr)
+		for(auto& reactor: m_reactors)
+			if(&reactor->socketGroup == group)
+				return *reactor;
+	return *m_reactors.front();
+}
+
+void Fastcgipp::Transceiver::shareListeners(const std::set<socket_t>& before)
+{
+	for(const auto listener: m_reactors.front()->socketGroup.listeners())
+		if(before.find(listener) == before.end())
+			for(auto reactor=m_reactors.begin()+1;
+					reactor!=m_reactors.end();
+					++reactor)
+				(*reactor)->socketGroup.share(listener);
+}
+
+bool Fastcgipp::Transceiver::listen()
+{
+	const auto before = m_reactors.front()->socketGroup.listeners();
+	if(!m_reactors.front()->socketGroup.listen())
+		return false;
+	shareListeners(before);
+	return true;
+}
+
+#if ! defined(FASTCGIPP_WINDOWS)
+bool Fastcgipp::Transceiver::listen(
+		const char* name,
+		uint32_t permissions,
+		const char* owner,
+		const char* group)
+{
+	const auto before = m_reactors.front()->socketGroup.listeners();
+	if(!m_reactors.front()->socketGroup.listen(
+				name,
+				permissions,
+				owner,
+				group))
+		return false;
+	shareListeners(before);
+	return true;
+}
+#endif
+
+bool Fastcgipp::Transceiver::inherit(socket_t listener)
+{
+	for(auto& reactor: m_reactors)
+	{
+		reactor->socketGroup.exclusiveListen(true);
+		if(!reactor->socketGroup.share(listener))
+			return false;
+	}
+	return true;
+}
+
+#if ! defined(FASTCGIPP_WINDOWS)
+bool Fastcgipp::Transceiver::sendListeners(socket_t channel)
+{
+	// Listeners shared between reactors are only sent once
+	std::set<socket_t> listeners;
+	for(const auto& reactor: m_reactors)
+		listeners.insert(
+				reactor->socketGroup.listeners().cbegin(),
+				reactor->socketGroup.listeners().cend());
+	return sendSockets(
+			channel,
+			std::vector<socket_t>(listeners.cbegin(), listeners.cend()));
+}
+
+void Fastcgipp::Transceiver::releaseListeners()
+{
+	for(auto& reactor: m_reactors)
+		reactor->socketGroup.handOver();
+}
+
+bool Fastcgipp::Transceiver::adoptListeners(socket_t channel)
+{
+	std::vector<socket_t> listeners;
+	if(!receiveSockets(channel, listeners))
+		return false;
+
+	const auto before = m_reactors.front()->socketGroup.listeners();
+	bool adopted = false;
+	for(const auto listener: listeners)
 	{
-		m_threadRecv.join();
+		if(m_reactors.front()->socketGroup.adopt(listener))
+			adopted = true;
+		else
+			closesocket(listener);
 	}
-	if(m_thread.joinable())
+	shareListeners(before);
+	return adopted;
+}
+#endif
+
+bool Fastcgipp::Transceiver::listen(
+		const char* ifName,
+		const char* service)
+{
+	for(auto& reactor: m_reactors)
 	{
-		m_thread.join();
+		reactor->socketGroup.reusePort(m_reactors.size()>1);
+		if(!reactor->socketGroup.listen(ifName, service))
+			return false;
 	}
+	return true;
+}
+
+bool Fastcgipp::Transceiver::listen(
+		const char* ifName,
+		int port)
+{
+	for(auto& reactor: m_reactors)
+	{
+		reactor->socketGroup.reusePort(m_reactors.size()>1);
+		if(!reactor->socketGroup.listen(ifName, port))
+			return false;
+	}
+	return true;
+}
+
+void Fastcgipp::Transceiver::acceptBatch(unsigned batch)
+{
+	m_acceptBatch = batch?batch:1;
+	for(auto& reactor: m_reactors)
+		reactor->socketGroup.acceptBatch(m_acceptBatch);
+}
+
+void Fastcgipp::Transceiver::reuseAddress(bool value)
+{
+	m_reuseAddress = value;
+	for(auto& reactor: m_reactors)
+		reactor->socketGroup.reuseAddress(value);
 }
 
 Fastcgipp::Transceiver::Transceiver(
 		const std::function<void(Protocol::RequestId, Message&&)> sendMessage):
-	m_sendBuffer()
+	m_maxSendBufferSize(10*1024*1024)
+	,m_maxConnectionBufferSize(4*1024*1024)
 	,m_sendBufferSize(0)
-	,m_maxSendBufferSize(10*1024*1024)
+	,m_busyConnections(0)
+	,m_waiting(0)
+	,m_reuseAddress(false)
+	,m_acceptBatch(64)
 	,m_sendMessage(sendMessage)
+	,m_headerTimeout(0)
+	,m_bodyTimeout(0)
+	,m_idleTimeout(0)
+	,m_requestTimeout(0)
+	,m_maxConnections(0)
+	,m_maxRequests(0)
+	,m_connectionCount(0)
+	,m_requestCount(0)
+	,m_zeroCopyThreshold(0)
+	,m_cork(false)
 #if FASTCGIPP_LOG_LEVEL > 3
 	,m_connectionKillCount(0),
 	m_connectionRDHupCount(0),
 	m_recordsSent(0),
 	m_recordsQueued(0),
-	m_recordsReceived(0)
+	m_recordsReceived(0),
+	m_overloadedCount(0)
 #endif
 {
+	for(auto& page: m_connections)
+		page.store(nullptr);
+	addReactor();
 	DIAG_LOG("Transceiver::Transciever(): Initialized")
 }
 
-void Fastcgipp::Transceiver::receive(Socket& socket)
+void Fastcgipp::Transceiver::receive(Reactor& reactor, Socket& socket)
 {
 	if(socket.valid())
 	{
-		std::shared_ptr<Block> pBuffer;
-		{
-			std::lock_guard<std::mutex> lock(m_recvBufferMutex);
-			if(m_receiveBuffers.find(socket) == m_receiveBuffers.end())
-			{
-				m_receiveBuffers[socket].reset(new Block());
-			}
-			pBuffer=m_receiveBuffers[socket];
-		}
-		Block &buffer=*pBuffer;
-		// Are we receiving a header?
-		if(buffer.size() < sizeof(Protocol::Header))
+		Connection* const connection = this->connection(socket.getHandle());
+		if(connection == nullptr)
 		{
-			buffer.reserve(sizeof(Protocol::Header));
-
-			const ssize_t read = socket.read(
-					buffer.begin()+buffer.size(),
-					buffer.reserve()-buffer.size());
-			if(read<0)
-			{
-				cleanupSocket(socket);
-				return;
-			}
-			buffer.size(buffer.size() + read);
-			if(buffer.size() < sizeof(Protocol::Header))
-				return;
+			ERR_LOG("Socket " << socket.getHandle() \
+					<< " is beyond the connection table")
+			socket.close();
+			return;
 		}
-
-		if(buffer.size() == sizeof(Protocol::Header))
-			buffer.reserve(sizeof(Protocol::Header)
-				+reinterpret_cast<Protocol::Header*>(
-					buffer.begin())->contentLength
-				+reinterpret_cast<Protocol::Header*>(
-					buffer.begin())->paddingLength);
-
-		Protocol::Header& header
-			= *reinterpret_cast<Protocol::Header*>(buffer.begin());
+		if(connection->receiveGeneration != socket.generation()
+				&& !attach(reactor, *connection, socket))
+			return;
+		cancelEnded(*connection);
+		Block &buffer=connection->receiveBuffer;
+		if(buffer.reserve() < s_receiveSize)
+			buffer.reserve(s_receiveSize);
 
 		const ssize_t read = socket.read(
-				buffer.begin()+buffer.size(),
+				buffer.end(),
 				buffer.reserve()-buffer.size());
-
 		if(read<0)
 		{
 			cleanupSocket(socket);
 			return;
 		}
 		buffer.size(buffer.size() + read);
-		if(buffer.size() < buffer.reserve())
-			return;
 
-		Message message;
-		message.data = std::move(buffer);
-		/*pBuffer.reset();
+		// Carve out every complete record we have
+		const char* record = buffer.begin();
+		bool carved=false;
+		while(true)
 		{
-			std::lock_guard<std::mutex> lock(m_recvBufferMutex);
-			m_receiveBuffers.erase(socket);
-		}*/
-		m_sendMessage(
-				Protocol::RequestId(header.fcgiId, socket),
-				std::move(message));
+			const size_t remaining = buffer.end()-record;
+			if(remaining < sizeof(Protocol::Header))
+				break;
+			const Protocol::Header& header
+				= *reinterpret_cast<const Protocol::Header*>(record);
+			const size_t recordSize = sizeof(Protocol::Header)
+				+header.contentLength
+				+header.paddingLength;
+			if(remaining < recordSize)
+			{
+				// Make sure the rest of this one can fit in the buffer
+				if(recordSize > buffer.reserve())
+				{
+					const size_t offset = record-buffer.begin();
+					buffer.reserve(offset+recordSize);
+					record = buffer.begin()+offset;
+				}
+				break;
+			}
+
+			const Protocol::RequestId id(header.fcgiId, socket);
+			if(header.type == Protocol::RecordType::BEGIN_REQUEST)
+			{
+				++connection->requests;
+				if(connection->overloaded || !reserveRequest())
+				{
+					connection->rejected.insert(id.m_id);
+					overloaded(id, header, *connection);
+				}
+				else
+				{
+					if(!connection->rejected.empty())
+						connection->rejected.erase(id.m_id);
+					if(m_requestTimeout != 0)
+					{
+						const auto timer = connection->requestTimers.emplace(
+								std::piecewise_construct,
+								std::forward_as_tuple(id.m_id),
+								std::forward_as_tuple());
+						if(timer.second)
+							timer.first->second.onExpire(std::bind(
+										&Transceiver::requestExpired,
+										this,
+										id,
+										std::ref(*connection)));
+						reactor.wheel.arm(
+								timer.first->second,
+								std::chrono::milliseconds(m_requestTimeout));
+					}
+				}
+			}
+			// Even a record we turn away is progress so the clock restarts
+			carved=true;
+
+			// Nobody is going to handle the rest of a request we turned away
+			if(!connection->rejected.empty()
+					&& connection->rejected.count(id.m_id) != 0)
+			{
+				record += recordSize;
+				continue;
+			}
+
+			Message message;
+			if(record == buffer.begin()
+					&& remaining == recordSize
+					&& recordSize >= s_receiveSize/2)
+			{
+				// A single big record fills the buffer so hand it over
+				// instead of copying it
+				message.data = std::move(buffer);
+				record = buffer.begin();
+			}
+			else
+			{
+				message.data.assign(record, recordSize);
+				record += recordSize;
+			}
+			m_sendMessage(id, std::move(message));
 #if FASTCGIPP_LOG_LEVEL > 3
-		++m_recordsReceived;
+			++m_recordsReceived;
 #endif
+		}
+
+		// Carry any partial record over to the front of the buffer
+		if(record != buffer.begin())
+		{
+			const size_t remaining = buffer.end()-record;
+			std::copy(record, static_cast<const char*>(buffer.end()), buffer.begin());
+			buffer.size(remaining);
+		}
+
+		// Restart the clock on whatever we're waiting for now
+		const Deadline next = buffer.size()==0? Deadline::IDLE:
+			buffer.size()<sizeof(Protocol::Header)? Deadline::HEADER:
+			Deadline::BODY;
+		if(carved || next != connection->deadline)
+			deadline(reactor, *connection, next);
 	}
 }
 
+
+bool Fastcgipp::Transceiver::reserveRequest()
+{
+	unsigned requests = m_requestCount;
+	do
+	{
+		const unsigned limit = m_maxRequests;
+		if(limit != 0 && requests >= limit)
+			return false;
+	} while(!m_requestCount.compare_exchange_weak(requests, requests+1));
+	return true;
+}
+
+void Fastcgipp::Transceiver::overloaded(
+		const Protocol::RequestId& id,
+		const Protocol::Header& header,
+		Connection& connection)
+{
+	// Close the connection afterwards if it is over the limit or if the
+	// other side didn't ask to keep it
+	bool kill = connection.overloaded;
+	if(header.contentLength >= sizeof(Protocol::BeginRequest))
+		kill = kill || reinterpret_cast<const Protocol::BeginRequest*>(
+				reinterpret_cast<const char*>(&header)
+				+sizeof(Protocol::Header))->kill();
+
+	Block record(sizeof(Protocol::Header)+sizeof(Protocol::EndRequest));
+	Protocol::Header& sendHeader
+		= *reinterpret_cast<Protocol::Header*>(record.begin());
+	sendHeader.version = Protocol::version;
+	sendHeader.type = Protocol::RecordType::END_REQUEST;
+	sendHeader.fcgiId = id.m_id;
+	sendHeader.contentLength = sizeof(Protocol::EndRequest);
+	sendHeader.paddingLength = 0;
+
+	Protocol::EndRequest& body = *reinterpret_cast<Protocol::EndRequest*>(
+			record.begin()+sizeof(Protocol::Header));
+	body.appStatus = 0;
+	body.protocolStatus = Protocol::ProtocolStatus::OVERLOADED;
+
+	// We are on the receive thread so waiting for the connection to drain
+	// could stall the whole reactor
+	enqueue(id.m_socket, std::move(record), kill, false);
+#if FASTCGIPP_LOG_LEVEL > 3
+	++m_overloadedCount;
+#endif
+}
+
 void Fastcgipp::Transceiver::cleanupSocket(const Socket& socket)
 {
+	Connection* const connection = this->connection(socket.getHandle());
+	if(connection != nullptr)
 	{
-		std::lock_guard<std::mutex> lock(m_recvBufferMutex);
-		m_receiveBuffers.erase(socket);
+		if(connection->receiveGeneration == socket.generation())
+			connection->receiveBuffer.clear();
+		std::lock_guard<std::mutex> lock(connection->mutex);
+		collect(*connection);
+		if(connection->generation == socket.generation())
+		{
+			dropRecords(*connection);
+			connection->pinned.clear();
+			connection->lingering=false;
+		}
 	}
 	m_sendMessage(
-			Fastcgipp::Protocol::RequestId(Protocol::badFcgiId, socket),
+			Fastcgipp::Protocol::RequestId(Protocol::badFcgiId, socket.id()),
 			Message());
 	socket.delayClose();////socket.close();
 #if FASTCGIPP_LOG_LEVEL > 3
@@ -474,41 +1188,105 @@ void Fastcgipp::Transceiver::cleanupSocket(const Socket& socket)
 }
 
 void Fastcgipp::Transceiver::send(
-		const Socket& socket,
+		const SocketId& socket,
 		Block&& data,
 		bool kill)
+{
+	enqueue(socket, std::move(data), kill, true);
+}
+
+void Fastcgipp::Transceiver::enqueue(
+		const SocketId& socket,
+		Block&& data,
+		bool kill,
+		bool wait)
 {
 	std::unique_ptr<Record> record(new Record(
 				socket,
 				std::move(data),
 				kill,false));
-	int nCount=0;
-	/*old{
-		std::lock_guard<std::mutex> lock(m_sendBufferMutex);
-		nCount=m_sendBuffer.size();
-		m_sendBuffer.push_back(std::move(record));
-	}*/
-	//new
-	int sendDataSize=record->data.size();
-	{
-		std::lock_guard<std::mutex> lock(m_sendBufferMutex);
-		m_sendBuffer[socket.getHandle()].push_back(std::move(record));
-		for(auto iterMap=m_sendBuffer.begin();iterMap != m_sendBuffer.end();++iterMap)
+	if(record->data.size() >= sizeof(Protocol::Header))
+	{
+		const Protocol::RecordType type =
+			reinterpret_cast<const Protocol::Header*>(
+					record->data.begin())->type;
+		if(type != Protocol::RecordType::OUTPUT
+				&& type != Protocol::RecordType::ERR)
+			record->push = true;
+	}
+	const size_t size = record->remaining();
+	Record* const pushed = record.release();
+	queue(socket, pushed, pushed, size, wait);
+}
+
+void Fastcgipp::Transceiver::sendFile(
+		const SocketId& socket,
+		Block&& data,
+		const std::shared_ptr<const File>& file,
+		uint64_t offset,
+		size_t size,
+		size_t padding)
+{
+	std::unique_ptr<Record> header(new Record(
+				socket,
+				std::move(data),
+				false,false));
+	std::unique_ptr<Record> body(new Record(
+				socket,
+				file,
+				offset,
+				size,
+				padding));
+	const size_t total = header->remaining()+body->remaining();
+	Record* const oldest = header.release();
+	Record* const newest = body.release();
+	newest->next = oldest;
+	queue(socket, newest, oldest, total);
+}
+
+void Fastcgipp::Transceiver::queue(
+		const SocketId& socket,
+		Record* newest,
+		Record* oldest,
+		size_t size,
+		bool wait)
+{
+	Connection* const connection = this->connection(socket.socket());
+	Reactor* const reactor = connection?
+		connection->reactor.load():
+		nullptr;
+	if(reactor == nullptr)
+	{
+		while(newest != oldest)
 		{
-			nCount+=iterMap->second.size();
+			Record* const next = newest->next;
+			delete newest;
+			newest = next;
 		}
+		delete oldest;
+		return;
 	}
-	m_sendBufferSize+=sendDataSize;
-	++nCount;
-	--nCount;
-	//m_socketGroup.wake();//do not use,this is for wake poll in one thread transceiver mode,
-	m_wakeSend.notify_all();
+	if(wait && throttled(*connection))
+	{
+		std::unique_lock<std::mutex> lock(m_drainedMutex);
+		++m_waiting;
+		while(throttled(*connection) && !m_terminate)
+			m_drained.wait(lock);
+		--m_waiting;
+	}
+	if(connection->queued.fetch_add(size) == 0 && size != 0)
+		++m_busyConnections;
+	m_sendBufferSize+=size;
+
+	oldest->next = connection->incoming.load(std::memory_order_relaxed);
+	while(!connection->incoming.compare_exchange_weak(oldest->next, newest));
+	ready(*reactor, *connection);
 #if FASTCGIPP_LOG_LEVEL > 3
 	++m_recordsQueued;
 #endif
 }
 void Fastcgipp::Transceiver::send2(
-		const Socket& socket,
+		const SocketId& socket,
 		Block&& data,
 		bool kill)
 {
@@ -523,12 +1301,14 @@ Fastcgipp::Transceiver::~Transceiver()
 			<< m_connectionKillCount)
 	DIAG_LOG("Transceiver::~Transceiver(): Remotely closed sockets === " \
 			<< m_connectionRDHupCount)
-	DIAG_LOG("Transceiver::~Transceiver(): Remaining receive buffers = " \
-			<< m_receiveBuffers.size())
 	DIAG_LOG("Transceiver::~Transceiver(): Records queued === " \
 			<< m_recordsQueued)
 	DIAG_LOG("Transceiver::~Transceiver(): Records sent ===== " \
 			<< m_recordsSent)
 	DIAG_LOG("Transceiver::~Transceiver(): Records received = " \
 			<< m_recordsReceived)
+	DIAG_LOG("Transceiver::~Transceiver(): Requests overloaded = " \
+			<< m_overloadedCount)
+	for(auto& page: m_connections)
+		delete[] page.load();
 }
@@ -0,0 +1,232 @@
+/*!
+ * @file       wheel.cpp
+ * @brief      Defines the Fastcgipp::TimingWheel class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/wheel.hpp"
+
+#include <algorithm>
+
+Fastcgipp::Timer::~Timer()
+{
+    cancel();
+}
+
+void Fastcgipp::Timer::cancel()
+{
+    if(m_wheel != nullptr)
+        m_wheel->cancel(*this);
+}
+
+Fastcgipp::TimingWheel::TimingWheel(std::chrono::milliseconds resolution):
+    m_resolution(std::max(resolution, std::chrono::milliseconds(1))),
+    m_start(Clock::now()),
+    m_tick(0),
+    m_size(0)
+{
+    for(unsigned level=0; level<s_levels; ++level)
+    {
+        m_levelSize[level] = 0;
+        for(auto& slot: m_slots[level])
+            slot.m_next = slot.m_prev = &slot;
+    }
+}
+
+Fastcgipp::TimingWheel::~TimingWheel()
+{
+    for(auto& level: m_slots)
+        for(auto& slot: level)
+            while(slot.m_next != &slot)
+                cancel(*slot.m_next);
+}
+
+uint64_t Fastcgipp::TimingWheel::tick(Clock::time_point time) const
+{
+    if(time <= m_start)
+        return 0;
+    return (time-m_start)/m_resolution;
+}
+
+void Fastcgipp::TimingWheel::arm(Timer& timer, Clock::time_point deadline)
+{
+    cancel(timer);
+
+    // Round up so we never expire early
+    uint64_t expiry = tick(deadline);
+    if(time(expiry) < deadline)
+        ++expiry;
+
+    timer.m_expiry = std::max(expiry, m_tick+1);
+    timer.m_wheel = this;
+    ++m_size;
+    place(timer);
+}
+
+void Fastcgipp::TimingWheel::cancel(Timer& timer)
+{
+    if(timer.m_wheel == nullptr)
+        return;
+    if(timer.m_wheel != this)
+    {
+        timer.m_wheel->cancel(timer);
+        return;
+    }
+    unlink(timer);
+    timer.m_wheel = nullptr;
+    --m_size;
+}
+
+void Fastcgipp::TimingWheel::place(Timer& timer)
+{
+    static const uint64_t span = uint64_t(1)<<(s_bits*s_levels);
+
+    uint64_t expiry = std::max(timer.m_expiry, m_tick);
+    const uint64_t delta = expiry-m_tick;
+    if(delta >= span)
+        expiry = m_tick+span-1;
+
+    unsigned level=0;
+    while(level+1<s_levels && delta>=uint64_t(1)<<(s_bits*(level+1)))
+        ++level;
+
+    Timer& head = m_slots[level][(expiry>>(s_bits*level)) & (s_slots-1)];
+    timer.m_level = level;
+    timer.m_next = &head;
+    timer.m_prev = head.m_prev;
+    head.m_prev->m_next = &timer;
+    head.m_prev = &timer;
+    ++m_levelSize[level];
+}
+
+void Fastcgipp::TimingWheel::unlink(Timer& timer)
+{
+    timer.m_prev->m_next = timer.m_next;
+    timer.m_next->m_prev = timer.m_prev;
+    timer.m_next = nullptr;
+    timer.m_prev = nullptr;
+    --m_levelSize[timer.m_level];
+}
+
+void Fastcgipp::TimingWheel::splice(Timer& from, Timer& to)
+{
+    if(from.m_next == &from)
+        return;
+    from.m_next->m_prev = to.m_prev;
+    to.m_prev->m_next = from.m_next;
+    from.m_prev->m_next = &to;
+    to.m_prev = from.m_prev;
+    from.m_next = from.m_prev = &from;
+}
+
+void Fastcgipp::TimingWheel::cascade(unsigned level)
+{
+    Timer moving;
+    moving.m_next = moving.m_prev = &moving;
+    splice(
+            m_slots[level][(m_tick>>(s_bits*level)) & (s_slots-1)],
+            moving);
+
+    while(moving.m_next != &moving)
+    {
+        Timer& timer = *moving.m_next;
+        unlink(timer);
+        place(timer);
+    }
+}
+
+unsigned Fastcgipp::TimingWheel::advance(Clock::time_point now)
+{
+    const uint64_t target = tick(now);
+    unsigned expired=0;
+
+    Timer due;
+    due.m_next = due.m_prev = &due;
+    while(m_tick < target)
+    {
+        if(m_size == 0)
+        {
+            m_tick = target;
+            break;
+        }
+        ++m_tick;
+
+        // Bring down the upper level slots whose turn has come, top first so
+        // their timers can pass through the levels below
+        for(unsigned level=s_levels-1; level>0; --level)
+            if((m_tick & ((uint64_t(1)<<(s_bits*level))-1)) == 0)
+                cascade(level);
+
+        // Take the slot out before calling anything so timers can be armed
+        // and cancelled freely from the expiry functions
+        splice(m_slots[0][m_tick & (s_slots-1)], due);
+        while(due.m_next != &due)
+        {
+            Timer& timer = *due.m_next;
+            unlink(timer);
+            if(timer.m_expiry > m_tick)
+            {
+                // Parked because it was further out than the wheel spans
+                place(timer);
+                continue;
+            }
+            timer.m_wheel = nullptr;
+            --m_size;
+            ++expired;
+
+            // The function is allowed to destroy the timer
+            const std::function<void()> expire(timer.m_expire);
+            if(expire)
+                expire();
+        }
+    }
+    return expired;
+}
+
+int Fastcgipp::TimingWheel::timeout(Clock::time_point now) const
+{
+    if(m_size == 0)
+        return -1;
+
+    // Find the next tick that either expires something or cascades the upper
+    // levels. The wheel always turns at least once a rotation of level zero.
+    const bool upper = m_size != m_levelSize[0];
+    uint64_t next = m_tick+s_slots;
+    for(uint64_t tick=m_tick+1; tick<m_tick+s_slots; ++tick)
+    {
+        const Timer& slot = m_slots[0][tick & (s_slots-1)];
+        if(slot.m_next != &slot || (upper && (tick & (s_slots-1)) == 0))
+        {
+            next = tick;
+            break;
+        }
+    }
+
+    const Clock::duration wait = time(next)-now;
+    if(wait <= Clock::duration::zero())
+        return 0;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            wait+std::chrono::milliseconds(1)-Clock::duration(1)).count();
+}
@@ -5,12 +5,16 @@
 #include <algorithm>
 #include <iostream>
 #include <string>
+#include <vector>
+#include <cstdio>
 
 unsigned called;
+unsigned fileCalled;
+size_t fileDumped;
 
 const Fastcgipp::Protocol::FcgiId FCGIID = 2006;
 
-void checker(const Fastcgipp::Socket& socket, Fastcgipp::Block&& record)
+void checker(const Fastcgipp::SocketId& socket, Fastcgipp::Block&& record)
 {
     if(record.size() % Fastcgipp::Protocol::chunkSize)
         FAIL_LOG("Our record is not sized properly");
@@ -24,7 +28,7 @@ void checker(const Fastcgipp::Socket& socket, Fastcgipp::Block&& record)
     if(header.version != Fastcgipp::Protocol::version)
         FAIL_LOG("FastCGI version not set properly")
 
-    if(header.type != Fastcgipp::Protocol::RecordType::OUT)
+    if(header.type != Fastcgipp::Protocol::RecordType::OUTPUT)
         FAIL_LOG("FastCGI record type wrong")
 
     switch(called)
@@ -302,10 +306,61 @@ void checker(const Fastcgipp::Socket& socket, Fastcgipp::Block&& record)
     ++called;
 }
 
+const uint64_t FILEOFFSET = 10;
+const size_t FILESIZE = 0xffffU+50;
+
+void fileChecker(
+        const Fastcgipp::SocketId& socket,
+        Fastcgipp::Block&& record,
+        const std::shared_ptr<const Fastcgipp::File>& file,
+        uint64_t offset,
+        size_t size,
+        size_t padding)
+{
+    if(record.size() != sizeof(Fastcgipp::Protocol::Header))
+        FAIL_LOG("Our file record header carries more than a header")
+
+    const Fastcgipp::Protocol::Header& header
+        = *reinterpret_cast<Fastcgipp::Protocol::Header*>(record.begin());
+
+    if(header.fcgiId != FCGIID)
+        FAIL_LOG("Our file record FcgiId doesn't match")
+
+    if(header.version != Fastcgipp::Protocol::version)
+        FAIL_LOG("File record FastCGI version not set properly")
+
+    if(header.type != Fastcgipp::Protocol::RecordType::OUTPUT)
+        FAIL_LOG("File record FastCGI record type wrong")
+
+    if(header.contentLength != size)
+        FAIL_LOG("File record content length doesn't match the file data")
+
+    if(header.paddingLength != padding)
+        FAIL_LOG("File record doesn't carry its own padding")
+
+    if((record.size()+size+padding) % Fastcgipp::Protocol::chunkSize)
+        FAIL_LOG("Our file record is not sized properly")
+
+    if(offset != FILEOFFSET+fileDumped)
+        FAIL_LOG("File record " << fileCalled << " is out of order")
+
+    std::vector<char> data(size);
+    if(file->read(data.data(), size, offset) != static_cast<ssize_t>(size))
+        FAIL_LOG("Couldn't read back file record " << fileCalled)
+    for(size_t i=0; i<size; ++i)
+        if(data[i] != static_cast<char>((offset+i)%251))
+            FAIL_LOG("File record " << fileCalled << " has the wrong data")
+
+    fileDumped += size;
+    ++fileCalled;
+}
+
 int main()
 {
     using Fastcgipp::Encoding;
     called = 0;
+    fileCalled = 0;
+    fileDumped = 0;
 
     // Testing with wide characters
     {
@@ -314,8 +369,10 @@ int main()
                 Fastcgipp::Protocol::RequestId(
                     FCGIID,
                     Fastcgipp::Socket()),
-                Fastcgipp::Protocol::RecordType::OUT,
-                checker);
+                Fastcgipp::Protocol::RecordType::OUTPUT,
+                checker,
+                checker,
+                fileChecker);
 
         std::basic_ostream<wchar_t> out(&streambuf);
         out << "In botany, a tree is a perennial plant with an elongated stem, "
@@ -366,8 +423,10 @@ int main()
                 Fastcgipp::Protocol::RequestId(
                     FCGIID,
                     Fastcgipp::Socket()),
-                Fastcgipp::Protocol::RecordType::OUT,
-                checker);
+                Fastcgipp::Protocol::RecordType::OUTPUT,
+                checker,
+                checker,
+                fileChecker);
 
         std::basic_ostream<char> out(&streambuf);
         out << "In botany, a tree is a perennial plant with an elongated stem, "
@@ -388,5 +447,40 @@ int main()
 
     if(called != 5)
         FAIL_LOG("Our checker() was not called as many times as it should have")
+
+    // Testing dumping part of a file
+    {
+        std::FILE* const tmp = std::tmpfile();
+        if(tmp == nullptr)
+            FAIL_LOG("Unable to create a temporary file")
+        for(size_t i=0; i<FILEOFFSET+FILESIZE+10; ++i)
+            std::fputc(static_cast<char>(i%251), tmp);
+        std::fflush(tmp);
+
+        Fastcgipp::FcgiStreambuf<char> streambuf;
+        streambuf.configure(
+                Fastcgipp::Protocol::RequestId(
+                    FCGIID,
+                    Fastcgipp::Socket()),
+                Fastcgipp::Protocol::RecordType::OUTPUT,
+                checker,
+                checker,
+                fileChecker);
+
+        if(streambuf.written())
+            FAIL_LOG("Fastcgipp::FcgiStreambuf::written() before writing")
+        if(!streambuf.dumpFile(fileno(tmp), FILEOFFSET, FILESIZE))
+            FAIL_LOG("Unable to dump a file")
+        if(!streambuf.written())
+            FAIL_LOG("Fastcgipp::FcgiStreambuf::written() after dumpFile()")
+        std::fclose(tmp);
+
+        if(fileCalled != 2)
+            FAIL_LOG("Our fileChecker() was called " << fileCalled \
+                    << " times instead of 2")
+        if(fileDumped != FILESIZE)
+            FAIL_LOG("Dumped " << fileDumped << " bytes of the file instead "\
+                    "of " << FILESIZE)
+    }
     return 0;
 }
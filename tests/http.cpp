@@ -1,5 +1,6 @@
 #include "fastcgi++/log.hpp"
 #include "fastcgi++/http.hpp"
+#include "fastcgi++/request.hpp"
 
 #include <list>
 #include <array>
@@ -11,6 +12,7 @@
 #include <chrono>
 #include <random>
 #include <cstring>
+#include <locale>
 
 int main()
 {
@@ -724,6 +726,111 @@ int main()
         }
     }
 
+    // Testing Fastcgipp::Request::reset() and Fastcgipp::Http::Environment::clear()
+    {
+        class Request: public Fastcgipp::Request<wchar_t>
+        {
+            bool responseProcess()
+            {
+                return true;
+            }
+        };
+
+        std::string sent;
+        const auto send = [&sent] (
+                const Fastcgipp::SocketId&,
+                Fastcgipp::Block&& record,
+                bool)
+        {
+            const Fastcgipp::Protocol::Header& header
+                = *reinterpret_cast<const Fastcgipp::Protocol::Header*>(
+                        record.begin());
+            sent.append(
+                    record.begin()+sizeof(header),
+                    static_cast<size_t>(header.contentLength));
+        };
+
+        Request request;
+        request.configure(
+                Fastcgipp::Protocol::RequestId(1, Fastcgipp::SocketId()),
+                Fastcgipp::Protocol::Role::RESPONDER,
+                false,
+                send,
+                send,
+                nullptr,
+                nullptr);
+
+        Fastcgipp::Http::Environment<wchar_t>& environment
+            = request.environment();
+        {
+            static const unsigned char data[] =
+#include "urlencodedParam.hpp"
+            environment.fill(
+                    reinterpret_cast<const char*>(data),
+                    reinterpret_cast<const char*>(data+sizeof(data)));
+        }
+        {
+            static const unsigned char data[] =
+#include "urlencodedPost.hpp"
+            environment.fillPostBuffer(
+                    reinterpret_cast<const char*>(data),
+                    reinterpret_cast<const char*>(data+sizeof(data)));
+            environment.parsePostBuffer();
+        }
+        if(environment.host.empty() || environment.posts.empty())
+            FAIL_LOG("Fastcgipp::Request reset test environment didn't fill")
+
+        const size_t hostCapacity = environment.host.capacity();
+        const size_t pathCapacity = environment.pathInfo.capacity();
+        const size_t postCapacity = environment.postBuffer().capacity();
+
+        const std::locale locale(
+                std::locale::classic(),
+                new std::numpunct<wchar_t>);
+        request.out.imbue(locale);
+        request.out << Fastcgipp::Encoding::HTML << L"<left>";
+        request.reset();
+
+        if(sent != "&lt;left&gt;")
+            FAIL_LOG("Fastcgipp::Request::reset() didn't flush what was left")
+
+        if(
+                !environment.host.empty() ||
+                !environment.userAgent.empty() ||
+                !environment.acceptLanguages.empty() ||
+                !environment.contentType.empty() ||
+                !environment.scriptName.empty() ||
+                environment.requestMethod !=
+                    Fastcgipp::Http::RequestMethod::ERR ||
+                !environment.requestUri.empty() ||
+                !environment.pathInfo.empty() ||
+                environment.contentLength != 0 ||
+                environment.serverAddress != Fastcgipp::Address() ||
+                environment.remoteAddress != Fastcgipp::Address() ||
+                environment.serverPort != 0 ||
+                environment.remotePort != 0 ||
+                !environment.gets.empty() ||
+                !environment.posts.empty() ||
+                !environment.cookies.empty() ||
+                !environment.postBuffer().empty())
+            FAIL_LOG("Fastcgipp::Http::Environment::clear() left data behind")
+
+        if(
+                environment.host.capacity() < hostCapacity ||
+                environment.pathInfo.capacity() < pathCapacity ||
+                environment.postBuffer().capacity() < postCapacity)
+            FAIL_LOG("Fastcgipp::Http::Environment::clear() gave up capacity")
+
+        if(request.out.getloc() != std::locale::classic())
+            FAIL_LOG("Fastcgipp::Request::reset() didn't restore the locale")
+
+        sent.clear();
+        request.out << L"<right>";
+        request.out.flush();
+        if(sent != "<right>")
+            FAIL_LOG("Fastcgipp::Request::reset() didn't restore the encoding")
+    }
+
     // Testing Fastcgipp::Http::SessionId
     {
         Fastcgipp::Http::SessionId session1;
@@ -238,5 +238,48 @@ int main()
                     "values and long names")
     }
 
+    // Testing Fastcgipp::Protocol::valuesResult() with short and long values
+    {
+        const std::vector<std::pair<std::string, std::string>> values{
+            {"FCGI_MAX_CONNS", "10"},
+            {"FCGI_MAX_REQS", std::string(300, '5')},
+            {"FCGI_MPXS_CONNS", "1"}};
+        const Fastcgipp::Block record(Fastcgipp::Protocol::valuesResult(values));
+        const Fastcgipp::Protocol::Header& header =
+            *reinterpret_cast<const Fastcgipp::Protocol::Header*>(
+                    record.begin());
+
+        if(!(
+                    header.type
+                        == Fastcgipp::Protocol::RecordType::GET_VALUES_RESULT &&
+                    header.fcgiId == 0 &&
+                    record.size()%Fastcgipp::Protocol::chunkSize == 0 &&
+                    record.size() == sizeof(header)
+                        +header.contentLength
+                        +header.paddingLength))
+            FAIL_LOG("Fastcgipp::Protocol::valuesResult header")
+
+        const char* data = record.begin()+sizeof(header);
+        const char* const dataEnd = data+header.contentLength;
+        const char* name;
+        const char* value;
+        const char* end;
+        for(const auto& pair: values)
+        {
+            if(!Fastcgipp::Protocol::processParamHeader(
+                        data,
+                        dataEnd,
+                        name,
+                        value,
+                        end)
+                    || std::string(name, value) != pair.first
+                    || std::string(value, end) != pair.second)
+                FAIL_LOG("Fastcgipp::Protocol::valuesResult body")
+            data = end;
+        }
+        if(data != dataEnd)
+            FAIL_LOG("Fastcgipp::Protocol::valuesResult content length")
+    }
+
     return 0;
 }
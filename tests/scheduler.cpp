@@ -0,0 +1,286 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/scheduler.hpp"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    Fastcgipp::Protocol::RequestId task(unsigned index)
+    {
+        return Fastcgipp::Protocol::RequestId(
+                index%1000+1,
+                Fastcgipp::SocketId(index/1000, 0));
+    }
+
+    unsigned index(const Fastcgipp::Protocol::RequestId& task)
+    {
+        return task.m_socket.socket()*1000+task.m_id-1;
+    }
+}
+
+int main()
+{
+    // Testing that a worker steals what was queued for another
+    {
+        Fastcgipp::Scheduler scheduler(4);
+        const unsigned count = 1000;
+        for(unsigned i=0; i<count; ++i)
+            scheduler.push(task(i));
+        if(scheduler.size() != count)
+            FAIL_LOG("Fastcgipp::Scheduler::size() after push()")
+
+        std::vector<int> popped(count, 0);
+        Fastcgipp::Protocol::RequestId id;
+        while(scheduler.pop(0, id))
+            ++popped[index(id)];
+        for(unsigned i=0; i<count; ++i)
+            if(popped[i] != 1)
+                FAIL_LOG("Fastcgipp::Scheduler popped task " << i << ' ' \
+                        << popped[i] << " times")
+        if(scheduler.size() != 0)
+            FAIL_LOG("Fastcgipp::Scheduler::size() after pop()")
+    }
+
+    // Testing tasks pushed from outside and from the workers themselves
+    {
+        const unsigned workers = 8;
+        const unsigned outside = 100000;
+        const unsigned total = outside*2;
+        Fastcgipp::Scheduler scheduler(workers);
+        std::unique_ptr<std::atomic_int[]> popped(new std::atomic_int[total]);
+        for(unsigned i=0; i<total; ++i)
+            popped[i] = 0;
+        std::atomic_uint done(0);
+
+        std::vector<std::thread> threads;
+        for(unsigned worker=0; worker<workers; ++worker)
+            threads.emplace_back([&, worker] ()
+                    {
+                        Fastcgipp::Protocol::RequestId id;
+                        while(true)
+                        {
+                            while(scheduler.pop(worker, id))
+                            {
+                                const unsigned i = index(id);
+                                ++popped[i];
+                                // Every outside task spawns one of our own
+                                if(i < outside)
+                                    scheduler.push(task(i+outside));
+                                if(++done == total)
+                                    scheduler.wake();
+                            }
+                            const unsigned generation = scheduler.generation();
+                            if(done == total)
+                                break;
+                            scheduler.idle(worker, generation);
+                        }
+                    });
+
+        for(unsigned i=0; i<outside; ++i)
+            scheduler.push(task(i));
+        for(auto& thread: threads)
+            thread.join();
+
+        for(unsigned i=0; i<total; ++i)
+            if(popped[i] != 1)
+                FAIL_LOG("Fastcgipp::Scheduler popped task " << i << ' ' \
+                        << popped[i] << " times across threads")
+        if(scheduler.size() != 0)
+            FAIL_LOG("Fastcgipp::Scheduler::size() after threads")
+    }
+
+    // Testing that affinity keeps every task of a request on one worker
+    {
+        const unsigned workers = 4;
+        const unsigned requests = 200;
+        const unsigned total = requests*50;
+        Fastcgipp::Scheduler scheduler(workers);
+        scheduler.affinity(true);
+        std::unique_ptr<std::atomic_int[]> popped(
+                new std::atomic_int[requests]);
+        std::unique_ptr<std::atomic_int[]> strays(
+                new std::atomic_int[requests]);
+        for(unsigned i=0; i<requests; ++i)
+            popped[i] = strays[i] = 0;
+        std::atomic_uint done(0);
+
+        std::vector<std::thread> threads;
+        for(unsigned worker=0; worker<workers; ++worker)
+            threads.emplace_back([&, worker] ()
+                    {
+                        Fastcgipp::Protocol::RequestId id;
+                        while(true)
+                        {
+                            while(scheduler.pop(worker, id))
+                            {
+                                const unsigned i = index(id);
+                                ++popped[i];
+                                if(scheduler.worker(id) != worker)
+                                    ++strays[i];
+                                if(++done == total)
+                                    scheduler.wake();
+                            }
+                            const unsigned generation = scheduler.generation();
+                            if(done == total)
+                                break;
+                            scheduler.idle(worker, generation);
+                        }
+                    });
+
+        for(unsigned i=0; i<total; ++i)
+            scheduler.push(task(i%requests));
+        for(auto& thread: threads)
+            thread.join();
+
+        for(unsigned i=0; i<requests; ++i)
+        {
+            if(popped[i] != int(total/requests))
+                FAIL_LOG("Fastcgipp::Scheduler with affinity popped request "\
+                        << i << ' ' << popped[i] << " times")
+            if(strays[i] != 0)
+                FAIL_LOG("Fastcgipp::Scheduler with affinity handed request "\
+                        << i << " to the wrong worker")
+        }
+    }
+
+    // Testing that classes share a worker by weight
+    {
+        Fastcgipp::Scheduler scheduler(1);
+        scheduler.classes({{3, 0}, {1, 0}});
+        const unsigned count = 400;
+        for(unsigned i=0; i<count; ++i)
+            scheduler.push(task(i), 1);
+        for(unsigned i=count; i<count*2; ++i)
+            scheduler.push(task(i), 0);
+
+        unsigned first = 0;
+        Fastcgipp::Protocol::RequestId id;
+        for(unsigned i=0; i<count; ++i)
+        {
+            if(!scheduler.pop(0, id))
+                FAIL_LOG("Fastcgipp::Scheduler with classes ran out early")
+            if(index(id) >= count)
+                ++first;
+        }
+        if(first != count*3/4)
+            FAIL_LOG("Fastcgipp::Scheduler gave the heavier class " << first \
+                    << " of " << count << " tasks")
+    }
+
+    // Testing that a class limit holds tasks back until one is released
+    {
+        Fastcgipp::Scheduler scheduler(2);
+        scheduler.classes({{1, 0}, {1, 1}});
+        scheduler.push(task(0), 1);
+        scheduler.push(task(1), 1);
+
+        Fastcgipp::Protocol::RequestId id;
+        if(!scheduler.pop(0, id))
+            FAIL_LOG("Fastcgipp::Scheduler didn't pop a limited class")
+        if(scheduler.pop(1, id))
+            FAIL_LOG("Fastcgipp::Scheduler popped past a class limit")
+        scheduler.push(task(2), 0);
+        if(!scheduler.pop(1, id) || index(id) != 2)
+            FAIL_LOG("Fastcgipp::Scheduler held back an unlimited class")
+        if(scheduler.pop(1, id))
+            FAIL_LOG("Fastcgipp::Scheduler popped past a class limit")
+        scheduler.release(0);
+        if(!scheduler.pop(1, id) || index(id) != 1)
+            FAIL_LOG("Fastcgipp::Scheduler didn't pop after a release()")
+        if(scheduler.size() != 0)
+            FAIL_LOG("Fastcgipp::Scheduler::size() after class limits")
+    }
+
+    // Testing class limits across threads
+    for(const bool affinity: {false, true})
+    {
+        const unsigned workers = 4;
+        const unsigned total = 20000;
+        const unsigned limit = 2;
+        Fastcgipp::Scheduler scheduler(workers);
+        scheduler.classes({{1, 0}, {2, limit}});
+        scheduler.affinity(affinity);
+        std::unique_ptr<std::atomic_int[]> popped(new std::atomic_int[total]);
+        for(unsigned i=0; i<total; ++i)
+            popped[i] = 0;
+        std::atomic_uint done(0);
+        std::atomic_uint limited(0);
+        std::atomic_uint most(0);
+
+        std::vector<std::thread> threads;
+        for(unsigned worker=0; worker<workers; ++worker)
+            threads.emplace_back([&, worker] ()
+                    {
+                        Fastcgipp::Protocol::RequestId id;
+                        while(true)
+                        {
+                            while(scheduler.pop(worker, id))
+                            {
+                                const unsigned i = index(id);
+                                ++popped[i];
+                                if(i%2)
+                                {
+                                    const unsigned now = ++limited;
+                                    unsigned max = most;
+                                    while(now > max
+                                            && !most.compare_exchange_weak(
+                                                max,
+                                                now));
+                                    std::this_thread::yield();
+                                    --limited;
+                                }
+                                if(++done == total)
+                                    scheduler.wake();
+                            }
+                            const unsigned generation = scheduler.generation();
+                            if(done == total)
+                                break;
+                            scheduler.idle(worker, generation);
+                        }
+                        scheduler.release(worker);
+                    });
+
+        for(unsigned i=0; i<total; ++i)
+            scheduler.push(task(i), i%2);
+        for(auto& thread: threads)
+            thread.join();
+
+        for(unsigned i=0; i<total; ++i)
+            if(popped[i] != 1)
+                FAIL_LOG("Fastcgipp::Scheduler with class limits popped task "\
+                        << i << ' ' << popped[i] << " times")
+        if(most > limit)
+            FAIL_LOG("Fastcgipp::Scheduler handled " << most \
+                    << " tasks of a class limited to " << limit)
+        if(scheduler.size() != 0)
+            FAIL_LOG("Fastcgipp::Scheduler::size() after class limits")
+    }
+
+    // Testing that wake() gets parked workers out of idle()
+    {
+        Fastcgipp::Scheduler scheduler(2);
+        std::atomic_bool stop(false);
+        std::vector<std::thread> threads;
+        for(unsigned worker=0; worker<2; ++worker)
+            threads.emplace_back([&, worker] ()
+                    {
+                        while(true)
+                        {
+                            const unsigned generation = scheduler.generation();
+                            if(stop)
+                                break;
+                            scheduler.idle(worker, generation);
+                        }
+                    });
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        stop = true;
+        scheduler.wake();
+        for(auto& thread: threads)
+            thread.join();
+    }
+
+    return 0;
+}
@@ -111,8 +111,9 @@ void client()
     unsigned int connections=0;
     unsigned int requestCount=0;
 
-    typedef std::map<Fastcgipp::Socket, std::vector<char>> Buffers;
+    typedef std::map<Fastcgipp::SocketId, std::vector<char>> Buffers;
     Buffers buffers;
+    std::map<Fastcgipp::SocketId, Fastcgipp::Socket> sockets;
     typedef Fastcgipp::Protocol::Requests<std::vector<char>> Requests;
     Requests requests;
     Requests::iterator request;
@@ -136,10 +137,12 @@ void client()
                 // Or maybe we should simulate a nasty killed connection?
                 if(requests.size()>=5 && nastyDist(rd))
                 {
-                    request->first.m_socket.close();
+                    const Fastcgipp::SocketId id = request->first.m_socket;
+                    sockets.at(id).close();
+                    sockets.erase(id);
                     --connections;
-                    buffers.erase(request->first.m_socket);
-                    auto range = requests.equal_range(request->first.m_socket);
+                    buffers.erase(id);
+                    auto range = requests.equal_range(id);
                     requests.erase(range.first, range.second);
                     goto RECEIVE;
                 }
@@ -200,6 +203,7 @@ void client()
                     FAIL_LOG("Couln't create a new connection")
 
                 request->second.reserve(sizeof(FullMessage));
+                sockets.emplace(socket.id(), socket);
                 ++connections;
             }
             request->second.resize(sizeof(FullMessage));
@@ -234,7 +238,7 @@ void client()
                     i<request->second.cend();
                     i += sent)
             {
-                sent = request->first.m_socket.write(
+                sent = sockets.at(request->first.m_socket).write(
                         &*i,
                         request->second.cend()-i);
                 if(sent<=0)
@@ -252,7 +256,8 @@ RECEIVE:
             const auto socket = group.poll(false);
             if(socket.valid())
             {
-                std::vector<char>& buffer=buffers[socket];
+                const Fastcgipp::SocketId id = socket.id();
+                std::vector<char>& buffer=buffers[id];
                 size_t received = buffer.size();
 
                 if(received < sizeof(Fastcgipp::Protocol::Header))
@@ -266,8 +271,9 @@ RECEIVE:
                         if(received)
                             FAIL_LOG("FACK")
                         socket.close();
+                        sockets.erase(id);
                         --connections;
-                        auto range = requests.equal_range(socket);
+                        auto range = requests.equal_range(id);
                         int distance = 0;
                         for(auto it = range.first; it != range.second; ++it)
                             ++distance;
@@ -275,7 +281,7 @@ RECEIVE:
                             FAIL_LOG("Got a server side kill that affects "\
                                     "multiple requests")
                         requests.erase(range.first);
-                        buffers.erase(socket);
+                        buffers.erase(id);
                         continue;
                     }
                     received += read;
@@ -310,7 +316,7 @@ RECEIVE:
 
                 auto request = requests.find(Fastcgipp::Protocol::RequestId(
                             header.fcgiId,
-                            socket));
+                            id));
                 if(request == requests.end())
                     FAIL_LOG("Got an echo " << header.fcgiId << " that isn't "\
                             "in our requests")
@@ -319,7 +325,7 @@ RECEIVE:
 
                 bool shared=false;
                 {
-                    auto range = requests.equal_range(socket);
+                    auto range = requests.equal_range(id);
                     for(auto it = range.first; it != range.second; ++it)
                         if(it != request)
                         {
@@ -342,7 +348,8 @@ RECEIVE:
                         {
                             --connections;
                             socket.close();
-                            buffers.erase(socket);
+                            sockets.erase(id);
+                            buffers.erase(id);
                         }
                         requests.erase(request);
                         break;
@@ -0,0 +1,149 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/wheel.hpp"
+
+#include <random>
+#include <memory>
+#include <vector>
+
+int main()
+{
+    using namespace std::chrono;
+    typedef Fastcgipp::TimingWheel::Clock Clock;
+
+    std::random_device device;
+    std::default_random_engine engine(device());
+
+    // Testing that timers across every level expire on time and only once
+    {
+        Fastcgipp::TimingWheel wheel(milliseconds(1));
+        const Clock::time_point start = Clock::now();
+
+        // Deadlines from a few ticks to past what the wheel spans
+        std::uniform_int_distribution<int64_t> randomDeadline(
+                1,
+                int64_t(6)*60*60*1000);
+        const unsigned count = 1000;
+        std::vector<milliseconds> deadlines(count);
+        std::vector<int> fired(count, 0);
+        std::vector<milliseconds> firedAt(count);
+        milliseconds now(0);
+        std::vector<std::unique_ptr<Fastcgipp::Timer>> timers;
+        for(unsigned i=0; i<count; ++i)
+        {
+            deadlines[i] = milliseconds(randomDeadline(engine));
+            timers.emplace_back(new Fastcgipp::Timer(
+                        [&fired, &firedAt, &now, i] ()
+                        {
+                            ++fired[i];
+                            firedAt[i] = now;
+                        }));
+            wheel.arm(*timers.back(), start+deadlines[i]);
+        }
+
+        // Cancel a few of them
+        for(unsigned i=0; i<count; i+=10)
+            wheel.cancel(*timers[i]);
+        if(wheel.size() != count-count/10)
+            FAIL_LOG("Fastcgipp::TimingWheel::size() after cancel")
+
+        std::uniform_int_distribution<int64_t> randomStep(1, 120000);
+        while(now < hours(7))
+        {
+            now += milliseconds(randomStep(engine));
+            wheel.advance(start+now);
+        }
+
+        for(unsigned i=0; i<count; ++i)
+        {
+            if(i%10 == 0)
+            {
+                if(fired[i] != 0)
+                    FAIL_LOG("Fastcgipp::TimingWheel expired a cancelled "\
+                            "timer")
+                continue;
+            }
+            if(fired[i] != 1)
+                FAIL_LOG("Fastcgipp::TimingWheel expired a timer " \
+                        << fired[i] << " times")
+            if(firedAt[i] < deadlines[i] || firedAt[i] > deadlines[i]+minutes(2))
+                FAIL_LOG("Fastcgipp::TimingWheel expired a timer due at " \
+                        << deadlines[i].count() << "ms at " \
+                        << firedAt[i].count() << "ms")
+        }
+        if(wheel.size() != 0 || wheel.timeout(start+now) != -1)
+            FAIL_LOG("Fastcgipp::TimingWheel isn't empty")
+    }
+
+    // Testing tick by tick expiry and timeout()
+    {
+        Fastcgipp::TimingWheel wheel(milliseconds(10));
+        const Clock::time_point start = Clock::now();
+
+        std::uniform_int_distribution<int64_t> randomDeadline(1, 100000);
+        milliseconds now(0);
+        for(int i=0; i<100; ++i)
+        {
+            const milliseconds deadline(now+milliseconds(randomDeadline(engine)));
+            bool fired=false;
+            Fastcgipp::Timer timer([&fired] () { fired=true; });
+            wheel.arm(timer, start+deadline);
+
+            // Follow timeout() the way a poll would
+            while(!fired)
+            {
+                const int timeout = wheel.timeout(start+now);
+                if(timeout < 0)
+                    FAIL_LOG("Fastcgipp::TimingWheel::timeout() with a " \
+                            "timer armed")
+                now += milliseconds(timeout);
+                wheel.advance(start+now);
+                // The wheel may wake right on the deadline to cascade and
+                // only expire the timer on the tick after
+                if(!fired && now >= deadline+milliseconds(10))
+                    FAIL_LOG("Fastcgipp::TimingWheel::timeout() slept past "\
+                            "a deadline")
+            }
+            if(now < deadline || now >= deadline+milliseconds(20))
+                FAIL_LOG("Fastcgipp::TimingWheel expired a timer due at " \
+                        << deadline.count() << "ms at " << now.count() << "ms")
+        }
+    }
+
+    // Testing arming and destroying timers from an expiry function
+    {
+        Fastcgipp::TimingWheel wheel(milliseconds(1));
+        const Clock::time_point start = Clock::now();
+
+        int repeats=0;
+        Fastcgipp::Timer repeating;
+        repeating.onExpire([&] ()
+                {
+                    if(++repeats < 5)
+                        wheel.arm(repeating, start+milliseconds(repeats*100+1));
+                });
+        wheel.arm(repeating, start+milliseconds(1));
+
+        // Both are due on the same tick and the killer goes first
+        std::unique_ptr<Fastcgipp::Timer> victim;
+        Fastcgipp::Timer killer([&victim] () { victim.reset(); });
+        wheel.arm(killer, start+milliseconds(50));
+        victim.reset(new Fastcgipp::Timer(
+                    [] ()
+                    {
+                        FAIL_LOG("Fastcgipp::TimingWheel expired a destroyed "\
+                                "timer")
+                    }));
+        wheel.arm(*victim, start+milliseconds(50));
+
+        std::unique_ptr<Fastcgipp::Timer> suicidal;
+        suicidal.reset(new Fastcgipp::Timer([&suicidal] () { suicidal.reset(); }));
+        wheel.arm(*suicidal, start+milliseconds(20));
+
+        wheel.advance(start+seconds(1));
+        if(repeats != 5 || suicidal || victim || wheel.size() != 0)
+            FAIL_LOG("Fastcgipp::TimingWheel with timers armed and destroyed "\
+                    "from expiry functions")
+    }
+
+    return 0;
+}